@@ -6,19 +6,194 @@
  * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
  * @date 3/24/2008
  */
- 
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
 #include "BTreeIndex.h"
 #include "BTreeNode.h"
 
 using namespace std;
 
+////////////////////////////////////////////////////////////////////////////////
+//                         IndexStats Implementation                          //
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Estimate the # entries in range.
+ * @param range[IN] the key range
+ * @return the estimated # entries with a key in range
+ */
+template <class Key>
+double IndexStatsT<Key>::estimate(const KeyRangeT<Key>& range) const
+{
+	// a key k covers [k, k + 1) on the line of key positions, so that an
+	// equality range of an integer key gets the share of one key value
+	double low = range.hasLow ? keyPosition(range.low) + (range.lowInclusive ? 0 : 1) : -HUGE_VAL;
+	double high = range.hasHigh ? keyPosition(range.high) + (range.highInclusive ? 1 : 0) : HUGE_VAL;
+
+	double n = 0;
+	for (int i = 0; i < bucketCount; i++) {
+		double begin = keyPosition(bounds[i]);
+		double end = (i + 1 < bucketCount) ? keyPosition(bounds[i + 1]) : keyPosition(maxKey) + 1;
+		if (end <= begin) {
+			// every key of the bucket is bounds[i]
+			if (low <= begin && begin < high)
+				n += counts[i];
+			continue;
+		}
+		double overlap = min(high, end) - max(low, begin);
+		if (overlap > 0)
+			n += counts[i] * overlap / (end - begin);
+	}
+	return n;
+}
+
+template <class Key>
+void IndexStatsT<Key>::add(const Key& key)
+{
+	if (bucketCount == 0) {
+		minKey = maxKey = bounds[0] = key;
+		counts[0] = 0;
+		bucketCount = 1;
+	}
+	if (key < minKey) minKey = key;
+	if (maxKey < key) maxKey = key;
+
+	// a key below the first bucket widens it
+	int b = upper_bound(bounds, bounds + bucketCount, key) - bounds - 1;
+	if (b < 0) {
+		b = 0;
+		bounds[0] = key;
+	}
+	counts[b]++;
+	rowCount++;
+}
+
+template <class Key>
+void IndexStatsT<Key>::store(char* buffer) const
+{
+	memcpy(buffer, &rowCount, sizeof(int));
+	memcpy(buffer + sizeof(int), &bucketCount, sizeof(int));
+	buffer += 2 * sizeof(int);
+	memcpy(buffer, &minKey, sizeof(Key));
+	memcpy(buffer + sizeof(Key), &maxKey, sizeof(Key));
+	memcpy(buffer + 2 * sizeof(Key), bounds, sizeof(bounds));
+	memcpy(buffer + 2 * sizeof(Key) + sizeof(bounds), counts, sizeof(counts));
+}
+
+template <class Key>
+void IndexStatsT<Key>::load(const char* buffer)
+{
+	memcpy(&rowCount, buffer, sizeof(int));
+	memcpy(&bucketCount, buffer + sizeof(int), sizeof(int));
+	buffer += 2 * sizeof(int);
+	memcpy(&minKey, buffer, sizeof(Key));
+	memcpy(&maxKey, buffer + sizeof(Key), sizeof(Key));
+	memcpy(bounds, buffer + 2 * sizeof(Key), sizeof(bounds));
+	memcpy(counts, buffer + 2 * sizeof(Key) + sizeof(bounds), sizeof(counts));
+	if (bucketCount < 0 || bucketCount > MAX_BUCKETS)
+		bucketCount = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                          LatchTable Implementation                         //
+////////////////////////////////////////////////////////////////////////////////
+
+LatchTable::LatchTable()
+{
+	// the chunk pointers are zero pages until a chunk is used
+	chunks = (pthread_rwlock_t**) calloc(MAX_CHUNKS, sizeof(pthread_rwlock_t*));
+	chunkCount = 0;
+	pthread_mutex_init(&growLock, NULL);
+}
+
+LatchTable::~LatchTable()
+{
+	for (int i = 0; i < chunkCount; i++) {
+		if (chunks[i] == NULL)
+			continue;
+		for (int j = 0; j < CHUNK_SIZE; j++)
+			pthread_rwlock_destroy(&chunks[i][j]);
+		delete [] chunks[i];
+	}
+	free(chunks);
+	pthread_mutex_destroy(&growLock);
+}
+
+pthread_rwlock_t* LatchTable::latch(PageId pid)
+{
+	int c = pid >> CHUNK_SHIFT;
+	pthread_rwlock_t* chunk = __atomic_load_n(&chunks[c], __ATOMIC_ACQUIRE);
+	if (chunk == NULL) {
+		pthread_mutex_lock(&growLock);
+		if ((chunk = chunks[c]) == NULL) {
+			chunk = new pthread_rwlock_t[CHUNK_SIZE];
+			for (int i = 0; i < CHUNK_SIZE; i++)
+				pthread_rwlock_init(&chunk[i], NULL);
+			__atomic_store_n(&chunks[c], chunk, __ATOMIC_RELEASE);
+			chunkCount = max(chunkCount, c + 1);
+		}
+		pthread_mutex_unlock(&growLock);
+	}
+	return &chunk[pid & (CHUNK_SIZE - 1)];
+}
+
+void LatchTable::lockShared(PageId pid)
+{
+	pthread_rwlock_rdlock(latch(pid));
+}
+
+void LatchTable::lockExclusive(PageId pid)
+{
+	pthread_rwlock_wrlock(latch(pid));
+}
+
+void LatchTable::unlock(PageId pid)
+{
+	pthread_rwlock_unlock(latch(pid));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                          BTreeIndex Implementation                         //
+////////////////////////////////////////////////////////////////////////////////
+
 /*
  * BTreeIndex constructor
  */
-BTreeIndex::BTreeIndex()
+template <class Key>
+BTreeIndexT<Key>::BTreeIndexT()
+{
+	rootPid = -1;
+	treeHeight = 0;
+	residentLevels = DEFAULT_RESIDENT_LEVELS;
+	nextPid = 0;
+	edgePid = -1;
+	edgeHasLow = false;
+	buffered = false;
+	readOnly = false;
+	pendingCount = 0;
+	pthread_rwlock_init(&rootLatch, NULL);
+	pthread_rwlock_init(&residentLatch, NULL);
+	pthread_mutex_init(&allocLock, NULL);
+	pthread_mutex_init(&edgeLock, NULL);
+	pthread_rwlock_init(&bufferLatch, NULL);
+	pthread_mutex_init(&statsLock, NULL);
+}
+
+template <class Key>
+BTreeIndexT<Key>::~BTreeIndexT()
 {
-    rootPid = -1;
-    treeHeight=0;
+	pthread_rwlock_destroy(&rootLatch);
+	pthread_rwlock_destroy(&residentLatch);
+	pthread_mutex_destroy(&allocLock);
+	pthread_mutex_destroy(&edgeLock);
+	pthread_rwlock_destroy(&bufferLatch);
+	pthread_mutex_destroy(&statsLock);
 }
 
 /*
@@ -28,33 +203,54 @@ BTreeIndex::BTreeIndex()
  * @param mode[IN] 'r' for read, 'w' for write
  * @return error code. 0 if no error
  */
-RC BTreeIndex::open(const string& indexname, char mode)
+template <class Key>
+RC BTreeIndexT<Key>::open(const string& indexname, char mode)
 {
 	RC rc;
 	if ((rc = pf.open(indexname, mode)) < 0) {
-    	return rc;
- 	}
-
- 	if(pf.endPid() == 0)
- 	{
- 		rootPid = -1;
- 		treeHeight = 0;
- 		char buffer[PageFile::PAGE_SIZE];
-	 	int* intBufPtr = (int*) buffer;
+		return rc;
+	}
+
+	char buffer[PageFile::PAGE_SIZE];
+	int* intBufPtr = (int*) buffer;
+	if (pf.endPid() == 0) {
+		// page 0 of the index file stores rootPid, treeHeight, the mode
+		// and the key statistics
+		rootPid = -1;
+		treeHeight = 0;
+		buffered = false;
+		stats = IndexStatsT<Key>();
+		memset(buffer, 0, PageFile::PAGE_SIZE);
 		intBufPtr[0] = rootPid;
 		intBufPtr[1] = treeHeight;
-		pf.write(0, buffer);
-
+		intBufPtr[2] = buffered;
+		stats.store(buffer + 3 * sizeof(int));
+		if ((rc = pf.write(0, buffer)) < 0) {
+			pf.close();
+			return rc;
+		}
+	}
+	else {
+		// READ ROOTPID AND TREEHEIGHT
+		if ((rc = pf.read(0, buffer)) < 0) {
+			pf.close();
+			return rc;
+		}
+		rootPid = intBufPtr[0];
+		treeHeight = intBufPtr[1];
+		buffered = (intBufPtr[2] != 0);
+		stats.load(buffer + 3 * sizeof(int));
+	}
+	readOnly = (mode == 'r' || mode == 'R');
+	nextPid = pf.endPid();
+	edgePid = -1;
+	rootBuffer = LeafNode();
+	pendingCount = 0;
 
- 	}
- 	else {
- 		 	// READ ROOTPID AND TREEHEIGHT
-	 	char buffer[PageFile::PAGE_SIZE];
-	 	pf.read(0, buffer);
-	 	int* intBufPtr = (int*) buffer;
-	 	rootPid = intBufPtr[0];
-	 	treeHeight = intBufPtr[1];
- 	}
+	if ((rc = loadResident()) < 0) {
+		pf.close();
+		return rc;
+	}
 	return 0;
 }
 
@@ -62,18 +258,288 @@ RC BTreeIndex::open(const string& indexname, char mode)
  * Close the index file.
  * @return error code. 0 if no error
  */
-RC BTreeIndex::close()
+template <class Key>
+RC BTreeIndexT<Key>::close()
 {
 	char buffer[PageFile::PAGE_SIZE];
- 	int* intBufPtr = (int*) buffer;
-	intBufPtr[0] = rootPid;
-	intBufPtr[1] = treeHeight;
-	pf.write(0, buffer);
+	int* intBufPtr = (int*) buffer;
+
+	// an index opened for reading has nothing to write back
+	if (!readOnly) {
+		// the root's buffer lives in memory only
+		if (buffered)
+			flushBuffers();
+
+		memset(buffer, 0, PageFile::PAGE_SIZE);
+		intBufPtr[0] = rootPid;
+		intBufPtr[1] = treeHeight;
+		intBufPtr[2] = buffered;
+		stats.store(buffer + 3 * sizeof(int));
+		pf.write(0, buffer);
+	}
+	resident.clear();
+	return pf.close();
+}
+
+/*
+ * Set how many levels of nonleaf nodes are kept resident in memory.
+ * @param levels[IN] the # resident levels. 0 keeps nothing resident
+ */
+template <class Key>
+void BTreeIndexT<Key>::setResidentLevels(int levels)
+{
+	residentLevels = max(0, levels);
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::loadResident()
+{
+	// the resident nodes are brought in by readNonLeaf() the first time
+	// a lookup passes them, so opening the index reads page 0 only and
+	// never a page that a statement does not need.
+	resident.clear();
+	return 0;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::readNonLeaf(PageId pid, int level, NonLeafNode*& node, NonLeafNode& scratch)
+{
+	RC rc;
+	if (level <= residentLevels) {
+		pthread_rwlock_rdlock(&residentLatch);
+		typename map<PageId, NonLeafNode>::iterator it = resident.find(pid);
+		bool hit = (it != resident.end());
+		if (hit)
+			node = &it->second;
+		pthread_rwlock_unlock(&residentLatch);
+		if (hit)
+			return 0;
+	}
+
+	if ((rc = scratch.read(pid, pf)) < 0)
+		return rc;
+	node = &scratch;
+	if (level <= residentLevels) {
+		// the page cannot change while the caller holds its latch, so a
+		// copy that another thread made meanwhile is the same node
+		pthread_rwlock_wrlock(&residentLatch);
+		node = &resident.insert(make_pair(pid, scratch)).first->second;
+		pthread_rwlock_unlock(&residentLatch);
+	}
+	return 0;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::writeNonLeaf(PageId pid, int level, NonLeafNode& node)
+{
+	RC rc;
+	if ((rc = node.write(pid, pf)) < 0)
+		return rc;
+
+	// a node stays resident when the root grows above it, so its copy
+	// is refreshed whatever level the node is at by now
+	pthread_rwlock_wrlock(&residentLatch);
+	typename map<PageId, NonLeafNode>::iterator it = resident.find(pid);
+	if (it != resident.end())
+		it->second = node;
+	else if (level <= residentLevels)
+		resident.insert(make_pair(pid, node));
+	pthread_rwlock_unlock(&residentLatch);
+	return 0;
+}
+
+template <class Key>
+PageId BTreeIndexT<Key>::allocatePages(int count)
+{
+	pthread_mutex_lock(&allocLock);
+	PageId pid = nextPid;
+	nextPid += count;
+	pthread_mutex_unlock(&allocLock);
+	return pid;
+}
+
+template <class Key>
+void BTreeIndexT<Key>::setRightEdge(PageId pid, bool hasLow, const Key& low)
+{
+	pthread_mutex_lock(&edgeLock);
+	edgePid = pid;
+	edgeHasLow = hasLow;
+	edgeLow = low;
+	pthread_mutex_unlock(&edgeLock);
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::latchRoot(PageId& pid, int& height, bool exclusiveLeaf)
+{
+	// rootLatch is held until the root page is latched, so the root
+	// cannot be replaced in between
+	pthread_rwlock_rdlock(&rootLatch);
+	pid = rootPid;
+	height = treeHeight;
+	if (height == 1 && exclusiveLeaf)
+		latches.lockExclusive(pid);
+	else if (height > 0)
+		latches.lockShared(pid);
+	pthread_rwlock_unlock(&rootLatch);
+	return height == 0 ? RC_NO_SUCH_RECORD : 0;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::findLeaf(const Key& searchKey, bool first, PageId& pid)
+{
+	RC rc;
+	int height;
+	NonLeafNode scratch;
+	NonLeafNode* node;
+
+	if ((rc = latchRoot(pid, height, false)) < 0)
+		return rc;
+	for (int n = 1; n < height; n++) {
+		PageId child;
+		if ((rc = readNonLeaf(pid, n, node, scratch)) < 0) {
+			latches.unlock(pid);
+			return rc;
+		}
+		if (first)
+			node->locateFirstChildPtr(searchKey, child);
+		else
+			node->locateChildPtr(searchKey, child);
+		latches.lockShared(child);
+		latches.unlock(pid);
+		pid = child;
+	}
+	return 0;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::findEdgeLeaf(bool rightmost, PageId& pid)
+{
+	RC rc;
+	int height;
+	NonLeafNode scratch;
+	NonLeafNode* node;
+
+	if ((rc = latchRoot(pid, height, false)) < 0)
+		return rc;
+	for (int n = 1; n < height; n++) {
+		if ((rc = readNonLeaf(pid, n, node, scratch)) < 0) {
+			latches.unlock(pid);
+			return rc;
+		}
+		PageId child = node->getChildPtr(rightmost ? node->getKeyCount() : 0);
+		latches.lockShared(child);
+		latches.unlock(pid);
+		pid = child;
+	}
+	return 0;
+}
+
+// true if k is strictly inside range, so that cutting range at k leaves
+// two sub-ranges
+template <class Key>
+static bool strictlyInside(const KeyRangeT<Key>& range, const Key& k)
+{
+	return (!range.hasLow || range.low < k) && (!range.hasHigh || k < range.high);
+}
+
+/*
+ * Output the keys that cut range into about parts sub-ranges of similar
+ * size.
+ * @param range[IN] the range to cut
+ * @param parts[IN] the # sub-ranges wanted
+ * @param keys[OUT] at most parts-1 keys strictly inside range, ascending
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC BTreeIndexT<Key>::getSplitKeys(const KeyRangeT<Key>& range, int parts, vector<Key>& keys)
+{
+	RC rc;
+	PageId pid;
+	int height;
+	NonLeafNode scratch;
+	NonLeafNode* node;
+	vector<PageId> children;
+
+	keys.clear();
+	if ((rc = latchRoot(pid, height, false)) < 0)
+		return (rc == RC_NO_SUCH_RECORD) ? 0 : rc;
+	if (height == 1) {
+		// a single leaf
+		latches.unlock(pid);
+		return 0;
+	}
+	if ((rc = readNonLeaf(pid, 1, node, scratch)) < 0) {
+		latches.unlock(pid);
+		return rc;
+	}
+	for (int i = 0; i <= node->getKeyCount(); i++) {
+		if (i < node->getKeyCount() && strictlyInside(range, node->getKey(i)))
+			keys.push_back(node->getKey(i));
+
+		// child i holds the keys from key i-1 up to key i
+		bool aboveLow = (i == node->getKeyCount() || !range.hasLow || range.low < node->getKey(i));
+		bool belowHigh = (i == 0 || !range.hasHigh || !(range.high < node->getKey(i - 1)));
+		if (aboveLow && belowHigh)
+			children.push_back(node->getChildPtr(i));
+	}
+	latches.unlock(pid);
+
+	// too few separators in the root: add those of its children
+	if ((int) keys.size() + 1 < parts && height > 2) {
+		for (unsigned i = 0; i < children.size(); i++) {
+			latches.lockShared(children[i]);
+			rc = readNonLeaf(children[i], 2, node, scratch);
+			for (int j = 0; rc == 0 && j < node->getKeyCount(); j++) {
+				if (strictlyInside(range, node->getKey(j)))
+					keys.push_back(node->getKey(j));
+			}
+			latches.unlock(children[i]);
+			if (rc < 0)
+				return rc;
+		}
+		sort(keys.begin(), keys.end());
+		unsigned n = 0;
+		for (unsigned i = 0; i < keys.size(); i++) {
+			if (n == 0 || keys[n - 1] < keys[i])
+				keys[n++] = keys[i];
+		}
+		keys.resize(n);
+	}
+
+	// keep parts-1 keys spread evenly over the ones found
+	if (parts < 1)
+		parts = 1;
+	if ((int) keys.size() > parts - 1) {
+		vector<Key> picked;
+		for (int j = 1; j < parts; j++)
+			picked.push_back(keys[(long long) j * keys.size() / parts]);
+		keys.swap(picked);
+	}
+	return 0;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::readPrevLeaf(PageId& pid, LeafNode& leaf)
+{
 	RC rc;
-	if ((rc = pf.close()) < 0) {
-    	return rc;
- 	}
-    return 0;
+	PageId target = pid;
+	PageId prev = leaf.getPrevNodePtr();
+
+	// the previous leaf is latched after this one was released, so it may
+	// have split meanwhile. its new siblings then sit between it and this
+	// leaf: follow the next pointers to the leaf right before this one.
+	while (prev != -1) {
+		latches.lockShared(prev);
+		rc = leaf.read(prev, pf);
+		latches.unlock(prev);
+		if (rc < 0)
+			return rc;
+		if (leaf.getNextNodePtr() == target)
+			break;
+		prev = leaf.getNextNodePtr();
+	}
+	pid = prev;
+	return 0;
 }
 
 /*
@@ -82,185 +548,1275 @@ RC BTreeIndex::close()
  * @param rid[IN] the RecordId for the record being inserted into the index
  * @return error code. 0 if no error
  */
-RC BTreeIndex::insert(int key, const RecordId& rid)
+template <class Key>
+RC BTreeIndexT<Key>::insert(const Key& key, const RecordId& rid)
 {
-	if(treeHeight == 0) {
-		createRoot(key, rid);
-		return 0;
+	RC rc = buffered ? insertBuffered(key, rid) : insertUnbuffered(key, rid);
+	if (rc == 0) {
+		pthread_mutex_lock(&statsLock);
+		stats.add(key);
+		pthread_mutex_unlock(&statsLock);
 	}
-	PageId siblingPid;
-	int newRootKey;
-	if((newRootKey = insertionHelper(key, rid, 1, rootPid, siblingPid)) != 0){
-		//New root Node
-		BTNonLeafNode *newRoot = new BTNonLeafNode;
-		newRoot -> initializeRoot(rootPid, newRootKey, siblingPid);
-		rootPid = pf.endPid();
-		newRoot -> write(rootPid, pf);
-		treeHeight++;
-
-	}
-	fprintf (stderr, "newRootKey: %d\n", newRootKey);
-	fprintf (stderr, "treeHeight: %d\n", treeHeight);
-
-    return 0;
-}
-
-
-RC BTreeIndex::createRoot(const int key, const RecordId &rid)
-{
-	BTNonLeafNode *root = new BTNonLeafNode;
-	rootPid = pf.endPid();
-	BTLeafNode *ln1 = new BTLeafNode;
-	BTLeafNode *ln2 = new BTLeafNode;
-	ln2->insert(key, rid);
-	root->initializeRoot(2, key, 3);
-	ln1->setNextNodePtr(3);
-	root->write(rootPid, pf);
-	//fprintf (stderr, "rootPid: %d\n", rootPid);
-	ln1->write(2, pf);
-	ln2->write(3, pf);
-	//fprintf(stderr, "Root created\n");
-	treeHeight+=2;
-
-}
-
-int BTreeIndex::insertionHelper(const int key, const RecordId &rid, int n, PageId pid, PageId &siblingPid)
-{
-	// Not eqaul to tree height meaning we are in the NonLeafNode.
-	if(n != treeHeight) {
-		PageId tempPid;
-		BTNonLeafNode *tempNode = new BTNonLeafNode;
-		tempNode -> read(pid, pf);
-		tempNode -> locateChildPtr(key, tempPid);
-		int siblingKey;
-		if(siblingKey = insertionHelper(key, rid, n+1, tempPid, siblingPid) != 0)
-		{
-			if((tempNode -> insert(siblingKey, siblingPid)) < 0) {
-				int midKey;
-				BTNonLeafNode *siblingNode = new BTNonLeafNode;
-				tempNode -> insertAndSplit (siblingKey, siblingPid, *siblingNode, midKey);
-				siblingPid = pf.endPid();
-				siblingNode -> write(siblingPid, pf);
-				tempNode -> write(pid, pf);
-
-				return midKey;
-			}
-			else {
-				tempNode -> write(pid, pf);
-				return 0;
+	return rc;
+}
+
+/*
+ * Return the number of (key, RecordId) pairs in the index.
+ * @return the # entries in the index
+ */
+template <class Key>
+int BTreeIndexT<Key>::getRowCount() const
+{
+	pthread_mutex_lock(&statsLock);
+	int n = stats.rowCount;
+	pthread_mutex_unlock(&statsLock);
+	return n;
+}
+
+/*
+ * Output the key statistics of the index.
+ * @param stats[OUT] the statistics
+ */
+template <class Key>
+void BTreeIndexT<Key>::getStats(IndexStatsT<Key>& out) const
+{
+	pthread_mutex_lock(&statsLock);
+	out = stats;
+	pthread_mutex_unlock(&statsLock);
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::insertUnbuffered(const Key& key, const RecordId& rid)
+{
+	RC rc;
+	// most inserts fit in their leaf and need only the leaf latched
+	// exclusively. the path is latched exclusively only for a split.
+	if ((rc = insertIntoLeaf(key, rid)) != RC_NODE_FULL)
+		return rc;
+	return insertWithSplit(key, rid);
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::insertIntoLeaf(const Key& key, const RecordId& rid)
+{
+	RC rc;
+	PageId pid;
+	int height;
+	NonLeafNode scratch;
+	NonLeafNode* node;
+	LeafNode leaf;
+
+	// a key that belongs to the rightmost leaf, as every key of an
+	// ascending stream does, goes straight there without a descent.
+	// the hint is checked again under the leaf latch, since only a
+	// split of that leaf, which needs the latch, moves the right edge.
+	pthread_mutex_lock(&edgeLock);
+	pid = edgePid;
+	bool onEdge = (pid != -1 && (!edgeHasLow || !(key < edgeLow)));
+	pthread_mutex_unlock(&edgeLock);
+	if (onEdge) {
+		latches.lockExclusive(pid);
+		pthread_mutex_lock(&edgeLock);
+		onEdge = (pid == edgePid);
+		pthread_mutex_unlock(&edgeLock);
+		if (onEdge) {
+			if ((rc = leaf.read(pid, pf)) == 0 && (rc = leaf.insert(key, rid)) == 0)
+				rc = leaf.write(pid, pf);
+			latches.unlock(pid);
+			return rc;
+		}
+		latches.unlock(pid);
+	}
+
+	if (latchRoot(pid, height, true) < 0)
+		return RC_NODE_FULL;
+	for (int n = 1; n < height; n++) {
+		PageId child;
+		if ((rc = readNonLeaf(pid, n, node, scratch)) < 0) {
+			latches.unlock(pid);
+			return rc;
+		}
+		node->locateChildPtr(key, child);
+		if (n + 1 == height)
+			latches.lockExclusive(child);
+		else
+			latches.lockShared(child);
+		latches.unlock(pid);
+		pid = child;
+	}
+
+	if ((rc = leaf.read(pid, pf)) == 0 && (rc = leaf.insert(key, rid)) == 0)
+		rc = leaf.write(pid, pf);
+	latches.unlock(pid);
+	return rc;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::insertWithSplit(const Key& key, const RecordId& rid)
+{
+	RC rc = 0;
+	pthread_rwlock_wrlock(&rootLatch);
+	if (treeHeight == 0) {
+		rc = createRoot(key, rid);
+		pthread_rwlock_unlock(&rootLatch);
+		return rc;
+	}
+
+	// latch the path exclusively from the root down. a node with room
+	// for one more entry stops a split below it, so the latches above it
+	// (and rootLatch, if it is not the root that may split) are released.
+	// path[i] is at level top + i, and nodes[i] is a copy of it.
+	vector<PageId>      path;
+	vector<NonLeafNode> nodes;
+	LeafNode leaf;
+	bool     holdRoot = true;
+	int      height = treeHeight;
+	int      top = 1;
+	PageId   pid = rootPid;
+	latches.lockExclusive(pid);
+	path.push_back(pid);
+	for (int n = 1; ; n++) {
+		bool safe;
+		if (n == height) {
+			if ((rc = leaf.read(pid, pf)) < 0)
+				break;
+			safe = leaf.getKeyCount() < LeafNode::MAX_KEY_COUNT;
+		} else {
+			NonLeafNode scratch;
+			NonLeafNode* node;
+			if ((rc = readNonLeaf(pid, n, node, scratch)) < 0)
+				break;
+			nodes.push_back(*node);
+			safe = node->getKeyCount() < nonLeafCapacity();
+		}
+		if (safe) {
+			for (int i = 0; i + 1 < (int) path.size(); i++)
+				latches.unlock(path[i]);
+			path.erase(path.begin(), path.end() - 1);
+			nodes.erase(nodes.begin(), nodes.begin() + (nodes.size() - (n < height)));
+			top = n;
+			if (holdRoot) {
+				pthread_rwlock_unlock(&rootLatch);
+				holdRoot = false;
 			}
 		}
+		if (n == height)
+			break;
+		nodes.back().locateChildPtr(key, pid);
+		latches.lockExclusive(pid);
+		path.push_back(pid);
+	}
 
+	// a key past the end of the rightmost leaf extends the right edge of
+	// the tree. nothing is inserted left of it again in an ascending
+	// stream, so the nodes there are kept full rather than split in half.
+	bool append = false;
+	if (rc == 0 && leaf.getNextNodePtr() == -1 && leaf.getKeyCount() > 0) {
+		Key      lastKey;
+		RecordId lastRid;
+		leaf.readEntry(leaf.getKeyCount() - 1, lastKey, lastRid);
+		append = !(key < lastKey);
 	}
-	// Eqaul to tree height meaning we are in the LeafNode. Insert key and rid in the leafNode and check if it overflows.
-	// If it overflows, return siblingKey to insert in the parentNode.
-	// If not return 0.
-	else if (n == treeHeight){
-		BTLeafNode *tempNode = new BTLeafNode;
-		tempNode -> read(pid, pf);
-		if((tempNode -> insert(key, rid)) < 0) {
-			BTLeafNode *siblingNode = new BTLeafNode;
-			int siblingKey;
-			tempNode -> insertAndSplit (key, rid, *siblingNode, siblingKey);
-			siblingPid = pf.endPid();
-			tempNode -> setNextNodePtr(siblingPid);
-			siblingNode -> write(siblingPid, pf);
-			tempNode -> write (pid, pf);
-			
-			return siblingKey;
+
+	// insert into the leaf and carry the splits up the latched path
+	Key    siblingKey;
+	PageId siblingPid = -1;
+	if (rc == 0)
+		rc = insertLeaf(path.back(), leaf, key, rid, append, siblingKey, siblingPid);
+	for (int i = (int) nodes.size() - 1; rc == 0 && siblingPid != -1 && i >= 0; i--) {
+		Key    childKey = siblingKey;
+		PageId childPid = siblingPid;
+		siblingPid = -1;
+		if (nodes[i].getKeyCount() < nonLeafCapacity() && nodes[i].insert(childKey, childPid) == 0) {
+			rc = writeNonLeaf(path[i], top + i, nodes[i]);
+			break;
 		}
-		else {
-			tempNode -> write(pid, pf);
-			
-			return 0;
+		NonLeafNode sibling;
+		nodes[i].insertAndSplit(childKey, childPid, sibling, siblingKey,
+			append ? nodes[i].getKeyCount() : -1);
+		if (buffered)
+			rc = splitBuffer(path[i], nodes[i], sibling, siblingKey);
+		siblingPid = allocatePages(1);
+		if (rc == 0 && (rc = writeNonLeaf(siblingPid, top + i, sibling)) == 0)
+			rc = writeNonLeaf(path[i], top + i, nodes[i]);
+	}
+
+	if (rc == 0 && siblingPid != -1) {
+		// the root was split, so no node on the path was safe and rootLatch
+		// is still held. grow the tree by one level with a new root node.
+		NonLeafNode newRoot;
+		newRoot.initializeRoot(rootPid, siblingKey, siblingPid);
+		PageId newRootPid = allocatePages(1);
+		if ((rc = writeNonLeaf(newRootPid, 1, newRoot)) == 0) {
+			rootPid = newRootPid;
+			treeHeight++;
 		}
 	}
+
+	for (int i = 0; i < (int) path.size(); i++)
+		latches.unlock(path[i]);
+	if (holdRoot)
+		pthread_rwlock_unlock(&rootLatch);
+	return rc;
 }
 
-/*
- * Find the leaf-node index entry whose key value is larger than or 
- * equal to searchKey, and output the location of the entry in IndexCursor.
- * IndexCursor is a "pointer" to a B+tree leaf-node entry consisting of
- * the PageId of the node and the SlotID of the index entry.
- * Note that, for range queries, we need to scan the B+tree leaf nodes.
- * For example, if the query is "key > 1000", we should scan the leaf
- * nodes starting  with the key value 1000. For this reason,
- * it is better to return the location of the leaf node entry 
- * for a given searchKey, instead of returning the RecordId
- * associated with the searchKey directly.
- * Once the location of the index entry is identified and returned 
- * from this function, you should call readForward() to retrieve the
- * actual (key, rid) pair from the index.
- * @param key[IN] the key to find.
- * @param cursor[OUT] the cursor pointing to the first index entry
- *                    with the key value.
- * @return error code. 0 if no error.
- */
-RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
+template <class Key>
+RC BTreeIndexT<Key>::insertLeaf(PageId pid, LeafNode& leaf, const Key& key, const RecordId& rid,
+	bool append, Key& siblingKey, PageId& siblingPid)
 {
-	// fprintf(stderr, "11\n");
-	BTNonLeafNode *tempNonLeafNode; 
-	PageId tempPid = rootPid;
-	// fprintf(stderr, "rootPid: %d\n", rootPid);
-	// fprintf(stderr, "12\n");
-	// fprintf(stderr, "treeHeight: %d\n", treeHeight);
+	RC rc;
+	siblingPid = -1;
+	if (leaf.insert(key, rid) == 0)
+		return leaf.write(pid, pf);
 
-	for (int i = 1; i < treeHeight; i++)
-	{
-		// fprintf(stderr, "13\n");
-		tempNonLeafNode = new BTNonLeafNode;
-		tempNonLeafNode -> read(tempPid, pf);
-		tempNonLeafNode -> locateChildPtr(searchKey, tempPid);
-		delete tempNonLeafNode;
-	}
-	//tempPid now pointing to leafNode
-	//locate searchKey from the leafnode
-	// fprintf(stderr, "14\n");
-	BTLeafNode *tempLeafNode = new BTLeafNode;
-	tempLeafNode -> read(tempPid, pf);
-	bool empty;
-	do {
-		// fprintf(stderr, "15\n");
-		empty = false;
-		// fprintf(stderr, "searchKey: %d\n", searchKey);
-		if( (tempLeafNode -> locate(searchKey, cursor.eid)) < 0 )
-		{
-			// fprintf(stderr, "16\n");
-			tempPid = tempLeafNode -> getNextNodePtr();
-			if(tempPid == -1)
-				return RC_NO_SUCH_RECORD;
-			tempLeafNode -> read(tempPid, pf);
-			empty = true;
+	// the sibling goes in between this leaf and its old next leaf. it is
+	// written before anything points to it, and the old next leaf is
+	// latched left to right like every other leaf-to-leaf step.
+	LeafNode sibling;
+	leaf.insertAndSplit(key, rid, sibling, siblingKey, append ? leaf.getKeyCount() : -1);
+	siblingPid = allocatePages(1);
+	sibling.setPrevNodePtr(pid);
+	leaf.setNextNodePtr(siblingPid);
+	if ((rc = sibling.write(siblingPid, pf)) < 0)
+		return rc;
+	PageId nextPid = sibling.getNextNodePtr();
+	if (nextPid != -1) {
+		LeafNode next;
+		latches.lockExclusive(nextPid);
+		if ((rc = next.read(nextPid, pf)) == 0) {
+			next.setPrevNodePtr(siblingPid);
+			rc = next.write(nextPid, pf);
 		}
-		// fprintf(stderr, "17\n");
-	}while (empty);
-	cursor.pid = tempPid;
-	delete tempLeafNode;
-    return 0;
+		latches.unlock(nextPid);
+		if (rc < 0)
+			return rc;
+	}
+	if ((rc = leaf.write(pid, pf)) < 0)
+		return rc;
+
+	// the sibling of the rightmost leaf is the new rightmost leaf
+	if (nextPid == -1)
+		setRightEdge(siblingPid, true, siblingKey);
+	return 0;
 }
 
 /*
- * Read the (key, rid) pair at the location specified by the index cursor,
- * and move foward the cursor to the next entry.
- * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
- * @param key[OUT] the key stored at the index cursor location.
- * @param rid[OUT] the RecordId stored at the index cursor location.
+ * Turn the buffered (B-epsilon tree) insert mode on or off.
+ * @param on[IN] true for buffered mode
  * @return error code. 0 if no error
  */
-RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
+template <class Key>
+RC BTreeIndexT<Key>::setBuffered(bool on)
 {
 	RC rc;
-	BTLeafNode *leafNode = new BTLeafNode;
-	leafNode -> read(cursor.pid, pf);
-	if(rc = (leafNode -> readEntry(cursor.eid, key, rid)) < 0) 
+	if (!on && buffered && (rc = flushBuffers()) < 0)
 		return rc;
-	if(cursor.eid == (leafNode -> getKeyCount())-1) //If eid is the last entry in the node
-	{
-		cursor.pid = leafNode -> getNextNodePtr();
-		cursor.eid = 0;
-	}
-	else // If eid is not the last entry in the node.
-		cursor.eid++;
-	delete leafNode;
+	buffered = on;
 	return 0;
 }
+
+/*
+ * Push every pending insert of a buffered index down to the leaves.
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC BTreeIndexT<Key>::flushBuffers()
+{
+	RC rc = 0;
+	bool moved = true;
+
+	// a split hands messages to a node that a pass may have gone by
+	// already, and a new root shifts every level, so pass over the tree
+	// until nothing is left
+	pthread_rwlock_wrlock(&bufferLatch);
+	while (rc == 0 && pendingCount > 0 && moved) {
+		moved = false;
+		rc = drainSubtree(rootPid, 1, treeHeight, moved);
+	}
+	pthread_rwlock_unlock(&bufferLatch);
+	return rc;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::flushIfPending()
+{
+	if (!buffered)
+		return 0;
+	pthread_rwlock_rdlock(&bufferLatch);
+	bool pending = (pendingCount > 0);
+	pthread_rwlock_unlock(&bufferLatch);
+	return pending ? flushBuffers() : 0;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::insertBuffered(const Key& key, const RecordId& rid)
+{
+	RC rc = 0;
+
+	// a tree of a single leaf has no buffer yet
+	pthread_rwlock_wrlock(&bufferLatch);
+	while (rc == 0 && treeHeight > 1 && rootBuffer.getKeyCount() >= LeafNode::MAX_KEY_COUNT)
+		rc = flushStep(rootPid, 1);
+	if (rc == 0) {
+		if (treeHeight > 1) {
+			if ((rc = rootBuffer.insert(key, rid)) == 0)
+				pendingCount++;
+		} else
+			rc = insertUnbuffered(key, rid);
+	}
+	pthread_rwlock_unlock(&bufferLatch);
+	return rc;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::readBuffer(PageId pid, int level, NonLeafNode& node, LeafNode& buffer)
+{
+	RC rc;
+	NonLeafNode* current;
+
+	latches.lockShared(pid);
+	rc = readNonLeaf(pid, level, current, node);
+	if (rc == 0 && current != &node)
+		node = *current;
+	latches.unlock(pid);
+	if (rc < 0)
+		return rc;
+
+	// buffer pages are only used under bufferLatch, so they need no latch
+	buffer = LeafNode();
+	if (pid == rootPid)
+		buffer = rootBuffer;
+	else if (node.getBufferPtr() != -1)
+		rc = buffer.read(node.getBufferPtr(), pf);
+	return rc;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::writeBuffer(PageId pid, NonLeafNode& node, LeafNode& buffer)
+{
+	if (pid == rootPid) {
+		rootBuffer = buffer;
+		return 0;
+	}
+	return buffer.write(node.getBufferPtr(), pf);
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::flushStep(PageId pid, int level)
+{
+	RC rc;
+	NonLeafNode node;
+	LeafNode    buffer;
+	if ((rc = readBuffer(pid, level, node, buffer)) < 0)
+		return rc;
+
+	int count = buffer.getKeyCount();
+	if (count == 0)
+		return 0;
+
+	// the messages are sorted, so the ones that go to the same child are
+	// next to each other. pick the longest run of them.
+	int    begin = 0, end = 0;
+	PageId child = -1;
+	for (int i = 0; i < count; ) {
+		Key      key;
+		RecordId rid;
+		PageId   first, next;
+		buffer.readEntry(i, key, rid);
+		node.locateChildPtr(key, first);
+		int j = i + 1;
+		for (; j < count; j++) {
+			buffer.readEntry(j, key, rid);
+			node.locateChildPtr(key, next);
+			if (next != first)
+				break;
+		}
+		if (j - i > end - begin) {
+			begin = i;
+			end = j;
+			child = first;
+		}
+		i = j;
+	}
+
+	if (level + 1 < treeHeight) {
+		// the child is a nonleaf node: move the run to its buffer, or make
+		// room there first
+		NonLeafNode childNode;
+		LeafNode    childBuffer;
+		if ((rc = readBuffer(child, level + 1, childNode, childBuffer)) < 0)
+			return rc;
+		if (childBuffer.getKeyCount() + (end - begin) > LeafNode::MAX_KEY_COUNT)
+			return flushStep(child, level + 1);
+
+		for (int i = begin; i < end; i++) {
+			Key      key;
+			RecordId rid;
+			buffer.readEntry(i, key, rid);
+			childBuffer.insert(key, rid);
+		}
+		if (childNode.getBufferPtr() == -1) {
+			PageId bufferPid = allocatePages(1);
+			if ((rc = childBuffer.write(bufferPid, pf)) < 0)
+				return rc;
+			latches.lockExclusive(child);
+			childNode.setBufferPtr(bufferPid);
+			rc = writeNonLeaf(child, level + 1, childNode);
+			latches.unlock(child);
+		} else
+			rc = childBuffer.write(childNode.getBufferPtr(), pf);
+		if (rc < 0)
+			return rc;
+		buffer.erase(begin, end);
+		return writeBuffer(pid, node, buffer);
+	}
+
+	// the child is a leaf. take the run out of this buffer first, since
+	// the inserts into the leaf may split this node and its buffer.
+	LeafNode run = buffer;
+	buffer.erase(begin, end);
+	if ((rc = writeBuffer(pid, node, buffer)) < 0)
+		return rc;
+	return applyToLeaf(child, run, begin, end);
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::applyToLeaf(PageId pid, LeafNode& buffer, int begin, int end)
+{
+	RC       rc;
+	LeafNode leaf;
+	Key      key;
+	RecordId rid;
+	int      i = begin;
+
+	// what fits in the leaf costs one latch and one write in all
+	latches.lockExclusive(pid);
+	if ((rc = leaf.read(pid, pf)) == 0) {
+		for (; i < end; i++) {
+			buffer.readEntry(i, key, rid);
+			if (leaf.insert(key, rid) < 0)
+				break;
+		}
+		if (i > begin)
+			rc = leaf.write(pid, pf);
+	}
+	latches.unlock(pid);
+
+	// the rest splits the leaf on the usual path
+	for (; rc == 0 && i < end; i++) {
+		buffer.readEntry(i, key, rid);
+		rc = insertUnbuffered(key, rid);
+	}
+	pendingCount -= end - begin;
+	return rc;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::drainSubtree(PageId pid, int level, int height, bool& moved)
+{
+	RC          rc;
+	NonLeafNode node;
+	LeafNode    buffer;
+	if (level >= height)
+		return 0;
+
+	// empty the buffer of this node, then the buffers below it
+	for (;;) {
+		if ((rc = readBuffer(pid, level, node, buffer)) < 0)
+			return rc;
+		if (buffer.getKeyCount() == 0)
+			break;
+		if ((rc = flushStep(pid, level)) < 0)
+			return rc;
+		moved = true;
+		if (treeHeight != height)
+			return 0;
+	}
+	for (int i = 0; i <= node.getKeyCount(); i++) {
+		if ((rc = drainSubtree(node.getChildPtr(i), level + 1, height, moved)) < 0)
+			return rc;
+		if (treeHeight != height)
+			return 0;
+	}
+	return 0;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::splitBuffer(PageId pid, NonLeafNode& node, NonLeafNode& sibling, const Key& midKey)
+{
+	RC       rc;
+	LeafNode buffer;
+	bool     isRoot = (pid == rootPid);
+	if (isRoot)
+		buffer = rootBuffer;
+	else if (node.getBufferPtr() != -1 && (rc = buffer.read(node.getBufferPtr(), pf)) < 0)
+		return rc;
+
+	// the messages >= midKey now go through the sibling
+	int count = buffer.getKeyCount();
+	int cut;
+	if (buffer.locate(midKey, cut) != 0)
+		cut = count;
+	if (cut < count) {
+		LeafNode right;
+		for (int i = cut; i < count; i++) {
+			Key      key;
+			RecordId rid;
+			buffer.readEntry(i, key, rid);
+			right.insert(key, rid);
+		}
+		buffer.erase(cut, count);
+		PageId bufferPid = allocatePages(1);
+		if ((rc = right.write(bufferPid, pf)) < 0)
+			return rc;
+		sibling.setBufferPtr(bufferPid);
+	}
+
+	if (isRoot) {
+		// the root is about to get a parent, so its buffer goes to a page
+		rootBuffer = LeafNode();
+		if (buffer.getKeyCount() == 0)
+			return 0;
+		if (node.getBufferPtr() == -1)
+			node.setBufferPtr(allocatePages(1));
+	} else if (node.getBufferPtr() == -1)
+		return 0;
+	return buffer.write(node.getBufferPtr(), pf);
+}
+
+/*
+ * Build the index bottom-up from (key, RecordId) pairs sorted by key.
+ * @param entries[IN] the pairs to load, sorted by key
+ * @param n[IN] the number of pairs
+ * @param fillFactor[IN] the fraction (0, 1] of each node to fill
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC BTreeIndexT<Key>::bulkLoad(const IndexEntry* entries, int n, double fillFactor)
+{
+	RC rc = 0;
+
+	// readers see an empty tree until the whole tree is built
+	pthread_rwlock_wrlock(&rootLatch);
+	if (treeHeight == 0) {
+		if (n > 0)
+			rc = buildBottomUp(entries, n, fillFactor);
+		pthread_rwlock_unlock(&rootLatch);
+		return rc;
+	}
+	pthread_rwlock_unlock(&rootLatch);
+
+	for (int i = 0; i < n; i++) {
+		if ((rc = insert(entries[i].key, entries[i].rid)) < 0)
+			return rc;
+	}
+	return 0;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::buildBottomUp(const IndexEntry* entries, int n, double fillFactor)
+{
+	RC rc;
+	if (fillFactor <= 0 || fillFactor > 1)
+		fillFactor = DEFAULT_FILL_FACTOR;
+
+	// the first key and the pid of every node on the level just built
+	vector<Key>    levelKeys;
+	vector<PageId> levelPids;
+
+	// pack the leaves left to right. the entries are spread evenly over
+	// the leaves so that the last one is not left nearly empty.
+	int leafCap = max(1, (int) (LeafNode::MAX_KEY_COUNT * fillFactor));
+	int leafCount = (n + leafCap - 1) / leafCap;
+	PageId firstPid = allocatePages(leafCount);
+	for (int i = 0; i < leafCount; i++) {
+		int begin = (int) ((long long) n * i / leafCount);
+		int end = (int) ((long long) n * (i + 1) / leafCount);
+		LeafNode leaf;
+		for (int j = begin; j < end; j++)
+			leaf.insert(entries[j].key, entries[j].rid);
+		leaf.setPrevNodePtr(i == 0 ? -1 : firstPid + i - 1);
+		leaf.setNextNodePtr(i == leafCount - 1 ? -1 : firstPid + i + 1);
+		if ((rc = leaf.write(firstPid + i, pf)) < 0)
+			return rc;
+		levelKeys.push_back(entries[begin].key);
+		levelPids.push_back(firstPid + i);
+	}
+	setRightEdge(levelPids.back(), leafCount > 1, levelKeys.back());
+
+	// build the nonleaf levels bottom-up until a single root remains
+	int height = 1;
+	int fanout = max(2, (int) ((NonLeafNode::MAX_KEY_COUNT + 1) * fillFactor));
+	while (levelPids.size() > 1) {
+		int childCount = levelPids.size();
+		int nodeCount = (childCount + fanout - 1) / fanout;
+		vector<Key>    upperKeys;
+		vector<PageId> upperPids;
+		for (int i = 0; i < nodeCount; i++) {
+			int begin = (int) ((long long) childCount * i / nodeCount);
+			int end = (int) ((long long) childCount * (i + 1) / nodeCount);
+			NonLeafNode node;
+			node.initialize(levelPids[begin]);
+			for (int j = begin + 1; j < end; j++)
+				node.insert(levelKeys[j], levelPids[j]);
+			PageId pid = allocatePages(1);
+			if ((rc = node.write(pid, pf)) < 0)
+				return rc;
+			upperKeys.push_back(levelKeys[begin]);
+			upperPids.push_back(pid);
+		}
+		levelKeys.swap(upperKeys);
+		levelPids.swap(upperPids);
+		height++;
+	}
+
+	// the histogram buckets split the sorted entries into equal parts
+	pthread_mutex_lock(&statsLock);
+	stats.rowCount = n;
+	stats.bucketCount = min(n, (int) IndexStatsT<Key>::MAX_BUCKETS);
+	stats.minKey = entries[0].key;
+	stats.maxKey = entries[n - 1].key;
+	for (int b = 0; b < stats.bucketCount; b++) {
+		int begin = (int) ((long long) n * b / stats.bucketCount);
+		int end = (int) ((long long) n * (b + 1) / stats.bucketCount);
+		stats.bounds[b] = entries[begin].key;
+		stats.counts[b] = end - begin;
+	}
+	pthread_mutex_unlock(&statsLock);
+
+	rootPid = levelPids[0];
+	treeHeight = height;
+	return loadResident();
+}
+
+/*
+ * Create the first node of an empty tree: a single leaf that is the root.
+ */
+template <class Key>
+RC BTreeIndexT<Key>::createRoot(const Key& key, const RecordId& rid)
+{
+	RC rc;
+	LeafNode root;
+	root.insert(key, rid);
+	PageId pid = allocatePages(1);
+	if ((rc = root.write(pid, pf)) < 0)
+		return rc;
+	rootPid = pid;
+	treeHeight = 1;
+	setRightEdge(pid, false, key);
+	return 0;
+}
+
+/*
+ * Find the leaf-node index entry whose key value is larger than or
+ * equal to searchKey, and output the location of the entry in IndexCursor.
+ * IndexCursor is a "pointer" to a B+tree leaf-node entry consisting of
+ * the PageId of the node and the SlotID of the index entry.
+ * Note that, for range queries, we need to scan the B+tree leaf nodes.
+ * For example, if the query is "key > 1000", we should scan the leaf
+ * nodes starting  with the key value 1000. For this reason,
+ * it is better to return the location of the leaf node entry
+ * for a given searchKey, instead of returning the RecordId
+ * associated with the searchKey directly.
+ * Once the location of the index entry is identified and returned
+ * from this function, you should call readForward() to retrieve the
+ * actual (key, rid) pair from the index.
+ * @param key[IN] the key to find.
+ * @param cursor[OUT] the cursor pointing to the first index entry
+ *                    with the key value.
+ * @return error code. 0 if no error.
+ */
+template <class Key>
+RC BTreeIndexT<Key>::locate(const Key& searchKey, IndexCursor& cursor)
+{
+	LeafNode leaf;
+	return locateEntry(searchKey, false, cursor.pid, leaf, cursor.eid);
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::locateEntry(const Key& searchKey, bool backward, PageId& pid, LeafNode& leaf, int& eid)
+{
+	RC rc;
+	PageId at;
+	if ((rc = flushIfPending()) < 0 || (rc = findLeaf(searchKey, !backward, at)) < 0)
+		return rc;
+
+	if (backward) {
+		rc = leaf.read(at, pf);
+		latches.unlock(at);
+		if (rc < 0)
+			return rc;
+
+		// if every key in the leaf is larger than searchKey,
+		// the entry is the last one of the previous leaf.
+		for (;;) {
+			if (leaf.locateBackward(searchKey, eid) == 0) {
+				pid = at;
+				return 0;
+			}
+			if ((rc = readPrevLeaf(at, leaf)) < 0)
+				return rc;
+			if (at == -1)
+				return RC_NO_SUCH_RECORD;
+		}
+	}
+
+	// at now points to the latched leaf. if every key in the leaf is
+	// smaller than searchKey, the entry is the first one of the next leaf.
+	for (;;) {
+		if ((rc = leaf.read(at, pf)) < 0)
+			break;
+		if ((rc = leaf.locate(searchKey, eid)) == 0) {
+			pid = at;
+			break;
+		}
+		PageId nextPid = leaf.getNextNodePtr();
+		if (nextPid == -1) {
+			rc = RC_NO_SUCH_RECORD;
+			break;
+		}
+		latches.lockShared(nextPid);
+		latches.unlock(at);
+		at = nextPid;
+	}
+	latches.unlock(at);
+	return rc;
+}
+
+// orders probe numbers by their keys for lookupBatch()
+template <class Key>
+struct ProbeOrder {
+	const Key* keys;
+	bool operator() (int a, int b) const { return keys[a] < keys[b]; }
+};
+
+// answer the probes keys[order[begin..end)] that are in leaf, which is a
+// leaf or a message buffer. returns the first probe larger than every key
+// in leaf; it and the probes after it are not answered.
+template <class Key, class LeafNode>
+static int probeLeaf(LeafNode& leaf, const Key* keys, const int* order, int begin, int end,
+	RecordId* out, bool* found)
+{
+	for (int i = begin; i < end; i++) {
+		int eid;
+		Key key;
+		RecordId rid;
+		if (leaf.locate(keys[order[i]], eid) < 0)
+			return i;
+		leaf.readEntry(eid, key, rid);
+		if (key == keys[order[i]]) {
+			out[order[i]] = rid;
+			found[order[i]] = true;
+		}
+	}
+	return end;
+}
+
+/*
+ * Look up many keys at once, descending the tree once per shared path.
+ * @param keys[IN] the keys to look up, in any order
+ * @param n[IN] the number of keys
+ * @param out[OUT] out[i] is the RecordId of the first entry with keys[i]
+ * @param found[OUT] found[i] is true if keys[i] is in the index
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC BTreeIndexT<Key>::lookupBatch(const Key* keys, int n, RecordId* out, bool* found)
+{
+	RC rc = 0;
+	PageId pid;
+	int height;
+
+	for (int i = 0; i < n; i++)
+		found[i] = false;
+	if (n <= 0)
+		return 0;
+
+	vector<int> order(n);
+	for (int i = 0; i < n; i++)
+		order[i] = i;
+	ProbeOrder<Key> cmp = { keys };
+	sort(order.begin(), order.end(), cmp);
+
+	// in buffered mode the pending inserts are merged on the way down,
+	// with no message moving meanwhile. a probe found further down
+	// overrides one found above, so that the oldest entry with the key is
+	// returned, as without buffers.
+	if (buffered) {
+		pthread_rwlock_rdlock(&bufferLatch);
+		probeLeaf(rootBuffer, keys, &order[0], 0, n, out, found);
+	}
+	if (latchRoot(pid, height, false) == 0) {
+		rc = lookupBatchHelper(pid, 1, height, keys, &order[0], 0, n, out, found);
+		latches.unlock(pid);
+	}
+	if (buffered)
+		pthread_rwlock_unlock(&bufferLatch);
+	return rc;
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::lookupBatchHelper(PageId pid, int level, int height, const Key* keys,
+	const int* order, int begin, int end, RecordId* out, bool* found)
+{
+	RC rc;
+	if (level < height) {
+		NonLeafNode scratch;
+		NonLeafNode* node;
+		if ((rc = readNonLeaf(pid, level, node, scratch)) < 0)
+			return rc;
+		if (buffered && level > 1 && node->getBufferPtr() != -1) {
+			LeafNode buffer;
+			if ((rc = buffer.read(node->getBufferPtr(), pf)) < 0)
+				return rc;
+			probeLeaf(buffer, keys, order, begin, end, out, found);
+		}
+
+		// the probes are sorted, so the probes that go to the same child
+		// are next to each other. descend once per run of such probes.
+		// this node stays latched until all of its runs are done.
+		vector<PageId> childPids(end - begin);
+		for (int i = begin; i < end; i++)
+			node->locateFirstChildPtr(keys[order[i]], childPids[i - begin]);
+		for (int i = begin; i < end; ) {
+			int j = i + 1;
+			while (j < end && childPids[j - begin] == childPids[i - begin])
+				j++;
+			latches.lockShared(childPids[i - begin]);
+			rc = lookupBatchHelper(childPids[i - begin], level + 1, height, keys, order, i, j, out, found);
+			latches.unlock(childPids[i - begin]);
+			if (rc < 0)
+				return rc;
+			i = j;
+		}
+		return 0;
+	}
+
+	// a leaf: one page read answers every probe that reached it. as in
+	// locate(), the first entry with a probe larger than every key in the
+	// leaf is the first one of the next leaf.
+	LeafNode leaf;
+	if ((rc = leaf.read(pid, pf)) < 0)
+		return rc;
+	int past = probeLeaf(leaf, keys, order, begin, end, out, found);
+	PageId latched = -1;
+	PageId nextPid;
+	while (past < end && (nextPid = leaf.getNextNodePtr()) != -1) {
+		latches.lockShared(nextPid);
+		if (latched != -1)
+			latches.unlock(latched);
+		latched = nextPid;
+		if ((rc = leaf.read(nextPid, pf)) < 0)
+			break;
+		past = probeLeaf(leaf, keys, order, past, end, out, found);
+	}
+	if (latched != -1)
+		latches.unlock(latched);
+	return rc;
+}
+
+/*
+ * Read the (key, rid) pair at the location specified by the index cursor,
+ * and move foward the cursor to the next entry.
+ * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+ * @param key[OUT] the key stored at the index cursor location.
+ * @param rid[OUT] the RecordId stored at the index cursor location.
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC BTreeIndexT<Key>::readForward(IndexCursor& cursor, Key& key, RecordId& rid)
+{
+	RC rc;
+	if (cursor.pid == -1)
+		return RC_END_OF_TREE;
+
+	// a stateless cursor has to bring in the leaf for every entry.
+	// use IndexIterator to walk many entries.
+	LeafNode leafNode;
+	latches.lockShared(cursor.pid);
+	rc = leafNode.read(cursor.pid, pf);
+	latches.unlock(cursor.pid);
+	if (rc < 0 || (rc = leafNode.readEntry(cursor.eid, key, rid)) < 0)
+		return rc;
+	if (cursor.eid == leafNode.getKeyCount()-1) //If eid is the last entry in the node
+	{
+		cursor.pid = leafNode.getNextNodePtr();
+		cursor.eid = 0;
+	}
+	else // If eid is not the last entry in the node.
+		cursor.eid++;
+	return 0;
+}
+
+/*
+ * Find the last leaf-node index entry whose key value is smaller than
+ * or equal to searchKey and output its location in IndexCursor.
+ * @param searchKey[IN] the key to find.
+ * @param cursor[OUT] the cursor pointing to the last index entry
+ *                    with a key value <= searchKey.
+ * @return error code. 0 if no error.
+ */
+template <class Key>
+RC BTreeIndexT<Key>::locateBackward(const Key& searchKey, IndexCursor& cursor)
+{
+	LeafNode leaf;
+	return locateEntry(searchKey, true, cursor.pid, leaf, cursor.eid);
+}
+
+/*
+ * Read the (key, rid) pair at the location specified by the index cursor,
+ * and move the cursor back to the previous entry.
+ * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+ * @param key[OUT] the key stored at the index cursor location.
+ * @param rid[OUT] the RecordId stored at the index cursor location.
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC BTreeIndexT<Key>::readBackward(IndexCursor& cursor, Key& key, RecordId& rid)
+{
+	RC rc;
+	if (cursor.pid == -1)
+		return RC_END_OF_TREE;
+
+	LeafNode leaf;
+	latches.lockShared(cursor.pid);
+	rc = leaf.read(cursor.pid, pf);
+	latches.unlock(cursor.pid);
+	if (rc < 0 || (rc = leaf.readEntry(cursor.eid, key, rid)) < 0)
+		return rc;
+
+	if (cursor.eid > 0) {
+		cursor.eid--;
+		return 0;
+	}
+
+	// eid was the first entry in the node. move to the last entry of the
+	// previous leaf, which is the page the next call returns from anyway.
+	cursor.eid = 0;
+	if ((rc = readPrevLeaf(cursor.pid, leaf)) < 0)
+		return rc;
+	if (cursor.pid != -1)
+		cursor.eid = leaf.getKeyCount() - 1;
+	return 0;
+}
+
+/*
+ * Output the location of the first (smallest) leaf-node index entry.
+ * @param cursor[OUT] the cursor pointing to the first index entry
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC BTreeIndexT<Key>::locateFirst(IndexCursor& cursor)
+{
+	RC rc;
+	PageId pid;
+	if ((rc = flushIfPending()) < 0 || (rc = findEdgeLeaf(false, pid)) < 0)
+		return rc;
+	latches.unlock(pid);
+	cursor.pid = pid;
+	cursor.eid = 0;
+	return 0;
+}
+
+/*
+ * Output the location of the last (largest) leaf-node index entry.
+ * @param cursor[OUT] the cursor pointing to the last index entry
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC BTreeIndexT<Key>::locateLast(IndexCursor& cursor)
+{
+	LeafNode leaf;
+	return locateLastEntry(cursor.pid, leaf, cursor.eid);
+}
+
+template <class Key>
+RC BTreeIndexT<Key>::locateLastEntry(PageId& pid, LeafNode& leaf, int& eid)
+{
+	RC rc;
+	PageId at;
+	if ((rc = flushIfPending()) < 0 || (rc = findEdgeLeaf(true, at)) < 0)
+		return rc;
+
+	rc = leaf.read(at, pf);
+	latches.unlock(at);
+	if (rc < 0)
+		return rc;
+	pid = at;
+	eid = leaf.getKeyCount() - 1;
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                          IndexIterator Implementation                      //
+////////////////////////////////////////////////////////////////////////////////
+
+template <class Key>
+IndexIteratorT<Key>::IndexIteratorT()
+{
+	index = NULL;
+	pid = -1;
+	eid = 0;
+}
+
+/*
+ * Pin the leaf that cursor points to and position the iterator there.
+ * @param index[IN] the index to iterate over
+ * @param cursor[IN] the first entry to return, e.g., from locate()
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC IndexIteratorT<Key>::open(BTreeIndexT<Key>& index, const IndexCursor& cursor)
+{
+	RC rc;
+	this->index = &index;
+	if ((rc = pin(cursor.pid)) < 0)
+		return rc;
+	eid = cursor.eid;
+	return 0;
+}
+
+/*
+ * Position the iterator at the entry locate(searchKey) finds or, with
+ * backward, at the entry locateBackward(searchKey) finds.
+ * @param index[IN] the index to iterate over
+ * @param searchKey[IN] the key to find
+ * @param backward[IN] true to find the last entry <= searchKey
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC IndexIteratorT<Key>::seek(BTreeIndexT<Key>& index, const Key& searchKey, bool backward)
+{
+	this->index = &index;
+	pid = -1;
+	eid = 0;
+	return index.locateEntry(searchKey, backward, pid, leaf, eid);
+}
+
+/*
+ * Position the iterator at the last entry of the index.
+ * @param index[IN] the index to iterate over
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC IndexIteratorT<Key>::seekLast(BTreeIndexT<Key>& index)
+{
+	this->index = &index;
+	pid = -1;
+	eid = 0;
+	return index.locateLastEntry(pid, leaf, eid);
+}
+
+template <class Key>
+RC IndexIteratorT<Key>::pin(PageId pid)
+{
+	RC rc;
+	this->pid = pid;
+	eid = 0;
+	if (pid == -1)
+		return 0;
+	index->latches.lockShared(pid);
+	rc = leaf.read(pid, index->pf);
+	index->latches.unlock(pid);
+	if (rc < 0) {
+		this->pid = -1;
+		return rc;
+	}
+	return 0;
+}
+
+/*
+ * Return the (key, rid) pair at the iterator and move it forward.
+ * @param key[OUT] the key of the entry
+ * @param rid[OUT] the RecordId of the entry
+ * @return error code. 0 if no error. RC_END_OF_TREE past the last entry
+ */
+template <class Key>
+RC IndexIteratorT<Key>::next(Key& key, RecordId& rid)
+{
+	RC rc;
+	// only an exhausted leaf costs a page access
+	while (pid != -1 && eid >= leaf.getKeyCount()) {
+		if ((rc = pin(leaf.getNextNodePtr())) < 0)
+			return rc;
+	}
+	if (pid == -1)
+		return RC_END_OF_TREE;
+
+	leaf.readEntry(eid++, key, rid);
+	return 0;
+}
+
+/*
+ * Return the (key, rid) pair at the iterator and move it backward.
+ * @param key[OUT] the key of the entry
+ * @param rid[OUT] the RecordId of the entry
+ * @return error code. 0 if no error. RC_END_OF_TREE before the first entry
+ */
+template <class Key>
+RC IndexIteratorT<Key>::prev(Key& key, RecordId& rid)
+{
+	RC rc;
+	while (pid != -1 && eid < 0) {
+		if ((rc = index->readPrevLeaf(pid, leaf)) < 0) {
+			pid = -1;
+			return rc;
+		}
+		eid = leaf.getKeyCount() - 1;
+	}
+	if (pid == -1 || eid >= leaf.getKeyCount())
+		return RC_END_OF_TREE;
+
+	leaf.readEntry(eid--, key, rid);
+	return 0;
+}
+
+/*
+ * Return up to n (key, rid) pairs in ascending order.
+ * @param keys[OUT] the keys of the entries
+ * @param rids[OUT] the RecordIds of the entries
+ * @param n[IN] the maximum number of entries to return
+ * @return the number of entries returned (0 at the end of the tree),
+ *         or an error code
+ */
+template <class Key>
+int IndexIteratorT<Key>::nextBatch(Key keys[], RecordId rids[], int n)
+{
+	RC rc;
+	int count = 0;
+	while (count < n) {
+		if (pid == -1)
+			break;
+		if (eid >= leaf.getKeyCount()) {
+			if ((rc = pin(leaf.getNextNodePtr())) < 0)
+				return rc;
+			continue;
+		}
+		// copy out as much of the pinned leaf as fits
+		int end = min(leaf.getKeyCount(), eid + (n - count));
+		for (; eid < end; eid++, count++)
+			leaf.readEntry(eid, keys[count], rids[count]);
+	}
+	return count;
+}
+
+/*
+ * @return the cursor of the entry the iterator is at
+ */
+template <class Key>
+IndexCursor IndexIteratorT<Key>::getCursor() const
+{
+	IndexCursor cursor;
+	cursor.pid = pid;
+	cursor.eid = eid;
+	return cursor;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                          IndexRangeScan Implementation                     //
+////////////////////////////////////////////////////////////////////////////////
+
+template <class Key>
+IndexRangeScanT<Key>::IndexRangeScanT()
+{
+	reverse = false;
+	done = true;
+}
+
+/*
+ * Position the scan at the first entry of range.
+ * @param index[IN] the index to scan
+ * @param range[IN] the key range to return
+ * @param reverse[IN] true to return the entries in descending key order
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC IndexRangeScanT<Key>::open(BTreeIndexT<Key>& index, const KeyRangeT<Key>& range, bool reverse)
+{
+	RC rc;
+	IndexCursor cursor;
+	this->range = range;
+	this->reverse = reverse;
+	done = false;
+
+	// a single descent to the starting end of the range. the iterator
+	// keeps the leaf it was found in, so inserts that run meanwhile cannot
+	// move the entry before the scan reads it.
+	if (!reverse && !range.hasLow) {
+		if ((rc = index.locateFirst(cursor)) == 0)
+			rc = iter.open(index, cursor);
+	} else if (!reverse)
+		rc = iter.seek(index, range.low, false);
+	else if (range.hasHigh)
+		rc = iter.seek(index, range.high, true);
+	else
+		rc = iter.seekLast(index);
+
+	if (rc == RC_NO_SUCH_RECORD) {
+		// nothing in the index is inside the range
+		done = true;
+		return 0;
+	}
+	return rc;
+}
+
+/*
+ * Return the next (key, rid) pair in the range.
+ * @param key[OUT] the key of the entry
+ * @param rid[OUT] the RecordId of the entry
+ * @return error code. 0 if no error. RC_END_OF_TREE past the end of the range
+ */
+template <class Key>
+RC IndexRangeScanT<Key>::next(Key& key, RecordId& rid)
+{
+	RC rc;
+	for (;;) {
+		if (done)
+			return RC_END_OF_TREE;
+
+		rc = reverse ? iter.prev(key, rid) : iter.next(key, rid);
+		if (rc < 0) {
+			done = true;
+			return rc;
+		}
+
+		if (!reverse) {
+			// skip the keys equal to an exclusive starting bound
+			if (range.hasLow && !range.lowInclusive && !(range.low < key))
+				continue;
+			if (range.hasHigh && (range.highInclusive ? range.high < key : !(key < range.high))) {
+				done = true;
+				return RC_END_OF_TREE;
+			}
+		} else {
+			if (range.hasHigh && !range.highInclusive && !(key < range.high))
+				continue;
+			if (range.hasLow && (range.lowInclusive ? key < range.low : !(range.low < key))) {
+				done = true;
+				return RC_END_OF_TREE;
+			}
+		}
+		return 0;
+	}
+}
+
+//
+// explicit instantiations for the supported key types
+//
+template struct IndexStatsT<Int32Key>;
+template struct IndexStatsT<Int64Key>;
+template struct IndexStatsT<StringKey>;
+
+template class BTreeIndexT<Int32Key>;
+template class BTreeIndexT<Int64Key>;
+template class BTreeIndexT<StringKey>;
+
+template class IndexIteratorT<Int32Key>;
+template class IndexIteratorT<Int64Key>;
+template class IndexIteratorT<StringKey>;
+
+template class IndexRangeScanT<Int32Key>;
+template class IndexRangeScanT<Int64Key>;
+template class IndexRangeScanT<StringKey>;
@@ -10,6 +10,9 @@
 #ifndef BTREEINDEX_H
 #define BTREEINDEX_H
 
+#include <map>
+#include <vector>
+#include <pthread.h>
 #include "Bruinbase.h"
 #include "PageFile.h"
 #include "RecordFile.h"
@@ -20,6 +23,8 @@
  * An IndexCursor consists of pid (PageId of the leaf node) and 
  * eid (the location of the index entry inside the node).
  * IndexCursor is used for index lookup and traversal.
+ * A cursor is only a position: an insert by another thread may shift the
+ * entries of its leaf. Scans that run alongside inserts use IndexRangeScan.
  */
 typedef struct {
   // PageId of the index entry
@@ -28,13 +33,124 @@ typedef struct {
   int     eid;  
 } IndexCursor;
 
+template <class Key> class IndexIteratorT;
+template <class Key> struct KeyRangeT;
+
+/**
+ * Statistics on the keys of an index for the query planner: the # entries,
+ * the smallest and largest key and an equi-depth histogram. bulkLoad()
+ * cuts the histogram into buckets of equal counts, and later inserts add
+ * to the count of their bucket. The statistics are kept in page 0 of the
+ * index file.
+ */
+template <class Key>
+struct IndexStatsT {
+  // the # histogram buckets built by bulkLoad()
+  static const int MAX_BUCKETS = 32;
+
+  int rowCount;             // the # entries
+  int bucketCount;          // the # buckets in use. 0 if the index is empty
+  Key minKey;
+  Key maxKey;
+  Key bounds[MAX_BUCKETS];  // bucket i holds the keys >= bounds[i] and < bounds[i+1]
+  int counts[MAX_BUCKETS];  // the # entries in bucket i
+
+  IndexStatsT() : rowCount(0), bucketCount(0) { }
+
+  /**
+   * Estimate the # entries in range. Keys are taken to be spread evenly
+   * inside a bucket.
+   * @param range[IN] the key range
+   * @return the estimated # entries with a key in range
+   */
+  double estimate(const KeyRangeT<Key>& range) const;
+
+  // count one more entry with key
+  void add(const Key& key);
+
+  // the # bytes store() writes
+  static const int STORED_SIZE = 2 * sizeof(int) + (2 + MAX_BUCKETS) * sizeof(Key) + MAX_BUCKETS * sizeof(int);
+  static_assert(3 * sizeof(int) + STORED_SIZE <= PageFile::PAGE_SIZE,
+                "the statistics must fit in page 0 after the tree header");
+
+  // copy the statistics to and from a page buffer
+  void store(char* buffer) const;
+  void load(const char* buffer);
+};
+
+/**
+ * A reader/writer latch for every page of an index file. The latches
+ * are created a chunk at a time on first use and never move, so finding
+ * the latch of a page takes no lock once its chunk exists.
+ */
+class LatchTable {
+ public:
+  LatchTable();
+  ~LatchTable();
+
+  void lockShared(PageId pid);
+  void lockExclusive(PageId pid);
+  void unlock(PageId pid);
+
+ private:
+  LatchTable(const LatchTable&);
+  LatchTable& operator=(const LatchTable&);
+
+  pthread_rwlock_t* latch(PageId pid);
+
+  static const int CHUNK_SHIFT = 10;                // 1024 latches a chunk
+  static const int CHUNK_SIZE = 1 << CHUNK_SHIFT;
+  static const int MAX_CHUNKS = (0x7fffffff >> CHUNK_SHIFT) + 1;
+
+  pthread_rwlock_t** chunks;     // MAX_CHUNKS chunk pointers, NULL if unused
+  int                chunkCount; // (highest chunk in use + 1)
+  pthread_mutex_t    growLock;   // serializes the creation of chunks
+};
+
 /**
  * Implements a B-Tree index for bruinbase.
- * 
+ * The index is templated on the key type; the node layout and fanout
+ * follow from BTLeafNodeT<Key> and BTNonLeafNodeT<Key>.
+ *
+ * Any number of threads may look up and insert into an open index at
+ * the same time. Every page has a reader/writer latch and a thread
+ * descends the tree by latch crabbing: it latches a child before it
+ * releases the parent. An insert first assumes that its leaf has room
+ * and latches only that leaf exclusively; only if the leaf must split
+ * does it descend again with exclusive latches, holding on to the nodes
+ * above the lowest one that cannot split. Leaves are latched left to
+ * right only, so a backward step releases the leaf before it latches
+ * the previous one. open(), close() and setResidentLevels() must not
+ * run concurrently with anything else.
  */
-class BTreeIndex {
+template <class Key>
+class BTreeIndexT {
  public:
-  BTreeIndex();
+  typedef BTLeafNodeT<Key>    LeafNode;
+  typedef BTNonLeafNodeT<Key> NonLeafNode;
+
+  /**
+   * A (key, RecordId) pair as handed to bulkLoad().
+   */
+  struct IndexEntry {
+    Key      key;
+    RecordId rid;
+    bool operator< (const IndexEntry& e) const { return key < e.key; }
+  };
+
+  // the default fraction of each node that bulkLoad() fills
+  static constexpr double DEFAULT_FILL_FACTOR = 0.9;
+
+  // the default # levels from the root that stay resident in memory
+  static const int DEFAULT_RESIDENT_LEVELS = 2;
+
+  // the # keys a nonleaf node holds in buffered mode. a batch that leaves
+  // a buffer is larger the fewer children share the buffer, so buffered
+  // nodes trade fanout for fewer page writes per insert.
+  static const int BUFFERED_FANOUT = 16;
+
+  BTreeIndexT();
+  ~BTreeIndexT();
 
   /**
    * Open the index file in read or write mode.
@@ -57,7 +173,20 @@ class BTreeIndex {
    * @param rid[IN] the RecordId for the record being inserted into the index
    * @return error code. 0 if no error
    */
-  RC insert(int key, const RecordId& rid);
+  RC insert(const Key& key, const RecordId& rid);
+
+  /**
+   * Build the index bottom-up from (key, RecordId) pairs sorted by key.
+   * Leaves are packed left to right up to fillFactor of their capacity,
+   * then each nonleaf level is built over the level below, so every
+   * index page is written exactly once and in sequential page order.
+   * If the index is not empty, the pairs are inserted one by one instead.
+   * @param entries[IN] the pairs to load, sorted by key
+   * @param n[IN] the number of pairs
+   * @param fillFactor[IN] the fraction (0, 1] of each node to fill
+   * @return error code. 0 if no error
+   */
+  RC bulkLoad(const IndexEntry* entries, int n, double fillFactor = DEFAULT_FILL_FACTOR);
 
   /**
    * Find the leaf-node index entry whose key value is larger than or
@@ -79,7 +208,19 @@ class BTreeIndex {
    * with the key value
    * @return error code. 0 if no error.
    */
-  RC locate(int searchKey, IndexCursor& cursor);
+  RC locate(const Key& searchKey, IndexCursor& cursor);
+
+  /**
+   * Look up many keys at once. The probe keys are sorted and the tree is
+   * descended once per shared path, so every node on the paths of the
+   * batch is visited at most once.
+   * @param keys[IN] the keys to look up, in any order
+   * @param n[IN] the number of keys
+   * @param out[OUT] out[i] is the RecordId of the first entry with keys[i]
+   * @param found[OUT] found[i] is true if keys[i] is in the index
+   * @return error code. 0 if no error
+   */
+  RC lookupBatch(const Key* keys, int n, RecordId* out, bool* found);
 
   /**
    * Read the (key, rid) pair at the location specified by the index cursor,
@@ -89,13 +230,265 @@ class BTreeIndex {
    * @param rid[OUT] the RecordId stored at the index cursor location
    * @return error code. 0 if no error
    */
-  RC readForward(IndexCursor& cursor, int& key, RecordId& rid);
+  RC readForward(IndexCursor& cursor, Key& key, RecordId& rid);
+
+  /**
+   * Find the last leaf-node index entry whose key value is smaller than
+   * or equal to searchKey and output its location as "IndexCursor."
+   * This is the starting point of an upper-bounded or descending scan
+   * with readBackward().
+   * @param searchKey[IN] the key to find
+   * @param cursor[OUT] the cursor pointing to the last index entry
+   * with a key value <= searchKey
+   * @return error code. 0 if no error.
+   */
+  RC locateBackward(const Key& searchKey, IndexCursor& cursor);
+
+  /**
+   * Read the (key, rid) pair at the location specified by the index cursor,
+   * and move the cursor back to the previous entry.
+   * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+   * @param key[OUT] the key stored at the index cursor location
+   * @param rid[OUT] the RecordId stored at the index cursor location
+   * @return error code. 0 if no error
+   */
+  RC readBackward(IndexCursor& cursor, Key& key, RecordId& rid);
+
+  /**
+   * Output the location of the first (smallest) leaf-node index entry.
+   * @param cursor[OUT] the cursor pointing to the first index entry
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the index is empty
+   */
+  RC locateFirst(IndexCursor& cursor);
+
+  /**
+   * Output the location of the last (largest) leaf-node index entry.
+   * @param cursor[OUT] the cursor pointing to the last index entry
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the index is empty
+   */
+  RC locateLast(IndexCursor& cursor);
+
+  /**
+   * Output the keys that cut range into about parts sub-ranges of similar
+   * size, for scanning the sub-ranges in parallel: the separator keys of
+   * the root inside range, together with those of the level below it if
+   * the root has too few. The keys are only a hint; a split the tree
+   * makes meanwhile does not make them wrong.
+   * @param range[IN] the range to cut
+   * @param parts[IN] the # sub-ranges wanted
+   * @param keys[OUT] at most parts-1 keys strictly inside range, ascending
+   * @return error code. 0 if no error
+   */
+  RC getSplitKeys(const KeyRangeT<Key>& range, int parts, std::vector<Key>& keys);
+
+  /**
+   * Set how many levels of nonleaf nodes, counted from the root, are
+   * kept resident in memory. A node is loaded the first time a lookup
+   * passes it. Resident nodes are kept up to date on splits, so after
+   * warming up a lookup only reads the pages below them. Call it before
+   * open().
+   * @param levels[IN] the # resident levels. 0 keeps nothing resident
+   */
+  void setResidentLevels(int levels);
+
+  /**
+   * Return the number of (key, RecordId) pairs in the index. The count is
+   * kept in page 0 of the index file, so it costs no page access.
+   * @return the # entries in the index
+   */
+  int getRowCount() const;
+
+  /**
+   * Output the key statistics of the index (see IndexStatsT).
+   * @param stats[OUT] the statistics
+   */
+  void getStats(IndexStatsT<Key>& stats) const;
+
+  /**
+   * Turn the buffered (B-epsilon tree) insert mode on or off. In buffered
+   * mode every nonleaf node carries a buffer of pending inserts. An insert
+   * only lands in the buffer of the root, which is kept in memory, and a
+   * full buffer moves the largest batch of inserts bound for one child a
+   * level down, so a leaf is written once per batch rather than once per
+   * insert. lookupBatch() merges the pending inserts along its paths; a
+   * scan, i.e., locate() and its variants, first pushes every pending
+   * insert down to the leaves and then sees the inserts made before it.
+   * Nonleaf nodes split at BUFFERED_FANOUT keys in buffered mode.
+   * The mode is stored in the index file, and close() leaves every buffer
+   * empty. Inserts are serialized in buffered mode. Call it on an open
+   * index that no other thread is using.
+   * @param on[IN] true for buffered mode
+   * @return error code. 0 if no error
+   */
+  RC setBuffered(bool on);
+
+  /**
+   * Push every pending insert of a buffered index down to the leaves.
+   * @return error code. 0 if no error
+   */
+  RC flushBuffers();
   
  private:
+  friend class IndexIteratorT<Key>;
+
   PageFile pf;         /// the PageFile used to store the actual b+tree in disk
 
-  int insertionHelper(const int key, const RecordId &rid, int n, PageId pid, PageId &siblingPid);
-  RC createRoot(const int key, const RecordId &rid);
+  // the # keys a nonleaf node holds before it splits
+  int nonLeafCapacity() const { return buffered ? BUFFERED_FANOUT : NonLeafNode::MAX_KEY_COUNT; }
+
+  // insert (key, rid) down to its leaf, or into the root's buffer
+  RC insertUnbuffered(const Key& key, const RecordId& rid);
+  RC insertBuffered(const Key& key, const RecordId& rid);
+
+  /**
+   * Move the largest batch of messages in the buffer of the nonleaf node
+   * at pid (level) that goes to one child down to that child: into its
+   * buffer or, for a leaf, into the leaf. If the child's buffer has no
+   * room, flush the child instead. Either way the tree may be restructured
+   * by the time it returns.
+   */
+  RC flushStep(PageId pid, int level);
+
+  // flush every buffer in the subtree at pid. moved is set if anything moved
+  RC drainSubtree(PageId pid, int level, int height, bool& moved);
+
+  // insert buffer[begin..end) into the leaf at pid and below its parent
+  RC applyToLeaf(PageId pid, LeafNode& buffer, int begin, int end);
+
+  // read the node at pid (level) and its message buffer (empty if none)
+  RC readBuffer(PageId pid, int level, NonLeafNode& node, LeafNode& buffer);
+
+  // write buffer back as the message buffer of node at pid
+  RC writeBuffer(PageId pid, NonLeafNode& node, LeafNode& buffer);
+
+  // flush the buffers before a scan if any message is pending
+  RC flushIfPending();
+
+  /**
+   * Split the message buffer of node at pid as node is split with sibling
+   * at midKey: the messages >= midKey go to a new buffer of sibling. The
+   * buffer of the root is moved from memory to a page, since the root
+   * is about to get a new parent.
+   */
+  RC splitBuffer(PageId pid, NonLeafNode& node, NonLeafNode& sibling, const Key& midKey);
+
+  /**
+   * Insert (key, rid) into its leaf if the leaf has room, holding an
+   * exclusive latch on the leaf only.
+   * @return RC_NODE_FULL if the leaf must split or the tree is empty
+   */
+  RC insertIntoLeaf(const Key& key, const RecordId& rid);
+
+  /**
+   * Insert (key, rid) with exclusive latches on the part of the path
+   * that the split can reach, growing the tree if the root splits.
+   */
+  RC insertWithSplit(const Key& key, const RecordId& rid);
+
+  /**
+   * Insert (key, rid) into leaf, the latched leaf at pid, and write it.
+   * If the leaf splits, the new sibling is returned in
+   * (siblingKey, siblingPid); otherwise siblingPid is set to -1.
+   * With append, the leaf keeps all of its entries on a split.
+   */
+  RC insertLeaf(PageId pid, LeafNode& leaf, const Key& key, const RecordId& rid,
+                bool append, Key& siblingKey, PageId& siblingPid);
+
+  // remember pid as the rightmost leaf, which holds the keys >= low
+  void setRightEdge(PageId pid, bool hasLow, const Key& low);
+
+  RC createRoot(const Key& key, const RecordId& rid);
+
+  // build the nonempty tree bottom-up for bulkLoad()
+  RC buildBottomUp(const IndexEntry* entries, int n, double fillFactor);
+
+  // reserve count consecutive new pages and return the first one
+  PageId allocatePages(int count);
+
+  /**
+   * Return the nonleaf node at pid, which is at the given level (the root
+   * is level 1). A resident node is returned in place; otherwise the page
+   * is read into scratch and node points to scratch. The caller must hold
+   * the latch of pid for as long as it uses node.
+   */
+  RC readNonLeaf(PageId pid, int level, NonLeafNode*& node, NonLeafNode& scratch);
+
+  /**
+   * Write the nonleaf node at pid to disk and refresh its resident copy.
+   * The caller must hold the exclusive latch of pid.
+   */
+  RC writeNonLeaf(PageId pid, int level, NonLeafNode& node);
+
+  // (re)load the resident levels, starting from the root
+  RC loadResident();
+
+  /**
+   * Latch the root and output its PageId and the tree height. The root is
+   * latched exclusively if it is a leaf and exclusiveLeaf is set, and
+   * shared otherwise. Nothing is latched if the tree is empty.
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the tree is empty
+   */
+  RC latchRoot(PageId& pid, int& height, bool exclusiveLeaf);
+
+  // find the leaf whose key range covers searchKey. with first, it is
+  // the leftmost such leaf, which holds the first entry >= searchKey if
+  // any, and otherwise the rightmost one, which holds the last entry
+  // <= searchKey. the leaf is returned latched shared and the caller
+  // must unlatch it.
+  RC findLeaf(const Key& searchKey, bool first, PageId& pid);
+
+  // find the leftmost or rightmost leaf, returned latched shared
+  RC findEdgeLeaf(bool rightmost, PageId& pid);
+
+  /**
+   * Find the entry locate() finds or, with backward, the one
+   * locateBackward() finds. leaf is the copy of its leaf read under the
+   * leaf's latch, so eid points into leaf whatever inserts run meanwhile.
+   */
+  RC locateEntry(const Key& searchKey, bool backward, PageId& pid, LeafNode& leaf, int& eid);
+
+  // the same for the last entry of the index
+  RC locateLastEntry(PageId& pid, LeafNode& leaf, int& eid);
+
+  /**
+   * Replace leaf, a copy of the leaf at pid, with the leaf before it and
+   * set pid to its PageId, or to -1 if pid is the first leaf.
+   */
+  RC readPrevLeaf(PageId& pid, LeafNode& leaf);
+
+  // look up the probes keys[order[begin..end)] in the subtree at pid,
+  // which the caller has latched shared
+  RC lookupBatchHelper(PageId pid, int level, int height, const Key* keys, const int* order,
+                       int begin, int end, RecordId* out, bool* found);
+
+  /// the resident nonleaf nodes by PageId. once a node is resident it
+  /// stays resident until close() and is kept current on every write.
+  std::map<PageId, NonLeafNode> resident;
+  int residentLevels;  /// # levels from the root kept in resident
+
+  LatchTable       latches;       /// the page latches
+  pthread_rwlock_t rootLatch;     /// guards rootPid and treeHeight
+  pthread_rwlock_t residentLatch; /// guards the map structure of resident
+  pthread_mutex_t  allocLock;     /// guards nextPid
+  PageId           nextPid;       /// the first page not allocated yet
+
+  /// the rightmost leaf, so that ascending inserts skip the descent.
+  /// edgePid is -1 until it is known, e.g., after the leaf first splits.
+  pthread_mutex_t  edgeLock;      /// guards the three below
+  PageId           edgePid;
+  bool             edgeHasLow;    /// false: every key goes to edgePid
+  Key              edgeLow;       /// the smallest key that goes to edgePid
+
+  /// the buffered mode (see setBuffered())
+  bool             buffered;
+  LeafNode         rootBuffer;    /// the root's messages, kept in memory
+  int              pendingCount;  /// # messages in all buffers
+  pthread_rwlock_t bufferLatch;   /// held exclusively while messages move
+
+  IndexStatsT<Key>        stats;     /// the key statistics
+  mutable pthread_mutex_t statsLock; /// guards stats
+  bool     readOnly;   /// true: opened in 'r' mode. close() writes nothing
+
   PageId   rootPid;    /// the PageId of the root node
   int      treeHeight; /// the height of the tree
   /// Note that the content of the above two variables will be gone when
@@ -104,4 +497,137 @@ class BTreeIndex {
   /// is opened again later.
 };
 
+/**
+ * A stateful cursor over the leaf entries of a BTreeIndexT. The current
+ * leaf stays pinned in the iterator, so moving within a leaf costs no
+ * page access at all and the scan reads each leaf page once.
+ */
+template <class Key>
+class IndexIteratorT {
+ public:
+  IndexIteratorT();
+
+  /**
+   * Pin the leaf that cursor points to and position the iterator there.
+   * @param index[IN] the index to iterate over
+   * @param cursor[IN] the first entry to return, e.g., from locate()
+   * @return error code. 0 if no error
+   */
+  RC open(BTreeIndexT<Key>& index, const IndexCursor& cursor);
+
+  /**
+   * Position the iterator at the entry locate(searchKey) finds or, with
+   * backward, at the one locateBackward(searchKey) finds. The leaf is
+   * pinned as the search found it, so unlike open() on a cursor from
+   * locate(), inserts by other threads cannot move the entry in between.
+   * @param index[IN] the index to iterate over
+   * @param searchKey[IN] the key to find
+   * @param backward[IN] true to find the last entry <= searchKey
+   * @return error code. 0 if no error
+   */
+  RC seek(BTreeIndexT<Key>& index, const Key& searchKey, bool backward);
+
+  /**
+   * Position the iterator at the last entry of the index.
+   * @param index[IN] the index to iterate over
+   * @return error code. 0 if no error
+   */
+  RC seekLast(BTreeIndexT<Key>& index);
+
+  /**
+   * Return the (key, rid) pair at the iterator and move it forward.
+   * @param key[OUT] the key of the entry
+   * @param rid[OUT] the RecordId of the entry
+   * @return error code. 0 if no error. RC_END_OF_TREE past the last entry
+   */
+  RC next(Key& key, RecordId& rid);
+
+  /**
+   * Return the (key, rid) pair at the iterator and move it backward.
+   * @param key[OUT] the key of the entry
+   * @param rid[OUT] the RecordId of the entry
+   * @return error code. 0 if no error. RC_END_OF_TREE before the first entry
+   */
+  RC prev(Key& key, RecordId& rid);
+
+  /**
+   * Return up to n (key, rid) pairs in ascending order, crossing leaves as
+   * needed.
+   * @param keys[OUT] the keys of the entries
+   * @param rids[OUT] the RecordIds of the entries
+   * @param n[IN] the maximum number of entries to return
+   * @return the number of entries returned (0 at the end of the tree),
+   *         or an error code
+   */
+  int nextBatch(Key keys[], RecordId rids[], int n);
+
+  /**
+   * @return the cursor of the entry the iterator is at
+   */
+  IndexCursor getCursor() const;
+
+ private:
+  // pin the leaf at pid. pid -1 marks the end of the leaf chain.
+  RC pin(PageId pid);
+
+  BTreeIndexT<Key>*                  index;
+  typename BTreeIndexT<Key>::LeafNode leaf;  // the pinned leaf
+  PageId                             pid;   // the pinned leaf's PageId
+  int                                eid;   // the current entry in leaf
+};
+
+/**
+ * A range of keys to scan with IndexRangeScanT. Either end may be open,
+ * and each bound may be inclusive or exclusive.
+ */
+template <class Key>
+struct KeyRangeT {
+  bool hasLow;        // false: no lower bound
+  bool lowInclusive;  // true: key >= low, false: key > low
+  Key  low;
+  bool hasHigh;       // false: no upper bound
+  bool highInclusive; // true: key <= high, false: key < high
+  Key  high;
+};
+
+/**
+ * Index range-scan operator. It locates one end of the range once and
+ * then walks the leaf chain until the other end, in ascending order or,
+ * with reverse, in descending order.
+ */
+template <class Key>
+class IndexRangeScanT {
+ public:
+  IndexRangeScanT();
+
+  /**
+   * Position the scan at the first entry of range.
+   * @param index[IN] the index to scan
+   * @param range[IN] the key range to return
+   * @param reverse[IN] true to return the entries in descending key order
+   * @return error code. 0 if no error
+   */
+  RC open(BTreeIndexT<Key>& index, const KeyRangeT<Key>& range, bool reverse);
+
+  /**
+   * Return the next (key, rid) pair in the range.
+   * @param key[OUT] the key of the entry
+   * @param rid[OUT] the RecordId of the entry
+   * @return error code. 0 if no error. RC_END_OF_TREE past the end of the range
+   */
+  RC next(Key& key, RecordId& rid);
+
+ private:
+  KeyRangeT<Key>      range;
+  bool                reverse;
+  IndexIteratorT<Key> iter;
+  bool                done;
+};
+
+typedef BTreeIndexT<Int32Key>     BTreeIndex;
+typedef IndexStatsT<Int32Key>     IndexStats;
+typedef KeyRangeT<Int32Key>       KeyRange;
+typedef IndexIteratorT<Int32Key>  IndexIterator;
+typedef IndexRangeScanT<Int32Key> IndexRangeScan;
+
 #endif /* BTREEINDEX_H */
@@ -1,112 +1,116 @@
+#include <algorithm>
 #include "BTreeNode.h"
 
 using namespace std;
 
-
-
-
-
 ////////////////////////////////////////////////////////////////////////////////
-//                            BTLeafNode Implementation                       //
+//                            BTreeNode Implementation                        //
 ////////////////////////////////////////////////////////////////////////////////
 
 /*
- * LeafNode Buffer
- * Equivalent to int buffer[256];
- _____________________________________________________________________________________
- |  0   |  1   |   2  |   3  |   4  |   5  |   6  | ...  | 252  | 253  | 254  |  255 |
- | KC   | key  | pid  |  sid | key  |  pid | sid  | ...  | sid  |empty |empty | ptr -+---->
- |______|______|______|______|______|______|______|______|______|______|______|______|
+ * Node Buffer
+ * For int keys a leaf entry is (key, pid, sid) and a nonleaf entry is
+ * (key, pid), which gives 84 and 126 entries per 1KB page respectively.
+ _____________________________________________________________________________
+ |  KC  | link | prev | key0 | val0 | key1 | val1 | ...  | keyN | valN |unused|
+ |______|______|______|______|______|______|______|______|______|______|______|
 
 */
 
-
-BTLeafNode::BTLeafNode()
+template <class Key, class Value, int PageSize>
+BTreeNode<Key, Value, PageSize>::BTreeNode()
 {
-    int *intBufferPtr = (int *)buffer;
-    intBufferPtr[0] = 0;
-    intBufferPtr[255] = -1;
+  header()->keyCount = 0;
+  header()->link = -1;
+  header()->prev = -1;
 }
+
 /*
  * Read the content of the node from the page pid in the PageFile pf.
  * @param pid[IN] the PageId to read
  * @param pf[IN] PageFile to read from
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::read(PageId pid, const PageFile& pf)
+template <class Key, class Value, int PageSize>
+RC BTreeNode<Key, Value, PageSize>::read(PageId pid, const PageFile& pf)
 {
-  RC  rc;
-  if ((rc = pf.read(pid, buffer)) < 0) {
-    return rc;
-  }
-
-  return 0; }
-
-  /*
-   * Write the content of the node to the page pid in the PageFile pf.
-   * @param pid[IN] the PageId to write to
-   * @param pf[IN] PageFile to write to
-   * @return 0 if successful. Return an error code if there is an error.
-   */
-RC BTLeafNode::write(PageId pid, PageFile& pf)
-{ 
-  RC rc;
-  if ((rc = pf.write(pid, buffer)) < 0)
-    return rc;
-
-  return 0; 
+  return pf.read(pid, buffer);
 }
 
 /*
- * Return the number of keys stored in the node.
- * @return the number of keys in the node
+ * Write the content of the node to the page pid in the PageFile pf.
+ * @param pid[IN] the PageId to write to
+ * @param pf[IN] PageFile to write to
+ * @return 0 if successful. Return an error code if there is an error.
  */
-int BTLeafNode::getKeyCount()
+template <class Key, class Value, int PageSize>
+RC BTreeNode<Key, Value, PageSize>::write(PageId pid, PageFile& pf)
+{
+  return pf.write(pid, buffer);
+}
+
+template <class Key, class Value, int PageSize>
+int BTreeNode<Key, Value, PageSize>::lowerBound(const Key& searchKey) const
+{
+  const Entry* e = entries();
+  int lo = 0, hi = getKeyCount();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (e[mid].key < searchKey) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+template <class Key, class Value, int PageSize>
+int BTreeNode<Key, Value, PageSize>::upperBound(const Key& searchKey) const
 {
-  int *intBufferPtr = (int*) buffer;
+  const Entry* e = entries();
+  int lo = 0, hi = getKeyCount();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (searchKey < e[mid].key) hi = mid;
+    else lo = mid + 1;
+  }
+  return lo;
+}
 
-  return intBufferPtr[0]; 
+template <class Key, class Value, int PageSize>
+RC BTreeNode<Key, Value, PageSize>::insertAt(int pos, const Key& key, const Value& value)
+{
+  int keyCount = getKeyCount();
+  if (keyCount >= MAX_KEY_COUNT) return RC_NODE_FULL;
+  if (pos < 0 || pos > keyCount) return RC_INVALID_CURSOR;
+
+  Entry* e = entries();
+  memmove(e + pos + 1, e + pos, (keyCount - pos) * sizeof(Entry));
+  e[pos].key = key;
+  e[pos].value = value;
+  header()->keyCount++;
+  return 0;
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+//                            BTLeafNode Implementation                       //
+////////////////////////////////////////////////////////////////////////////////
+
+template <class Key, int PageSize>
+BTLeafNodeT<Key, PageSize>::BTLeafNodeT()
+{
+}
+
 /*
  * Insert a (key, rid) pair to the node.
  * @param key[IN] the key to insert
  * @param rid[IN] the RecordId to insert
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTLeafNode::insert(int key, const RecordId& rid)
+template <class Key, int PageSize>
+RC BTLeafNodeT<Key, PageSize>::insert(const Key& key, const RecordId& rid)
 {
-
-  RC rc;
-  if(checkFull())
-    return RC_NODE_FULL;
-  // Set eid to last buffer
-  int eidCandidate = getKeyCount();
-  int *intBufferPtr2 = (int*) buffer;
-  for (int i = 0; i < getKeyCount(); i++) {
-    int readKey;
-    RecordId readRid;
-    // Read entry i
-    if(rc = readEntry(i, readKey, readRid) < 0)
-      return rc;
-    // If read entry key is greater than the i's key, new entry needs to put before i entry.
-    if(readKey >= key) {
-      eidCandidate = i;
-      break;
-    }
-  }
-  
-  // If new key is the biggest, put at the end.
-  // If not shift all the entires by one and put it in the eidCandidate
-  if(eidCandidate != getKeyCount())
-    shift(eidCandidate);
-  if(rc = insertToBuffer(key, rid, eidCandidate) < 0)
-    return rc;
-
-  // Update key count
-  incKeyCout(true);
-  return 0; 
+  // equal keys keep their insertion order
+  return this->insertAt(this->upperBound(key), key, rid);
 }
 
 /*
@@ -117,67 +121,80 @@ RC BTLeafNode::insert(int key, const RecordId& rid)
  * @param rid[IN] the RecordId to insert.
  * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
  * @param siblingKey[OUT] the first key in the sibling node after split.
+ * @param numStay[IN] the # entries this node keeps, or -1 for half of them
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::insertAndSplit(int key, const RecordId& rid, 
-    BTLeafNode& sibling, int& siblingKey)
+template <class Key, int PageSize>
+RC BTLeafNodeT<Key, PageSize>::insertAndSplit(const Key& key, const RecordId& rid,
+    BTLeafNodeT& sibling, Key& siblingKey, int numStay)
 {
-  RC rc;
-  int numMove = getKeyCount()/2;
-  int numStay = getKeyCount() - numMove;
+  typedef typename BTreeNode<Key, RecordId, PageSize>::Entry Entry;
+
+  if (sibling.getKeyCount() != 0) return RC_INVALID_CURSOR;
+
+  // merge the new entry into a temporary copy of all entries
+  int keyCount = this->getKeyCount();
+  int pos = this->upperBound(key);
+  Entry all[BTreeNode<Key, RecordId, PageSize>::MAX_KEY_COUNT + 1];
+  Entry* e = this->entries();
+  memcpy(all, e, pos * sizeof(Entry));
+  all[pos].key = key;
+  all[pos].value = rid;
+  memcpy(all + pos + 1, e + pos, (keyCount - pos) * sizeof(Entry));
+
+  // by default the left node keeps the larger half. either node keeps
+  // at least one entry.
+  int total = keyCount + 1;
+  if (numStay < 0)
+    numStay = (total + 1) / 2;
+  numStay = std::max(1, std::min(numStay, total - 1));
+  memcpy(e, all, numStay * sizeof(Entry));
+  this->header()->keyCount = numStay;
+  memcpy(sibling.entries(), all + numStay, (total - numStay) * sizeof(Entry));
+  sibling.header()->keyCount = total - numStay;
+
+  sibling.setNextNodePtr(getNextNodePtr());
+  siblingKey = all[numStay].key;
+  return 0;
+}
 
-  if (rc = insert(key, rid) <0)
-    return rc;
+/*
+ * Find the entry whose key value is larger than or equal to searchKey
+ * and output the eid (entry number) whose key value >= searchKey.
+ * Remeber that all keys inside a B+tree node should be kept sorted.
+ * @param searchKey[IN] the key to search for
+ * @param eid[OUT] the entry number that contains a key larger than or equalty to searchKey
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+template <class Key, int PageSize>
+RC BTLeafNodeT<Key, PageSize>::locate(const Key& searchKey, int& eid)
+{
+  if (this->getKeyCount() <= 0) return RC_INVALID_CURSOR;
 
-  int keyCount = getKeyCount();
-  for (int i = keyCount-1; i >= numStay; i--)
-  {
-    int readKey;
-    RecordId readRid;
-    if(rc = readEntry(i, readKey, readRid) < 0)
-      return rc;
-    if (rc = sibling.insert(readKey, readRid) < 0)
-      return rc;
-    if (rc = deleteFromBuffer(i) < 0)
-      return rc;
-    incKeyCout(false);
-  }
+  int i = this->lowerBound(searchKey);
+  if (i >= this->getKeyCount()) return RC_NO_SUCH_RECORD;
 
-  RecordId readRid;
-  if (rc = sibling.readEntry(0, siblingKey, readRid) < 0)
-    return rc;
-  return 0; 
+  eid = i;
+  return 0;
 }
 
-  /*
-   * Find the entry whose key value is larger than or equal to searchKey
-   * and output the eid (entry number) whose key value >= searchKey.
-   * Remeber that all keys inside a B+tree node should be kept sorted.
-   * @param searchKey[IN] the key to search for
-   * @param eid[OUT] the entry number that contains a key larger than or equalty to searchKey
-   * @return 0 if successful. Return an error code if there is an error.
-   */
-RC BTLeafNode::locate(int searchKey, int& eid)
-{ 
-  RC rc; 
-  // If there is no entry or if eid is not valid, or if eid is larger than key count
-  // Return error
-  if (getKeyCount() <=0)
-    return RC_INVALID_CURSOR;
-
-  // Loop through entries and search for the key that are greater or equal to searchKey
-  // Entries are sorted so we can avoid leftovers if we found the key
-  for(int i = 0; i < getKeyCount(); i++){
-    int keyEntry;
-    RecordId ridEntry;
-    if (rc = readEntry(i, keyEntry, ridEntry) <0)
-      return rc;
-    if(keyEntry >= searchKey) {
-      eid = i;
-      return 0;
-    }
-  }
-  return RC_NO_SUCH_RECORD;
+/*
+ * Find the last entry whose key value is smaller than or equal to
+ * searchKey and output its eid (entry number).
+ * @param searchKey[IN] the key to search for
+ * @param eid[OUT] the entry number that contains a key smaller than or equal to searchKey
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+template <class Key, int PageSize>
+RC BTLeafNodeT<Key, PageSize>::locateBackward(const Key& searchKey, int& eid)
+{
+  if (this->getKeyCount() <= 0) return RC_INVALID_CURSOR;
+
+  int i = this->upperBound(searchKey) - 1;
+  if (i < 0) return RC_NO_SUCH_RECORD;
+
+  eid = i;
+  return 0;
 }
 
 /*
@@ -187,199 +204,89 @@ RC BTLeafNode::locate(int searchKey, int& eid)
  * @param rid[OUT] the RecordId from the entry
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
-{ 
-  // If there is no entry or if eid is not valid, or if eid is larger than key count
-  // Return error
-  if(getKeyCount() <= 0 || eid < 0 || eid >= getKeyCount())
-    return RC_INVALID_CURSOR;
-
-  // Convert buffer pointer from char to int
-  int *intBufferPtr = (int *) buffer;
-
-  // Read from the buffer
-  int index = eid * 3 + 1;
-  key = *(intBufferPtr + index);
-  rid.pid = *(intBufferPtr + index + 1);
-  rid.sid = *(intBufferPtr + index + 2);
-
-  return 0; 
-}
-
-/*
- * Return the pid of the next slibling node.
- * @return the PageId of the next sibling node 
- */
-PageId BTLeafNode::getNextNodePtr()
-{ 
-  int *intBufferPtr = (int *)buffer;
+template <class Key, int PageSize>
+RC BTLeafNodeT<Key, PageSize>::readEntry(int eid, Key& key, RecordId& rid)
+{
+  if (eid < 0 || eid >= this->getKeyCount()) return RC_INVALID_CURSOR;
 
-  // Return the last element from the buffer which is PageId of the next sibling node
-  return (*(intBufferPtr + 255));
+  key = this->entries()[eid].key;
+  rid = this->entries()[eid].value;
+  return 0;
 }
 
 /*
- * Set the pid of the next slibling node.
- * @param pid[IN] the PageId of the next sibling node 
+ * Remove the entries from begin up to (but not including) end.
+ * @param begin[IN] the first entry number to remove
+ * @param end[IN] the entry number after the last one to remove
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::setNextNodePtr(PageId pid)
-{ 
-  int *intBufferPtr = (int *)buffer;
-  // Set last element of the buffer to the PageId of next sibling node
-  *(intBufferPtr + 255) = pid;
-  return 0; 
-}
-
-
+template <class Key, int PageSize>
+RC BTLeafNodeT<Key, PageSize>::erase(int begin, int end)
+{
+  typedef typename BTreeNode<Key, RecordId, PageSize>::Entry Entry;
 
-////////////////////////////////////////////////////////////////////////////////
-//                            BTLeafNode Helper Functions                     //
-////////////////////////////////////////////////////////////////////////////////
+  int keyCount = this->getKeyCount();
+  if (begin < 0 || begin > end || end > keyCount) return RC_INVALID_CURSOR;
 
-//Convert integer to dynamic array of characters. 
-//Return 0 if success -1 otherwise
-RC BTLeafNode::insertToBuffer(const int key, const RecordId rid, const int eid)
-{
-  if(eid < 0)
-    return RC_INVALID_CURSOR;
-  if(checkFull())
-    return RC_NODE_FULL;
-  int* intBufferPtr = (int*) buffer;
-  int index = eid*3+1;
-  *(intBufferPtr + index) = key;
-  *(intBufferPtr + index + 1) = rid.pid;
-  *(intBufferPtr + index + 2) = rid.sid;
+  Entry* e = this->entries();
+  memmove(e + begin, e + end, (keyCount - end) * sizeof(Entry));
+  this->header()->keyCount = keyCount - (end - begin);
   return 0;
 }
-bool BTLeafNode::checkFull()
-{
-  //Max key count, excluding last entry of the leaf node (page id)
-  if(getKeyCount() >= g_maxKeyCount)
-    return true;
-  return false;
 
-}
-//Shifts all the elements from eid by one entry
-RC BTLeafNode::shift(const int eid)
+/*
+ * Return the pid of the next slibling node.
+ * @return the PageId of the next sibling node
+ */
+template <class Key, int PageSize>
+PageId BTLeafNodeT<Key, PageSize>::getNextNodePtr()
 {
-  if(eid < 0)
-    return RC_INVALID_CURSOR;
-  RC rc;
-  int * intBufferPtr = (int *)buffer;
-  for(int i = getKeyCount()-1; i >= eid; i--) 
-  {
-    int readKey;
-    RecordId readRid;
-    // Read entry for eid = i
-    if(rc = readEntry(i, readKey, readRid) < 0)
-      return rc;
-    // Insert to buffer for eid = i+1
-    if(rc = insertToBuffer(readKey, readRid, i+1) < 0)
-      return rc;
-  }
-  return 0;
-
+  return this->header()->link;
 }
 
-RC BTLeafNode::deleteFromBuffer(const int eid)
+/*
+ * Set the pid of the next slibling node.
+ * @param pid[IN] the PageId of the next sibling node
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+template <class Key, int PageSize>
+RC BTLeafNodeT<Key, PageSize>::setNextNodePtr(PageId pid)
 {
-  RC rc;
-  if(eid >= getKeyCount())
-    return RC_NO_SUCH_RECORD;
-
-  int* intBufferPtr = (int*) buffer;
-  int index = eid*3+1;
-  *(intBufferPtr + index) = -1;
-  *(intBufferPtr + index + 1) = -1;
-  *(intBufferPtr + index + 2) = -1;
+  this->header()->link = pid;
   return 0;
-
 }
 
-void BTLeafNode::incKeyCout(bool increment)
-{
-
-  int *intBufferPtr = (int*) buffer;
-  if(increment) {
-    
-    intBufferPtr[0]++;
-    // fprintf(stderr, "Inside incKeyCount, intBufferPtr:%d\n", intBufferPtr[0]);
-    // fprintf(stderr, "Inside incKeyCount, intBufferPtr1:%d\n", intBufferPtr[1]);
-    // fprintf(stderr, "Inside incKeyCount, intBufferPtr4:%d\n", intBufferPtr[4]);
-    // fprintf(stderr, "Inside incKeyCount, intBufferPtr7:%d\n", intBufferPtr[7]);
-    // fprintf(stderr, "Inside incKeyCount, intBufferPtr10:%d\n", intBufferPtr[10]);
-    // fprintf(stderr, "Inside incKeyCount, intBufferPtr13:%d\n", intBufferPtr[13]);
-    // fprintf(stderr, "Inside incKeyCount, intBufferPtr16:%d\n", intBufferPtr[16]);
-    // fprintf(stderr, "Inside incKeyCount, intBufferPtr19:%d\n", intBufferPtr[19]);
-    // fprintf(stderr, "Inside incKeyCount, intBufferPtr22:%d\n", intBufferPtr[22]);
-    // fprintf(stderr, "Inside incKeyCount, intBufferPtr25:%d\n", intBufferPtr[25]);
-    // fprintf(stderr, "Inside incKeyCount, intBufferPtr28:%d\n", intBufferPtr[28]);
-
-  }
-  else
-    intBufferPtr[0]--;
-}
-
-
-////////////////////////////////////////////////////////////////////////////////
-//                            BTNonLeafNode Implementation                    //
-////////////////////////////////////////////////////////////////////////////////
-
-/*
- * LeafNode Buffer
- * Equivalent to int buffer[256];
-
-  256-1 = 255;
-  255/2 + 1
- _____________________________________________________________________________________
- |  0   |  1   |   2  |   3  |   4  |   5  |   6  | ...  | 252  | 253  | 254  |  255 |
- | KC   | pid  | key  |  pid | key  |  pid | key  | ...  | key  | pid  | key  | pid -+---->
- |______|______|______|______|______|______|______|______|______|______|______|______|
-
-*/
-
 /*
- * Read the content of the node from the page pid in the PageFile pf.
- * @param pid[IN] the PageId to read
- * @param pf[IN] PageFile to read from
- * @return 0 if successful. Return an error code if there is an error.
+ * Return the pid of the previous slibling node.
+ * @return the PageId of the previous sibling node
  */
-RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
-{ 
-  RC rc;
-  if ((rc = pf.read(pid, buffer)) < 0)
-    return rc;
-  else
-    return 0;
+template <class Key, int PageSize>
+PageId BTLeafNodeT<Key, PageSize>::getPrevNodePtr()
+{
+  return this->header()->prev;
 }
 
 /*
- * Write the content of the node to the page pid in the PageFile pf.
- * @param pid[IN] the PageId to write to
- * @param pf[IN] PageFile to write to
+ * Set the pid of the previous slibling node.
+ * @param pid[IN] the PageId of the previous sibling node
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::write(PageId pid, PageFile& pf)
-{ 
-  RC rc;
-  if ((rc = pf.write(pid, buffer)) < 0)
-    return rc;
-  else
-    return 0; 
+template <class Key, int PageSize>
+RC BTLeafNodeT<Key, PageSize>::setPrevNodePtr(PageId pid)
+{
+  this->header()->prev = pid;
+  return 0;
 }
 
-/*
- * Return the number of keys stored in the node.
- * @return the number of keys in the node
- */
-int BTNonLeafNode::getKeyCount()
-{ 
-  int *intBufferPtr = (int*) buffer;
 
-  return intBufferPtr[0]; 
-}
+////////////////////////////////////////////////////////////////////////////////
+//                            BTNonLeafNode Implementation                    //
+////////////////////////////////////////////////////////////////////////////////
 
+template <class Key, int PageSize>
+BTNonLeafNodeT<Key, PageSize>::BTNonLeafNodeT()
+{
+}
 
 /*
  * Insert a (key, pid) pair to the node.
@@ -387,32 +294,10 @@ int BTNonLeafNode::getKeyCount()
  * @param pid[IN] the PageId to insert
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTNonLeafNode::insert(int key, PageId pid)
+template <class Key, int PageSize>
+RC BTNonLeafNodeT<Key, PageSize>::insert(const Key& key, PageId pid)
 {
-  RC rc;
-  if(checkFull())
-    return RC_NODE_FULL;
-
-  //Convert buffer pointer from char to int
-  int *bufferPtr = (int *) buffer;
-
-  //loop until end of last pid?
-  int i = 0;
-  for(; i < getKeyCount(); ++i){
-    if (*((bufferPtr+2) + 2*i) > key)
-    { 
-      // key is not at the end
-      shift(i);
-      break;
-
-    }
-  }
-      //if not within the keyCount, insert at the end.
-  *((bufferPtr+2) + 2*i) = key;
-  *((bufferPtr+3) + 2*i) = pid; // inc address and assign it
-  incKeyCout(true);
-
-  return 0;
+  return this->insertAt(this->upperBound(key), key, pid);
 }
 
 /*
@@ -423,46 +308,45 @@ RC BTNonLeafNode::insert(int key, PageId pid)
  * @param pid[IN] the PageId to insert
  * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
  * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+ * @param numStay[IN] the # keys this node keeps, or -1 for half of them
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey)
-{ 
-  RC rc;
-
-  int numMove = getKeyCount()/2;
-  int numStay = getKeyCount() - numMove;
-
-  int keyCount = getKeyCount();
-  for (int i = keyCount-1; i >= numStay; i--)
-  {
-    int readKey;
-
-    if (rc = sibling.insert(readKey, pid) < 0)
-      return rc;
-    if (rc = deleteFromBuffer(i) < 0)
-      return rc;
-    incKeyCout(false);
-  }
-  
-  //[KC | pid | key | pid | ... ] //[KC | -pid- | -key- | pid | ... ]
-  midKey = numMove;
-  // remove the mkey
-  deleteFromBuffer(numMove);
-
-  if (key < midKey){ // insert key in original buffer
-    insert(key, pid);
-  }
-  else{ // insert key in the sibling
-    sibling.insert(key, pid);
-  }
-
-  /* midKey:- //the key chosen after overflow is split.
-  *                             _push_up_
-  * [pidJ|40|pidK|50|pidL| ...] [pidX|190|pidY|250|pidZ| ...]
-  *                             mid key = 190
-  */
-  //midKey = *((bufferPtr+1) + 2*numStay); // first key of second node split
-  return 0; 
+template <class Key, int PageSize>
+RC BTNonLeafNodeT<Key, PageSize>::insertAndSplit(const Key& key, PageId pid,
+    BTNonLeafNodeT& sibling, Key& midKey, int numStay)
+{
+  typedef typename BTreeNode<Key, PageId, PageSize>::Entry Entry;
+
+  if (sibling.getKeyCount() != 0) return RC_INVALID_CURSOR;
+
+  int keyCount = this->getKeyCount();
+  int pos = this->upperBound(key);
+  Entry all[BTreeNode<Key, PageId, PageSize>::MAX_KEY_COUNT + 1];
+  Entry* e = this->entries();
+  memcpy(all, e, pos * sizeof(Entry));
+  all[pos].key = key;
+  all[pos].value = pid;
+  memcpy(all + pos + 1, e + pos, (keyCount - pos) * sizeof(Entry));
+
+  /* midKey: the key chosen after overflow is split.
+   *                             _push_up_
+   * [pidJ|40|pidK|50|pidL| ...] [pidX|190|pidY|250|pidZ| ...]
+   *                             mid key = 190
+   * the pid right of the middle key becomes the leftmost child of sibling.
+   * if this node keeps every other key, sibling has that child only.
+   */
+  int total = keyCount + 1;
+  if (numStay < 0)
+    numStay = total / 2;
+  numStay = std::max(1, std::min(numStay, total - 1));
+  memcpy(e, all, numStay * sizeof(Entry));
+  this->header()->keyCount = numStay;
+
+  midKey = all[numStay].key;
+  sibling.header()->link = all[numStay].value;
+  memcpy(sibling.entries(), all + numStay + 1, (total - numStay - 1) * sizeof(Entry));
+  sibling.header()->keyCount = total - numStay - 1;
+  return 0;
 }
 
 /*
@@ -472,125 +356,111 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
  * @param pid[OUT] the pointer to the child node to follow.
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
-{ 
-  /*
-  Based on searchKey -> examine until searchKey is < key of node
-  */
-  //Convert buffer pointer from char to int
-  int *bufferPtr = (int *) buffer;
-  int keyCount = getKeyCount();
-
-  // if no key, no point in travesing empty
-  if(keyCount <= 0)
-    return RC_INVALID_CURSOR;
-
-  // Loop through buffer and search for the key that are greater or equal to searchKey
-  // if found in buffer set it to pid and exit.
-  
-  int i = 0;
-  for(; i < keyCount; i++){
-    // key found
-    if (*((bufferPtr+2) + 2*i) > searchKey)
-    {
-      pid = *((bufferPtr+1) + 2*i);
-      return 0;
-    }
-  }
-  // gone everywhere and still could not find key greater than searchkey.
-  pid = *((bufferPtr+1) + 2*i);
-  return 0; 
+template <class Key, int PageSize>
+RC BTNonLeafNodeT<Key, PageSize>::locateChildPtr(const Key& searchKey, PageId& pid)
+{
+  // follow the pointer right of the last key that is <= searchKey
+  int i = this->upperBound(searchKey);
+  pid = (i == 0) ? this->header()->link : this->entries()[i - 1].value;
+  return 0;
 }
 
 /*
- * Initialize the root node with (pid1, key, pid2).
- * @param pid1[IN] the first PageId to insert
- * @param key[IN] the key that should be inserted between the two PageIds
- * @param pid2[IN] the PageId to insert behind the key
+ * Given the searchKey, find the child-node pointer to follow to the
+ * first entry with a key >= searchKey.
+ * @param searchKey[IN] the searchKey that is being looked up.
+ * @param pid[OUT] the pointer to the child node to follow.
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
-{ 
-  /*
-  Root initizlization on Buffer:
-  [ pid1 | key | pid2 ]
-  pid1 = with an index of 0 on buffer
-
-  default values of page values.
-  */
-  //Convert buffer pointer from char to int
-  int *bufferPtr = (int *) buffer;
-
-  *(bufferPtr+1) = pid1;
-  *(bufferPtr+2) = key; // inc address and assign it
-  *(bufferPtr+3) = pid2; // inc address and assign it
-  incKeyCout(true);
-   // first root insert
-  return 0; 
+template <class Key, int PageSize>
+RC BTNonLeafNodeT<Key, PageSize>::locateFirstChildPtr(const Key& searchKey, PageId& pid)
+{
+  // follow the pointer right of the last key that is < searchKey
+  int i = this->lowerBound(searchKey);
+  pid = (i == 0) ? this->header()->link : this->entries()[i - 1].value;
+  return 0;
 }
 
+/*
+ * Return the i'th child pointer of the node.
+ * @param i[IN] the child number, 0 <= i <= getKeyCount()
+ * @return the PageId of the child
+ */
+template <class Key, int PageSize>
+PageId BTNonLeafNodeT<Key, PageSize>::getChildPtr(int i)
+{
+  if (i < 0 || i > this->getKeyCount()) return -1;
+  return (i == 0) ? this->header()->link : this->entries()[i - 1].value;
+}
 
-// void BTNonLeafNode::insertTreeHeightRootPid(int treeHeight, PageId rootPid)
-// {
-//   int *bufferPtr = (int *) buffer;
-//   bufferPtr[254] = treeHeight;
-//   bufferPtr[255] = rootPid;
-// }
-
-
-////////////////////////////////////////////////////////////////////////////////
-//                            BTNonLeafNode Helper Functions                     //
-////////////////////////////////////////////////////////////////////////////////
+/*
+ * Return the pid of the message buffer page of the node.
+ * @return the PageId of the buffer page, or -1 if the node has none
+ */
+template <class Key, int PageSize>
+PageId BTNonLeafNodeT<Key, PageSize>::getBufferPtr()
+{
+  // page 0 of an index is never a buffer page
+  return this->header()->prev > 0 ? this->header()->prev : -1;
+}
 
- /*
- * Checks node if full
+/*
+ * Set the pid of the message buffer page of the node.
+ * @param pid[IN] the PageId of the buffer page
  * @return 0 if successful. Return an error code if there is an error.
  */
-bool BTNonLeafNode::checkFull()
+template <class Key, int PageSize>
+RC BTNonLeafNodeT<Key, PageSize>::setBufferPtr(PageId pid)
 {
-  //Max key count, excluding last entry of the leaf node (page id)
-  int keyCount = getKeyCount();
-  if(keyCount >= g_maxKeyCount_NonLeafNode)
-    return true;
-  else
-    return false;
+  this->header()->prev = pid;
+  return 0;
 }
 
-//Shifts all the elements from loc by one entry
-RC BTNonLeafNode::shift(const int loc)
+/*
+ * Initialize the root node with (pid1, key, pid2).
+ * @param pid1[IN] the first PageId to insert
+ * @param key[IN] the key that should be inserted between the two PageIds
+ * @param pid2[IN] the PageId to insert behind the key
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+template <class Key, int PageSize>
+RC BTNonLeafNodeT<Key, PageSize>::initializeRoot(PageId pid1, const Key& key, PageId pid2)
 {
-  RC rc;
-  int * intBufferPtr = (int *)buffer;
-  int keyCount = getKeyCount();
-  for(int i = keyCount-1; i >= loc; i--) 
-  {
-    int index = loc*2+2;
-    *(intBufferPtr + index + 2) = *(intBufferPtr + index); 
-    *(intBufferPtr + index + 3) = *(intBufferPtr + index + 1);
-  }
+  this->header()->keyCount = 1;
+  this->header()->link = pid1;
+  this->entries()[0].key = key;
+  this->entries()[0].value = pid2;
   return 0;
 }
 
-RC BTNonLeafNode::deleteFromBuffer(const int loc)
+/*
+ * Initialize an empty node with only its leftmost child pointer.
+ * @param pid[IN] the leftmost child of the node
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+template <class Key, int PageSize>
+RC BTNonLeafNodeT<Key, PageSize>::initialize(PageId pid)
 {
-  RC rc;
-  if(loc >= getKeyCount())
-    return RC_NO_SUCH_RECORD;
-
-  int* intBufferPtr = (int*) buffer;
-  int index = loc*2;
-  *(intBufferPtr + index) = -1;
-  *(intBufferPtr + index + 1) = -1;
+  this->header()->keyCount = 0;
+  this->header()->link = pid;
   return 0;
 }
 
-void BTNonLeafNode::incKeyCout(bool increment)
-{
 
-  int *intBufferPtr = (int*) buffer;
-  if(increment)
-    intBufferPtr[0]++;
-  else
-    intBufferPtr[0]--;
-}
+//
+// explicit instantiations for the supported key types
+//
+template class BTreeNode<Int32Key, RecordId>;
+template class BTreeNode<Int32Key, PageId>;
+template class BTLeafNodeT<Int32Key>;
+template class BTNonLeafNodeT<Int32Key>;
+
+template class BTreeNode<Int64Key, RecordId>;
+template class BTreeNode<Int64Key, PageId>;
+template class BTLeafNodeT<Int64Key>;
+template class BTNonLeafNodeT<Int64Key>;
 
+template class BTreeNode<StringKey, RecordId>;
+template class BTreeNode<StringKey, PageId>;
+template class BTLeafNodeT<StringKey>;
+template class BTNonLeafNodeT<StringKey>;
@@ -10,130 +10,359 @@
 #ifndef BTNODE_H
 #define BTNODE_H
 
+#include <cstring>
+#include <string>
 #include "RecordFile.h"
 #include "PageFile.h"
-#include "math.h"
+
+/**
+ * FixedKey: a fixed-width string-prefix key.
+ * Only the first N bytes of a string are kept (zero padded), and keys are
+ * compared bytewise, so the key has a constant width inside a node.
+ */
+template <int N>
+struct FixedKey {
+  char bytes[N];
+
+  static FixedKey fromString(const std::string& s)
+  {
+    FixedKey k;
+    memset(k.bytes, 0, N);
+    memcpy(k.bytes, s.data(), s.size() < (size_t)N ? s.size() : N);
+    return k;
+  }
+
+  int compare(const FixedKey& k) const { return memcmp(bytes, k.bytes, N); }
+};
+
+template <int N> bool operator< (const FixedKey<N>& a, const FixedKey<N>& b) { return a.compare(b) < 0; }
+template <int N> bool operator> (const FixedKey<N>& a, const FixedKey<N>& b) { return a.compare(b) > 0; }
+template <int N> bool operator<= (const FixedKey<N>& a, const FixedKey<N>& b) { return a.compare(b) <= 0; }
+template <int N> bool operator>= (const FixedKey<N>& a, const FixedKey<N>& b) { return a.compare(b) >= 0; }
+template <int N> bool operator== (const FixedKey<N>& a, const FixedKey<N>& b) { return a.compare(b) == 0; }
+template <int N> bool operator!= (const FixedKey<N>& a, const FixedKey<N>& b) { return a.compare(b) != 0; }
+
+// the key types the B+tree is instantiated for (see the end of BTreeNode.cc)
+typedef int          Int32Key;
+typedef long long    Int64Key;
+typedef FixedKey<16> StringKey;
+
+/**
+ * A 64-bit FNV-1a hash over the bytes of a key. The key types are plain
+ * values without padding, so equal keys have equal bytes and hashes.
+ */
+template <class Key>
+inline unsigned long long hashKey(const Key& key)
+{
+  const unsigned char* p = (const unsigned char*) &key;
+  unsigned long long h = 14695981039346656037ULL;
+  for (size_t i = 0; i < sizeof(Key); i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/**
+ * The position of a key on the real line, in key order, for interpolating
+ * between two keys. A string key is placed by its first 8 bytes.
+ */
+inline double keyPosition(Int32Key key) { return key; }
+inline double keyPosition(Int64Key key) { return (double) key; }
+
+template <int N>
+inline double keyPosition(const FixedKey<N>& key)
+{
+  double pos = 0;
+  for (int i = 0; i < 8; i++)
+    pos = pos * 256 + (i < N ? (unsigned char) key.bytes[i] : 0);
+  return pos;
+}
+
+/**
+ * BTreeNode: the common page layout of a B+tree node.
+ * A node is a header followed by a sorted array of (key, value) entries:
+ *
+ *   [ keyCount | link | prev | (key, value) | (key, value) | ... ]
+ *
+ * For a leaf node the value is a RecordId, link is the next sibling and
+ * prev is the previous sibling, so the leaves form a doubly linked list;
+ * for a nonleaf node the value is the child right of the key, link is
+ * the leftmost child and prev is the page that buffers the node's pending
+ * inserts in a buffered index. The fanout is computed from the page size
+ * and the key width at compile time.
+ */
+template <class Key, class Value, int PageSize = PageFile::PAGE_SIZE>
+class BTreeNode {
+ public:
+  struct Header {
+    int    keyCount;  // # entries in the node
+    PageId link;      // next sibling (leaf) or leftmost child (nonleaf)
+    PageId prev;      // previous sibling (leaf) or message buffer (nonleaf)
+  };
+
+  struct Entry {
+    Key   key;
+    Value value;
+  };
+
+  // entries start at the first properly aligned offset after the header
+  static constexpr int ENTRY_OFFSET =
+    (sizeof(Header) + alignof(Entry) - 1) / alignof(Entry) * alignof(Entry);
+
+  // the maximum # entries that fit in a node
+  static constexpr int MAX_KEY_COUNT = (PageSize - ENTRY_OFFSET) / sizeof(Entry);
+
+  static_assert(PageSize <= PageFile::PAGE_SIZE, "node must fit in a page");
+  static_assert(MAX_KEY_COUNT >= 3, "page too small for this key type");
+
+  BTreeNode();
+
+  /**
+   * Read the content of the node from the page pid in the PageFile pf.
+   * @param pid[IN] the PageId to read
+   * @param pf[IN] PageFile to read from
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC read(PageId pid, const PageFile& pf);
+
+  /**
+   * Write the content of the node to the page pid in the PageFile pf.
+   * @param pid[IN] the PageId to write to
+   * @param pf[IN] PageFile to write to
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC write(PageId pid, PageFile& pf);
+
+  /**
+   * Return the number of keys stored in the node.
+   * @return the number of keys in the node
+   */
+  int getKeyCount() const { return header()->keyCount; }
+
+ protected:
+  const Header* header() const { return (const Header*) buffer; }
+  Header* header() { return (Header*) buffer; }
+  const Entry* entries() const { return (const Entry*) (buffer + ENTRY_OFFSET); }
+  Entry* entries() { return (Entry*) (buffer + ENTRY_OFFSET); }
+
+  // index of the first entry whose key is >= searchKey
+  int lowerBound(const Key& searchKey) const;
+
+  // index of the first entry whose key is > searchKey
+  int upperBound(const Key& searchKey) const;
+
+  // insert (key, value) at position pos, shifting the later entries
+  RC insertAt(int pos, const Key& key, const Value& value);
+
+  /**
+   * The main memory buffer for loading the content of the disk page
+   * that contains the node.
+   */
+  alignas(Entry) char buffer[PageFile::PAGE_SIZE];
+};
+
 /**
- * BTLeafNode: The class representing a B+tree leaf node.
+ * BTLeafNodeT: The class representing a B+tree leaf node.
  */
-const int g_leafEntrySize = sizeof(int) + sizeof(RecordId);
-const int g_maxKeyCount = 84;
-class BTLeafNode {
-public:
-    BTLeafNode ();
-    RC insert(int key, const RecordId& rid);
-    RC insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey);
-    RC locate(int searchKey, int& eid);
-    RC readEntry(int eid, int& key, RecordId& rid);
-    PageId getNextNodePtr();
-    RC setNextNodePtr(PageId pid);
-    int getKeyCount();
-    RC read(PageId pid, const PageFile& pf);
-    RC write(PageId pid, PageFile& pf);
-    
-private:
-    char buffer[PageFile::PAGE_SIZE];
-   // int keyCount;
-    RC insertToBuffer(const int key, const RecordId rid, const int eid);
-    RC deleteFromBuffer(const int eid);
-    bool checkFull();
-    void incKeyCout(bool increment);
-    RC shift(const int eid);
-}; 
+template <class Key, int PageSize = PageFile::PAGE_SIZE>
+class BTLeafNodeT : public BTreeNode<Key, RecordId, PageSize> {
+ public:
+  BTLeafNodeT();
+
+  /**
+   * Insert the (key, rid) pair to the node.
+   * Remember that all keys inside a B+tree node should be kept sorted.
+   * @param key[IN] the key to insert
+   * @param rid[IN] the RecordId to insert
+   * @return 0 if successful. Return an error code if the node is full.
+   */
+  RC insert(const Key& key, const RecordId& rid);
+
+  /**
+   * Insert the (key, rid) pair to the node
+   * and split the node half and half with sibling.
+   * The sibling inherits the next-node pointer of this node; the caller
+   * must link this node, the sibling and the old next node together
+   * once the sibling has a PageId.
+   * @param key[IN] the key to insert.
+   * @param rid[IN] the RecordId to insert.
+   * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
+   * @param siblingKey[OUT] the first key in the sibling node after split.
+   * @param numStay[IN] the # entries this node keeps, or -1 to split half
+   *                    and half. A node on the right edge of an ascending
+   *                    insert stream keeps all of its entries.
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC insertAndSplit(const Key& key, const RecordId& rid, BTLeafNodeT& sibling, Key& siblingKey,
+                    int numStay = -1);
+
+  /**
+   * Find the entry whose key value is larger than or equal to searchKey
+   * and output the eid (entry number) whose key value >= searchKey.
+   * Remeber that all keys inside a B+tree node should be kept sorted.
+   * @param searchKey[IN] the key to search for
+   * @param eid[OUT] the entry number that contains a key larger than or equalty to searchKey
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC locate(const Key& searchKey, int& eid);
+
+  /**
+   * Find the last entry whose key value is smaller than or equal to
+   * searchKey and output its eid (entry number).
+   * @param searchKey[IN] the key to search for
+   * @param eid[OUT] the entry number that contains a key smaller than or equal to searchKey
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC locateBackward(const Key& searchKey, int& eid);
+
+  /**
+   * Read the (key, rid) pair from the eid entry.
+   * @param eid[IN] the entry number to read the (key, rid) pair from
+   * @param key[OUT] the key from the entry
+   * @param rid[OUT] the RecordId from the entry
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC readEntry(int eid, Key& key, RecordId& rid);
+
+  /**
+   * Remove the entries from begin up to (but not including) end.
+   * @param begin[IN] the first entry number to remove
+   * @param end[IN] the entry number after the last one to remove
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC erase(int begin, int end);
 
+  /**
+   * Return the pid of the next slibling node.
+   * @return the PageId of the next sibling node
+   */
+  PageId getNextNodePtr();
+
+  /**
+   * Set the pid of the next slibling node.
+   * @param pid[IN] the PageId of the next sibling node
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC setNextNodePtr(PageId pid);
+
+  /**
+   * Return the pid of the previous slibling node.
+   * @return the PageId of the previous sibling node
+   */
+  PageId getPrevNodePtr();
+
+  /**
+   * Set the pid of the previous slibling node.
+   * @param pid[IN] the PageId of the previous sibling node
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC setPrevNodePtr(PageId pid);
+};
 
 /**
- * BTNonLeafNode: The class representing a B+tree nonleaf node.
+ * BTNonLeafNodeT: The class representing a B+tree nonleaf node.
  */
+template <class Key, int PageSize = PageFile::PAGE_SIZE>
+class BTNonLeafNodeT : public BTreeNode<Key, PageId, PageSize> {
+ public:
+  BTNonLeafNodeT();
+
+  /**
+   * Insert a (key, pid) pair to the node.
+   * Remember that all keys inside a B+tree node should be kept sorted.
+   * @param key[IN] the key to insert
+   * @param pid[IN] the PageId to insert
+   * @return 0 if successful. Return an error code if the node is full.
+   */
+  RC insert(const Key& key, PageId pid);
+
+  /**
+   * Insert the (key, pid) pair to the node
+   * and split the node half and half with sibling.
+   * The sibling node MUST be empty when this function is called.
+   * The middle key after the split is returned in midKey.
+   * Remember that all keys inside a B+tree node should be kept sorted.
+   * @param key[IN] the key to insert
+   * @param pid[IN] the PageId to insert
+   * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
+   * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+   * @param numStay[IN] the # keys this node keeps, or -1 to split half and half
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC insertAndSplit(const Key& key, PageId pid, BTNonLeafNodeT& sibling, Key& midKey,
+                    int numStay = -1);
+
+  /**
+   * Given the searchKey, find the child-node pointer to follow and
+   * output it in pid.
+   * Remember that the keys inside a B+tree node are sorted.
+   * @param searchKey[IN] the searchKey that is being looked up.
+   * @param pid[OUT] the pointer to the child node to follow.
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC locateChildPtr(const Key& searchKey, PageId& pid);
+
+  /**
+   * Given the searchKey, find the child-node pointer to follow to the
+   * first entry with a key >= searchKey. The entries with a key equal
+   * to a key of the node may be on both sides of it, so unlike
+   * locateChildPtr(), this goes left of a key equal to searchKey.
+   * @param searchKey[IN] the searchKey that is being looked up.
+   * @param pid[OUT] the pointer to the child node to follow.
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC locateFirstChildPtr(const Key& searchKey, PageId& pid);
+
+  /**
+   * Return the i'th child pointer of the node, where 0 is the leftmost
+   * child and getKeyCount() is the rightmost one.
+   * @param i[IN] the child number
+   * @return the PageId of the child
+   */
+  PageId getChildPtr(int i);
+
+  /**
+   * Return the i'th key of the node, which separates the children i and
+   * i+1.
+   * @param i[IN] the key number, from 0 to getKeyCount()-1
+   * @return the key
+   */
+  Key getKey(int i) const { return this->entries()[i].key; }
+
+  /**
+   * Return the pid of the page that buffers the pending inserts of the
+   * node in a buffered index. The buffer page is in the leaf-node format.
+   * @return the PageId of the buffer page, or -1 if the node has none
+   */
+  PageId getBufferPtr();
+
+  /**
+   * Set the pid of the message buffer page of the node.
+   * @param pid[IN] the PageId of the buffer page
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC setBufferPtr(PageId pid);
+
+  /**
+   * Initialize the root node with (pid1, key, pid2).
+   * @param pid1[IN] the first PageId to insert
+   * @param key[IN] the key that should be inserted between the two PageIds
+   * @param pid2[IN] the PageId to insert behind the key
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC initializeRoot(PageId pid1, const Key& key, PageId pid2);
+
+  /**
+   * Initialize an empty node with only its leftmost child pointer.
+   * Further (key, pid) pairs are added with insert().
+   * @param pid[IN] the leftmost child of the node
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC initialize(PageId pid);
+};
 
-/*  
-*   Unspanned Method:
-*      NonLeafNode: [ pid | key | pid | ... | pid ]
-*      1024/4 = 256 //int array
-*      256 - 1// last pid
-*      255/2= 127 //pairs of [pid | key] entries
-*      1 unused element.
-*/
-const int g_maxKeyCount_NonLeafNode = 127;
-class BTNonLeafNode {
-public:
-    /**
-     * Insert a (key, pid) pair to the node.
-     * Remember that all keys inside a B+tree node should be kept sorted.
-     * @param key[IN] the key to insert
-     * @param pid[IN] the PageId to insert
-     * @return 0 if successful. Return an error code if the node is full.
-     */
-    RC insert(int key, PageId pid);
-    
-    /**
-     * Insert the (key, pid) pair to the node
-     * and split the node half and half with sibling.
-     * The sibling node MUST be empty when this function is called.
-     * The middle key after the split is returned in midKey.
-     * Remember that all keys inside a B+tree node should be kept sorted.
-     * @param key[IN] the key to insert
-     * @param pid[IN] the PageId to insert
-     * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
-     * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
-     * @return 0 if successful. Return an error code if there is an error.
-     */
-    RC insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey);
-    
-    /**
-     * Given the searchKey, find the child-node pointer to follow and
-     * output it in pid.
-     * Remember that the keys inside a B+tree node are sorted.
-     * @param searchKey[IN] the searchKey that is being looked up.
-     * @param pid[OUT] the pointer to the child node to follow.
-     * @return 0 if successful. Return an error code if there is an error.
-     */
-    RC locateChildPtr(int searchKey, PageId& pid);
-    
-    /**
-     * Initialize the root node with (pid1, key, pid2).
-     * @param pid1[IN] the first PageId to insert
-     * @param key[IN] the key that should be inserted between the two PageIds
-     * @param pid2[IN] the PageId to insert behind the key
-     * @return 0 if successful. Return an error code if there is an error.
-     */
-    RC initializeRoot(PageId pid1, int key, PageId pid2);
-    
-    /**
-     * Return the number of keys stored in the node.
-     * @return the number of keys in the node
-     */
-    int getKeyCount();
-    
-    /**
-     * Read the content of the node from the page pid in the PageFile pf.
-     * @param pid[IN] the PageId to read
-     * @param pf[IN] PageFile to read from
-     * @return 0 if successful. Return an error code if there is an error.
-     */
-    RC read(PageId pid, const PageFile& pf);
-    
-    /**
-     * Write the content of the node to the page pid in the PageFile pf.
-     * @param pid[IN] the PageId to write to
-     * @param pf[IN] PageFile to write to
-     * @return 0 if successful. Return an error code if there is an error.
-     */
-    RC write(PageId pid, PageFile& pf);
-
-   // void insertTreeHeightRootPid(int treeHeight, PageId rootPid);
-    
-private:
-    /**
-     * The main memory buffer for loading the content of the disk page 
-     * that contains the node.
-     */
-    char buffer[PageFile::PAGE_SIZE];
-    //int keyCount;
-    bool checkFull();
-    RC shift(const int loc);
-    RC deleteFromBuffer(const int loc);
-    void incKeyCout(bool increment);
-}; 
+typedef BTLeafNodeT<int>    BTLeafNode;
+typedef BTNonLeafNodeT<int> BTNonLeafNode;
 
 #endif /* BTNODE_H */
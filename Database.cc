@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include <algorithm>
+#include <vector>
+#include <sys/stat.h>
+#include "Database.h"
+#include "QueryCursor.h"
+
+using namespace std;
+
+// the # tuples backfill() reads at a time
+static const int BACKFILL_BATCH = 1024;
+
+// check whether a file exists
+static bool fileExists(const string& name);
+
+Table::Table()
+    : tableOpen(false), indexOpen(false), hashOpen(false), lsmOpen(false), mode('r')
+{
+}
+
+Table::~Table()
+{
+    close();
+}
+
+/*
+ * Open the files of a table.
+ * @param name[IN] the table name, with the directory of its files
+ * @param mode[IN] 'r' for read, 'w' for write
+ * @param index[IN] the index to maintain in 'w' mode
+ * @return error code. 0 if no error
+ */
+RC Table::open(const string& name, char mode, SqlEngine::IndexType index)
+{
+    RC rc;
+
+    close();
+    if (mode != 'r' && mode != 'w') return RC_INVALID_FILE_MODE;
+    this->mode = mode;
+
+    if ((rc = rf.open(name + ".tbl", mode)) < 0) return rc;
+    tableOpen = true;
+
+    if (mode == 'r') {
+        // a missing index is no error. the table is then scanned.
+        indexOpen = (bIndex.open(name + ".idx", 'r') == 0);
+        hashOpen = (hIndex.open(name + ".hash", 'r') == 0);
+        lsmOpen = (lIndex.open(name + ".lsm", 'r') == 0);
+        return 0;
+    }
+
+    // every index the table has is kept up to date, not just the one
+    // that index names, or a later SELECT would answer from an index
+    // that misses tuples. a new index on a table with tuples gets them
+    // first.
+    bool hasIndex = fileExists(name + ".idx");
+    bool hasHash = fileExists(name + ".hash");
+    bool hasLsm = fileExists(name + ".lsm");
+    bool newIndex = !hasIndex && (index == SqlEngine::BTREE_INDEX || index == SqlEngine::BUFFERED_INDEX);
+    bool newHash = !hasHash && index == SqlEngine::HASH_INDEX;
+    bool newLsm = !hasLsm && index == SqlEngine::LSM_INDEX;
+
+    if (hasHash || newHash) {
+        if ((rc = hIndex.open(name + ".hash", 'w')) < 0) {
+            close();
+            return rc;
+        }
+        hashOpen = true;
+    }
+    if (hasIndex || newIndex) {
+        if ((rc = bIndex.open(name + ".idx", 'w')) < 0) {
+            close();
+            return rc;
+        }
+        indexOpen = true;
+    }
+    if (hasLsm || newLsm) {
+        if ((rc = lIndex.open(name + ".lsm", 'w')) < 0) {
+            close();
+            return rc;
+        }
+        lsmOpen = true;
+    }
+    if ((newIndex || newHash || newLsm) && (rc = backfill(newIndex, newHash, newLsm)) < 0) {
+        close();
+        return rc;
+    }
+
+    // a buffered index stays buffered for the later loads
+    if (index == SqlEngine::BUFFERED_INDEX)
+        bIndex.setBuffered(true);
+    return 0;
+}
+
+/*
+ * Close the files of the table.
+ * @return error code. 0 if no error
+ */
+RC Table::close()
+{
+    RC rc = 0;
+    RC r;
+
+    // every file is closed even if one fails
+    if (indexOpen && (r = bIndex.close()) < 0) rc = r;
+    if (hashOpen && (r = hIndex.close()) < 0) rc = r;
+    if (lsmOpen && (r = lIndex.close()) < 0) rc = r;
+    if (tableOpen && (r = rf.close()) < 0) rc = r;
+    tableOpen = indexOpen = hashOpen = lsmOpen = false;
+    return rc;
+}
+
+/*
+ * Read the value of a tuple with the given key.
+ * @param key[IN] the key to look up
+ * @param value[OUT] the value of the first tuple found with key
+ * @return error code. 0 if no error. RC_NO_SUCH_RECORD if no tuple has key
+ */
+RC Table::get(int key, string& value)
+{
+    RC rc;
+    QueryCursor cursor;
+    int k;
+    string_view v;
+
+    if ((rc = select(3, key, key, cursor)) < 0) return rc;
+    if ((rc = cursor.next(k, v)) < 0)
+        return (rc == RC_END_OF_TREE) ? RC_NO_SUCH_RECORD : rc;
+    value.assign(v.data(), v.size());
+    return 0;
+}
+
+/*
+ * Open a cursor over the tuples with lo <= key <= hi.
+ * @param lo[IN] the smallest key to return
+ * @param hi[IN] the largest key to return
+ * @param cursor[OUT] the cursor to open
+ * @return error code. 0 if no error
+ */
+RC Table::scan(int lo, int hi, QueryCursor& cursor)
+{
+    return select(3, lo, hi, cursor);
+}
+
+/*
+ * Count the tuples with lo <= key <= hi.
+ * @param lo[IN] the smallest key to count
+ * @param hi[IN] the largest key to count
+ * @param count[OUT] the # tuples
+ * @return error code. 0 if no error
+ */
+RC Table::count(int lo, int hi, int& count)
+{
+    RC rc;
+    QueryCursor cursor;
+    const TupleBatch* batch;
+
+    count = 0;
+    if ((rc = select(4, lo, hi, cursor)) < 0) return rc;
+    while ((rc = cursor.nextBatch(batch)) == 0)
+        count += batch->selCount;
+    return (rc == RC_END_OF_TREE) ? 0 : rc;
+}
+
+/*
+ * Append every tuple of source to the table and its index.
+ * @param source[IN] the tuples to load
+ * @return error code. 0 if no error
+ */
+RC Table::bulkLoad(TupleSource& source)
+{
+    RC       rc;
+    int      key;
+    string   value;
+    RecordId rid;
+    vector<BTreeIndex::IndexEntry> entries; // (key, rid) pairs for the bulk load
+
+    if (!tableOpen || mode != 'w') return RC_INVALID_FILE_MODE;
+
+    while ((rc = source.next(key, value)) == 0) {
+        if ((rc = rf.append(key, value, rid)) < 0) return rc;
+        if (hashOpen && (rc = hIndex.insert(key, rid)) < 0) return rc;
+        if (lsmOpen && (rc = lIndex.insert(key, rid)) < 0) return rc;
+        if (indexOpen) {
+            BTreeIndex::IndexEntry entry = { key, rid };
+            entries.push_back(entry);
+        }
+    }
+    if (rc != RC_END_OF_TREE) return rc;
+
+    // build the index bottom-up from the sorted (key, rid) pairs instead
+    // of descending the tree once per tuple. an 8-byte rid plus the key
+    // is small enough that the pairs of any load file sort in memory.
+    // into a nonempty index the pairs are inserted one by one, through
+    // the buffers of a buffered index.
+    if (indexOpen) {
+        stable_sort(entries.begin(), entries.end());
+        return bIndex.bulkLoad(entries.empty() ? NULL : &entries[0], entries.size());
+    }
+    return 0;
+}
+
+RC Table::backfill(bool toIndex, bool toHash, bool toLsm)
+{
+    RC rc;
+    RecordId rid;
+    vector<RecordId> rids(BACKFILL_BATCH);
+    vector<int> keys(BACKFILL_BATCH);
+    vector<string> values(BACKFILL_BATCH);
+    vector<BTreeIndex::IndexEntry> entries;
+    const RecordId end = rf.endRid();
+
+    rid.pid = rid.sid = 0;
+    while (rid < end) {
+        int n = 0;
+        for (; n < BACKFILL_BATCH && rid < end; n++, ++rid)
+            rids[n] = rid;
+        if ((rc = rf.read(&rids[0], n, &keys[0], &values[0])) < 0) return rc;
+        for (int i = 0; i < n; i++) {
+            if (toHash && (rc = hIndex.insert(keys[i], rids[i])) < 0) return rc;
+            if (toLsm && (rc = lIndex.insert(keys[i], rids[i])) < 0) return rc;
+            if (toIndex) {
+                BTreeIndex::IndexEntry entry = { keys[i], rids[i] };
+                entries.push_back(entry);
+            }
+        }
+    }
+    if (toIndex && !entries.empty()) {
+        stable_sort(entries.begin(), entries.end());
+        return bIndex.bulkLoad(&entries[0], entries.size());
+    }
+    return 0;
+}
+
+RC Table::select(int attr, int lo, int hi, QueryCursor& cursor)
+{
+    KeyRange range;
+
+    range.hasLow = range.hasHigh = true;
+    range.lowInclusive = range.highInclusive = true;
+    range.low = lo;
+    range.high = hi;
+    return cursor.open(*this, attr, range);
+}
+
+
+Database::Database(const string& dir)
+    : dir(dir)
+{
+    pthread_mutex_init(&catalogLock, NULL);
+}
+
+Database::~Database()
+{
+    map<string, Table*>::iterator it;
+    for (it = catalog.begin(); it != catalog.end(); ++it)
+        delete it->second;
+    pthread_mutex_destroy(&catalogLock);
+}
+
+/*
+ * Return the handle of a table in the catalog.
+ * @param name[IN] the table name
+ * @param table[OUT] the handle
+ * @return error code. 0 if no error
+ */
+RC Database::getTable(const string& name, Table*& table)
+{
+    RC rc = 0;
+
+    pthread_mutex_lock(&catalogLock);
+    map<string, Table*>::iterator it = catalog.find(name);
+    if (it != catalog.end())
+        table = it->second;
+    else {
+        // a table that does not exist is not remembered
+        table = new Table;
+        if ((rc = table->open(path(name), 'r')) < 0) {
+            delete table;
+            table = NULL;
+        } else
+            catalog[name] = table;
+    }
+    pthread_mutex_unlock(&catalogLock);
+    return rc;
+}
+
+/*
+ * Close the handle of a table in the catalog.
+ * @param name[IN] the table name
+ */
+void Database::invalidate(const string& name)
+{
+    pthread_mutex_lock(&catalogLock);
+    map<string, Table*>::iterator it = catalog.find(name);
+    if (it != catalog.end()) {
+        delete it->second;
+        catalog.erase(it);
+    }
+    pthread_mutex_unlock(&catalogLock);
+}
+
+/*
+ * Open a table for reading.
+ * @param name[IN] the table name
+ * @param table[OUT] the handle to open
+ * @return error code. 0 if no error
+ */
+RC Database::openTable(const string& name, Table& table)
+{
+    return table.open(path(name), 'r');
+}
+
+/*
+ * Load tuples into a table, as LOAD does.
+ * @param name[IN] the table name
+ * @param index[IN] the index to build on the key column
+ * @param source[IN] the tuples to load
+ * @return error code. 0 if no error
+ */
+RC Database::loadTable(const string& name, SqlEngine::IndexType index, TupleSource& source)
+{
+    RC rc;
+    Table table;
+
+    // the handle in the catalog would miss the new tuples
+    invalidate(name);
+    if ((rc = table.open(path(name), 'w', index)) < 0) return rc;
+    rc = table.bulkLoad(source);
+    RC r = table.close();
+    return (rc < 0) ? rc : r;
+}
+
+static bool fileExists(const string& name)
+{
+    struct stat st;
+    return stat(name.c_str(), &st) == 0;
+}
+
+string Database::path(const string& name) const
+{
+    if (dir.empty() || dir[dir.size() - 1] == '/') return dir + name;
+    return dir + "/" + name;
+}
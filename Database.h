@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#ifndef DATABASE_H
+#define DATABASE_H
+
+#include <map>
+#include <string>
+#include <pthread.h>
+#include "Bruinbase.h"
+#include "SqlEngine.h"
+#include "RecordFile.h"
+#include "BTreeIndex.h"
+#include "HashIndex.h"
+#include "LsmIndex.h"
+
+class QueryCursor;
+
+/**
+ * The tuples that Table::bulkLoad() appends, one at a time.
+ */
+class TupleSource {
+ public:
+  virtual ~TupleSource() { }
+
+  /**
+   * Return the next tuple.
+   * @param key[OUT] the key of the tuple
+   * @param value[OUT] the value of the tuple
+   * @return error code. 0 if no error. RC_END_OF_TREE after the last tuple
+   */
+  virtual RC next(int& key, std::string& value) = 0;
+};
+
+/**
+ * A handle on the files of a table: <name>.tbl and, if they exist, its
+ * B+tree index <name>.idx, hash index <name>.hash and LSM index
+ * <name>.lsm. Bruinbase is
+ * embedded through it without going through SQL text: get(), scan() and
+ * count() plan their query the way SELECT does, and bulkLoad() does what
+ * LOAD does.
+ */
+class Table {
+ public:
+  Table();
+  ~Table();
+
+  /**
+   * Open the files of a table.
+   * In 'r' mode the indexes of the table are opened if they exist. In 'w'
+   * mode the table file is created if it does not exist, every index the
+   * table has is added to, and the index that index names is created if
+   * the table has none of its kind yet, with the tuples already in the
+   * table.
+   * @param name[IN] the table name, with the directory of its files
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @param index[IN] the index to maintain in 'w' mode
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& name, char mode,
+          SqlEngine::IndexType index = SqlEngine::NO_INDEX);
+
+  /**
+   * Close the files of the table.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * Read the value of a tuple with the given key.
+   * @param key[IN] the key to look up
+   * @param value[OUT] the value of the first tuple found with key
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if no tuple has key
+   */
+  RC get(int key, std::string& value);
+
+  /**
+   * Open a cursor over the tuples with lo <= key <= hi.
+   * @param lo[IN] the smallest key to return
+   * @param hi[IN] the largest key to return
+   * @param cursor[OUT] the cursor to open. It must not outlive the table
+   * @return error code. 0 if no error
+   */
+  RC scan(int lo, int hi, QueryCursor& cursor);
+
+  /**
+   * Count the tuples with lo <= key <= hi.
+   * @param lo[IN] the smallest key to count
+   * @param hi[IN] the largest key to count
+   * @param count[OUT] the # tuples
+   * @return error code. 0 if no error
+   */
+  RC count(int lo, int hi, int& count);
+
+  /**
+   * Append every tuple of source to the table and its index. The table
+   * must be open in 'w' mode.
+   * @param source[IN] the tuples to load
+   * @return error code. 0 if no error
+   */
+  RC bulkLoad(TupleSource& source);
+
+  /**
+   * @return the table file
+   */
+  const RecordFile& getRecordFile() const { return rf; }
+
+  /**
+   * @return the B+tree index of the table. NULL if it has none
+   */
+  BTreeIndex* getIndex() { return indexOpen ? &bIndex : NULL; }
+
+  /**
+   * @return the hash index of the table. NULL if it has none
+   */
+  HashIndex* getHashIndex() { return hashOpen ? &hIndex : NULL; }
+
+  /**
+   * @return the LSM index of the table. NULL if it has none
+   */
+  LsmIndex* getLsmIndex() { return lsmOpen ? &lIndex : NULL; }
+
+ private:
+  Table(const Table&);
+  Table& operator=(const Table&);
+
+  // add the tuples in the table file to the new indexes
+  RC backfill(bool toIndex, bool toHash, bool toLsm);
+
+  // run a SELECT with the conditions lo <= key <= hi
+  RC select(int attr, int lo, int hi, QueryCursor& cursor);
+
+  RecordFile rf;
+  BTreeIndex bIndex;
+  HashIndex  hIndex;
+  LsmIndex   lIndex;
+  bool       tableOpen;
+  bool       indexOpen;
+  bool       hashOpen;
+  bool       lsmOpen;
+  char       mode;
+};
+
+/**
+ * A directory of tables, and the entry point for embedding Bruinbase.
+ * It keeps a catalog of the tables it has opened: getTable() opens a
+ * table once, and later calls return the same handle with the end of the
+ * table file and the first page of its index still in memory, until
+ * loadTable() or invalidate() closes it.
+ */
+class Database {
+ public:
+  /**
+   * @param dir[IN] the directory of the table files. Empty: the current
+   * directory
+   */
+  explicit Database(const std::string& dir = "");
+  ~Database();
+
+  /**
+   * Return the handle of a table in the catalog, opening the table for
+   * reading if it is not in the catalog yet.
+   * @param name[IN] the table name
+   * @param table[OUT] the handle. It stays valid until the table is
+   * invalidated
+   * @return error code. 0 if no error
+   */
+  RC getTable(const std::string& name, Table*& table);
+
+  /**
+   * Close the handle of a table in the catalog, e.g., because its files
+   * changed. The next getTable() opens the table again.
+   * @param name[IN] the table name
+   */
+  void invalidate(const std::string& name);
+
+  /**
+   * Open a table for reading.
+   * @param name[IN] the table name
+   * @param table[OUT] the handle to open
+   * @return error code. 0 if no error
+   */
+  RC openTable(const std::string& name, Table& table);
+
+  /**
+   * Load tuples into a table, as LOAD does. The table is created if it
+   * does not exist, and its handle in the catalog is invalidated.
+   * @param name[IN] the table name
+   * @param index[IN] the index to build on the key column
+   * @param source[IN] the tuples to load
+   * @return error code. 0 if no error
+   */
+  RC loadTable(const std::string& name, SqlEngine::IndexType index, TupleSource& source);
+
+ private:
+  // the path of the files of a table, without the extension
+  std::string path(const std::string& name) const;
+
+  Database(const Database&);
+  Database& operator=(const Database&);
+
+  std::string                    dir;
+  std::map<std::string, Table*>  catalog;      // the open tables by name
+  pthread_mutex_t                catalogLock;  /// guards catalog
+};
+
+#endif /* DATABASE_H */
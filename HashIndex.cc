@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "HashIndex.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+//                          HashBucket Implementation                         //
+////////////////////////////////////////////////////////////////////////////////
+
+template <class Key>
+void HashBucketT<Key>::initialize(int localDepth)
+{
+	this->header()->keyCount = 0;
+	this->header()->link = -1;
+	this->header()->prev = localDepth;
+}
+
+template <class Key>
+RC HashBucketT<Key>::insert(const Key& key, const RecordId& rid)
+{
+	return this->insertAt(this->upperBound(key), key, rid);
+}
+
+template <class Key>
+void HashBucketT<Key>::locate(const Key& searchKey, int& eid) const
+{
+	eid = this->lowerBound(searchKey);
+}
+
+template <class Key>
+RC HashBucketT<Key>::readEntry(int eid, Key& key, RecordId& rid) const
+{
+	if (eid < 0 || eid >= this->getKeyCount()) return RC_INVALID_CURSOR;
+
+	key = this->entries()[eid].key;
+	rid = this->entries()[eid].value;
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                          HashIndex Implementation                          //
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * HashIndex constructor
+ */
+template <class Key>
+HashIndexT<Key>::HashIndexT()
+{
+	mode = 'r';
+	globalDepth = 0;
+	dirty = false;
+}
+
+/*
+ * Open the index file in read or write mode.
+ * Under 'w' mode, the index file should be created if it does not exist.
+ * @param indexname[IN] the name of the index file
+ * @param mode[IN] 'r' for read, 'w' for write
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC HashIndexT<Key>::open(const string& indexname, char mode)
+{
+	RC rc;
+	if ((rc = pf.open(indexname, mode)) < 0)
+		return rc;
+	this->mode = (mode == 'W') ? 'w' : mode;
+	directory.clear();
+	dirPages.clear();
+	dirty = false;
+
+	char buffer[PageFile::PAGE_SIZE];
+	int* intBufPtr = (int*) buffer;
+	if (pf.endPid() == 0) {
+		// a new index is a single empty bucket at page 1
+		Bucket bucket;
+		bucket.initialize(0);
+		globalDepth = 0;
+		directory.push_back(1);
+		if ((rc = bucket.write(1, pf)) == 0)
+			rc = writeDirectory();
+	} else if ((rc = pf.read(0, buffer)) == 0) {
+		// page 0: globalDepth, the # directory pages, then their PageIds
+		globalDepth = intBufPtr[0];
+		int count = intBufPtr[1];
+		if (globalDepth < 0 || globalDepth > MAX_GLOBAL_DEPTH || count < 0 || count > MAX_DIR_PAGES)
+			rc = RC_INVALID_FILE_FORMAT;
+		else
+			dirPages.assign(intBufPtr + 2, intBufPtr + 2 + count);
+		directory.resize(1 << globalDepth);
+		for (int i = 0; rc == 0 && i < count; i++) {
+			if ((rc = pf.read(dirPages[i], buffer)) < 0)
+				break;
+			int first = i * DIR_ENTRIES_PER_PAGE;
+			int n = min(DIR_ENTRIES_PER_PAGE, (int) directory.size() - first);
+			memcpy(&directory[first], buffer, n * sizeof(PageId));
+		}
+	}
+	if (rc < 0)
+		pf.close();
+	return rc;
+}
+
+/*
+ * Close the index file.
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC HashIndexT<Key>::close()
+{
+	RC rc = 0;
+	if (mode == 'w' && dirty)
+		rc = writeDirectory();
+	RC closeRC = pf.close();
+	return (rc < 0) ? rc : closeRC;
+}
+
+template <class Key>
+RC HashIndexT<Key>::writeDirectory()
+{
+	RC rc;
+	char buffer[PageFile::PAGE_SIZE];
+	int* intBufPtr = (int*) buffer;
+
+	// a grown directory gets its new pages at the end of the file
+	int count = (directory.size() + DIR_ENTRIES_PER_PAGE - 1) / DIR_ENTRIES_PER_PAGE;
+	PageId next = pf.endPid();
+	while ((int) dirPages.size() < count)
+		dirPages.push_back(next++);
+	for (int i = 0; i < count; i++) {
+		int first = i * DIR_ENTRIES_PER_PAGE;
+		int n = min(DIR_ENTRIES_PER_PAGE, (int) directory.size() - first);
+		memset(buffer, 0, PageFile::PAGE_SIZE);
+		memcpy(buffer, &directory[first], n * sizeof(PageId));
+		if ((rc = pf.write(dirPages[i], buffer)) < 0)
+			return rc;
+	}
+
+	memset(buffer, 0, PageFile::PAGE_SIZE);
+	intBufPtr[0] = globalDepth;
+	intBufPtr[1] = count;
+	for (int i = 0; i < count; i++)
+		intBufPtr[2 + i] = dirPages[i];
+	if ((rc = pf.write(0, buffer)) < 0)
+		return rc;
+	dirty = false;
+	return 0;
+}
+
+/*
+ * Insert (key, RecordId) pair to the index.
+ * @param key[IN] the key for the value inserted into the index
+ * @param rid[IN] the RecordId for the record being inserted into the index
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC HashIndexT<Key>::insert(const Key& key, const RecordId& rid)
+{
+	RC rc;
+	unsigned long long h = hashKey(key);
+	for (;;) {
+		PageId pid = directory[h & ((1ULL << globalDepth) - 1)];
+		Bucket bucket;
+		if ((rc = bucket.read(pid, pf)) < 0)
+			return rc;
+		if (bucket.insert(key, rid) == 0)
+			return bucket.write(pid, pf);
+
+		// a split cannot separate keys of the same hash, and the directory
+		// cannot grow past MAX_GLOBAL_DEPTH. the bucket grows a chain of
+		// overflow pages then.
+		bool sameHash = true;
+		for (int i = 0; sameHash && i < bucket.getKeyCount(); i++) {
+			Key      k;
+			RecordId r;
+			bucket.readEntry(i, k, r);
+			sameHash = (hashKey(k) == h);
+		}
+		if (!sameHash && bucket.getLocalDepth() < MAX_GLOBAL_DEPTH) {
+			if ((rc = split(pid)) < 0)
+				return rc;
+			continue;
+		}
+
+		for (;;) {
+			PageId next = bucket.getOverflowPtr();
+			if (next == -1) {
+				Bucket overflow;
+				overflow.initialize(bucket.getLocalDepth());
+				overflow.insert(key, rid);
+				next = pf.endPid();
+				if ((rc = overflow.write(next, pf)) < 0)
+					return rc;
+				bucket.setOverflowPtr(next);
+				return bucket.write(pid, pf);
+			}
+			pid = next;
+			if ((rc = bucket.read(pid, pf)) < 0)
+				return rc;
+			if (bucket.insert(key, rid) == 0)
+				return bucket.write(pid, pf);
+		}
+	}
+}
+
+template <class Key>
+RC HashIndexT<Key>::readChain(PageId pid, vector<Entry>& entries, vector<PageId>& pages,
+	int& localDepth)
+{
+	RC rc;
+	Bucket bucket;
+	entries.clear();
+	pages.clear();
+	while (pid != -1) {
+		if ((rc = bucket.read(pid, pf)) < 0)
+			return rc;
+		if (pages.empty())
+			localDepth = bucket.getLocalDepth();
+		pages.push_back(pid);
+		for (int i = 0; i < bucket.getKeyCount(); i++) {
+			Entry e;
+			bucket.readEntry(i, e.key, e.value);
+			entries.push_back(e);
+		}
+		pid = bucket.getOverflowPtr();
+	}
+	return 0;
+}
+
+template <class Key>
+RC HashIndexT<Key>::writeChain(vector<PageId>& pages, const vector<Entry>& entries, int localDepth)
+{
+	RC rc;
+	int count = max(1, (int) ((entries.size() + Bucket::MAX_KEY_COUNT - 1) / Bucket::MAX_KEY_COUNT));
+
+	// new pages go past the end of the file and past the pages given,
+	// which may not be written yet
+	PageId next = pf.endPid();
+	for (int i = 0; i < (int) pages.size(); i++)
+		next = max(next, pages[i] + 1);
+	while ((int) pages.size() < count)
+		pages.push_back(next++);
+
+	int e = 0;
+	for (int i = 0; i < (int) pages.size(); i++) {
+		Bucket bucket;
+		bucket.initialize(localDepth);
+		for (; e < (int) entries.size() && bucket.getKeyCount() < Bucket::MAX_KEY_COUNT; e++)
+			bucket.insert(entries[e].key, entries[e].value);
+		if (i + 1 < (int) pages.size())
+			bucket.setOverflowPtr(pages[i + 1]);
+		if ((rc = bucket.write(pages[i], pf)) < 0)
+			return rc;
+	}
+	return 0;
+}
+
+template <class Key>
+RC HashIndexT<Key>::split(PageId pid)
+{
+	RC rc;
+	vector<Entry>  entries;
+	vector<PageId> pages;
+	int localDepth;
+	if ((rc = readChain(pid, entries, pages, localDepth)) < 0)
+		return rc;
+
+	// a bucket that every directory entry of its hash bits points to
+	// needs a directory twice as large first
+	if (localDepth == globalDepth) {
+		directory.insert(directory.end(), directory.begin(), directory.end());
+		globalDepth++;
+	}
+
+	// the entries whose next hash bit is 1 move to a new bucket
+	vector<Entry> stay, move;
+	for (int i = 0; i < (int) entries.size(); i++) {
+		if ((hashKey(entries[i].key) >> localDepth) & 1)
+			move.push_back(entries[i]);
+		else
+			stay.push_back(entries[i]);
+	}
+	vector<PageId> newPages(1, pf.endPid());
+	if ((rc = writeChain(newPages, move, localDepth + 1)) < 0 ||
+	    (rc = writeChain(pages, stay, localDepth + 1)) < 0)
+		return rc;
+
+	for (int i = 0; i < (int) directory.size(); i++) {
+		if (directory[i] == pid && ((i >> localDepth) & 1))
+			directory[i] = newPages[0];
+	}
+	dirty = true;
+	return 0;
+}
+
+/*
+ * Find every entry with key.
+ * @param key[IN] the key to find
+ * @param rids[OUT] the RecordIds of the entries with key
+ * @return error code. 0 if no error. RC_NO_SUCH_RECORD if key is not in the index
+ */
+template <class Key>
+RC HashIndexT<Key>::lookup(const Key& key, vector<RecordId>& rids)
+{
+	RC rc;
+	Bucket bucket;
+	rids.clear();
+	PageId pid = directory[hashKey(key) & ((1ULL << globalDepth) - 1)];
+	while (pid != -1) {
+		if ((rc = bucket.read(pid, pf)) < 0)
+			return rc;
+		int eid;
+		Key k;
+		RecordId rid;
+		bucket.locate(key, eid);
+		for (; bucket.readEntry(eid, k, rid) == 0 && !(key < k); eid++)
+			rids.push_back(rid);
+		pid = bucket.getOverflowPtr();
+	}
+	return rids.empty() ? RC_NO_SUCH_RECORD : 0;
+}
+
+//
+// explicit instantiations for the supported key types
+//
+template class HashBucketT<Int32Key>;
+template class HashBucketT<Int64Key>;
+template class HashBucketT<StringKey>;
+
+template class HashIndexT<Int32Key>;
+template class HashIndexT<Int64Key>;
+template class HashIndexT<StringKey>;
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include "BTreeNode.h"
+
+/**
+ * HashBucketT: a bucket page of a HashIndexT. It has the page layout of a
+ * B+tree node with RecordId values, sorted by key; link is the next
+ * overflow page of the bucket and prev is the local depth of the bucket.
+ */
+template <class Key>
+class HashBucketT : public BTreeNode<Key, RecordId> {
+ public:
+  /**
+   * Empty the bucket.
+   * @param localDepth[IN] the # hash bits that all keys in the bucket share
+   */
+  void initialize(int localDepth);
+
+  /**
+   * Insert the (key, rid) pair to the bucket.
+   * @param key[IN] the key to insert
+   * @param rid[IN] the RecordId to insert
+   * @return 0 if successful. Return an error code if the bucket is full.
+   */
+  RC insert(const Key& key, const RecordId& rid);
+
+  /**
+   * Output the eid (entry number) of the first entry whose key is larger
+   * than or equal to searchKey, or getKeyCount() if there is none.
+   * @param searchKey[IN] the key to search for
+   * @param eid[OUT] the entry number
+   */
+  void locate(const Key& searchKey, int& eid) const;
+
+  /**
+   * Read the (key, rid) pair from the eid entry.
+   * @param eid[IN] the entry number to read the (key, rid) pair from
+   * @param key[OUT] the key from the entry
+   * @param rid[OUT] the RecordId from the entry
+   * @return 0 if successful. Return an error code if there is an error.
+   */
+  RC readEntry(int eid, Key& key, RecordId& rid) const;
+
+  /**
+   * @return the # hash bits that all keys in the bucket share
+   */
+  int getLocalDepth() const { return this->header()->prev; }
+
+  /**
+   * @return the PageId of the next overflow page, or -1 if there is none
+   */
+  PageId getOverflowPtr() const { return this->header()->link; }
+
+  /**
+   * Set the pid of the next overflow page.
+   * @param pid[IN] the PageId of the next overflow page
+   */
+  void setOverflowPtr(PageId pid) { this->header()->link = pid; }
+};
+
+/**
+ * An extendible hash index for equality lookups on the key column.
+ *
+ * A directory of 2^globalDepth bucket pointers is indexed by the low
+ * bits of hashKey(key). A full bucket splits in two on one more hash
+ * bit, doubling the directory when its local depth reaches the global
+ * depth, so a lookup always costs one bucket page (plus the overflow
+ * pages of a bucket that holds more duplicates of one key than fit in a
+ * page).
+ *
+ * Page 0 holds the global depth and the PageIds of the directory pages.
+ * The directory is loaded at open() and written back at close().
+ */
+template <class Key>
+class HashIndexT {
+ public:
+  typedef HashBucketT<Key>       Bucket;
+  typedef typename Bucket::Entry Entry;
+
+  HashIndexT();
+
+  /**
+   * Open the index file in read or write mode.
+   * Under 'w' mode, the index file should be created if it does not exist.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& indexname, char mode);
+
+  /**
+   * Close the index file.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * Insert (key, RecordId) pair to the index.
+   * @param key[IN] the key for the value inserted into the index
+   * @param rid[IN] the RecordId for the record being inserted into the index
+   * @return error code. 0 if no error
+   */
+  RC insert(const Key& key, const RecordId& rid);
+
+  /**
+   * Find every entry with key.
+   * @param key[IN] the key to find
+   * @param rids[OUT] the RecordIds of the entries with key
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if key is not in the index
+   */
+  RC lookup(const Key& key, std::vector<RecordId>& rids);
+
+ private:
+  // the # directory entries a directory page holds
+  static constexpr int DIR_ENTRIES_PER_PAGE = PageFile::PAGE_SIZE / sizeof(PageId);
+
+  // the # directory pages that page 0 has room for
+  static constexpr int MAX_DIR_PAGES = PageFile::PAGE_SIZE / sizeof(int) - 2;
+
+  // the largest global depth whose directory fits in MAX_DIR_PAGES pages
+  static constexpr int MAX_GLOBAL_DEPTH = 15;
+  static_assert((1 << MAX_GLOBAL_DEPTH) <= MAX_DIR_PAGES * DIR_ENTRIES_PER_PAGE,
+                "directory must fit in page 0");
+
+  // read the whole chain of the bucket at pid
+  RC readChain(PageId pid, std::vector<Entry>& entries, std::vector<PageId>& pages,
+               int& localDepth);
+
+  /**
+   * Write entries to the chain of pages, which starts with the primary
+   * page of a bucket. Pages are added to the chain as needed, and pages
+   * it does not need stay in it empty for later inserts.
+   */
+  RC writeChain(std::vector<PageId>& pages, const std::vector<Entry>& entries, int localDepth);
+
+  // split the bucket at pid on one more hash bit
+  RC split(PageId pid);
+
+  // write the directory and page 0
+  RC writeDirectory();
+
+  PageFile            pf;           /// the PageFile that stores the index
+  char                mode;         /// 'r' or 'w'
+  int                 globalDepth;  /// the # hash bits the directory uses
+  std::vector<PageId> directory;    /// 2^globalDepth bucket PageIds
+  std::vector<PageId> dirPages;     /// the pages that store directory
+  bool                dirty;        /// true: directory changed since open()
+};
+
+typedef HashBucketT<Int32Key> HashBucket;
+typedef HashIndexT<Int32Key>  HashIndex;
+
+#endif /* HASHINDEX_H */
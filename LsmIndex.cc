@@ -0,0 +1,735 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include "LsmIndex.h"
+
+using namespace std;
+
+// the i'th Bloom filter bit of a key hash, by double hashing
+static unsigned long long bloomBit(unsigned long long h, int i, unsigned long long bits)
+{
+	unsigned long long h1 = h & 0xffffffffULL;
+	unsigned long long h2 = (h >> 32) | 1;
+	return (h1 + i * h2) % bits;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                            Run Implementation                              //
+////////////////////////////////////////////////////////////////////////////////
+
+template <class Key>
+LsmIndexT<Key>::Run::~Run()
+{
+	pf.close();
+	if (obsolete)
+		unlink(filename.c_str());
+}
+
+template <class Key>
+PageId LsmIndexT<Key>::Run::seek(const Key& key) const
+{
+	if (dataPages == 0)
+		return -1;
+
+	// the first page whose first key is >= key may have entries with key
+	// on the page before it, so start there. data page i is page i + 1.
+	int i = lower_bound(fences.begin(), fences.end(), key) - fences.begin();
+	return max(i, 1);
+}
+
+template <class Key>
+bool LsmIndexT<Key>::Run::mayContain(const Key& key) const
+{
+	unsigned long long bits = (unsigned long long) bloom.size() * 8;
+	if (bits == 0)
+		return entryCount > 0;
+
+	unsigned long long h = hashKey(key);
+	for (int i = 0; i < BLOOM_HASH_COUNT; i++) {
+		unsigned long long b = bloomBit(h, i, bits);
+		if ((bloom[b >> 3] & (1 << (b & 7))) == 0)
+			return false;
+	}
+	return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                          LsmIndex Implementation                           //
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * LsmIndex constructor
+ */
+template <class Key>
+LsmIndexT<Key>::LsmIndexT()
+{
+	mode = 'r';
+	memtableSize = DEFAULT_MEMTABLE_SIZE;
+	nextRunId = 0;
+	version = 0;
+	running = false;
+	stopping = false;
+	compactRC = 0;
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&work, NULL);
+	pthread_cond_init(&compacted, NULL);
+}
+
+template <class Key>
+LsmIndexT<Key>::~LsmIndexT()
+{
+	if (running)
+		close();
+	pthread_mutex_destroy(&lock);
+	pthread_cond_destroy(&work);
+	pthread_cond_destroy(&compacted);
+}
+
+template <class Key>
+void LsmIndexT<Key>::setMemtableSize(int entries)
+{
+	memtableSize = max(1, entries);
+}
+
+template <class Key>
+string LsmIndexT<Key>::runName(int id) const
+{
+	char suffix[16];
+	sprintf(suffix, ".%d", id);
+	return name + suffix;
+}
+
+/*
+ * Open the index in read or write mode.
+ * Under 'w' mode, the index is created if it does not exist and the
+ * compaction thread is started.
+ * @param indexname[IN] the name of the index file
+ * @param mode[IN] 'r' for read, 'w' for write
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC LsmIndexT<Key>::open(const string& indexname, char mode)
+{
+	RC rc;
+	if ((rc = pf.open(indexname, mode)) < 0)
+		return rc;
+	name = indexname;
+	this->mode = (mode == 'W') ? 'w' : mode;
+	runs.clear();
+	memtable.clear();
+	compactRC = 0;
+
+	char buffer[PageFile::PAGE_SIZE];
+	int* intBufPtr = (int*) buffer;
+	if (pf.endPid() == 0) {
+		nextRunId = 0;
+		rc = writeManifest();
+	} else if ((rc = pf.read(0, buffer)) == 0) {
+		// page 0: nextRunId, the # runs, then (id, level) of every run
+		nextRunId = intBufPtr[0];
+		int count = intBufPtr[1];
+		if (count < 0 || count > MAX_RUNS)
+			rc = RC_INVALID_FILE_FORMAT;
+		for (int i = 0; rc == 0 && i < count; i++) {
+			RunPtr run;
+			if ((rc = openRun(intBufPtr[2 + 2 * i], intBufPtr[3 + 2 * i], run)) == 0)
+				runs.push_back(run);
+		}
+	}
+	if (rc < 0) {
+		runs.clear();
+		pf.close();
+		return rc;
+	}
+
+	if (this->mode == 'w') {
+		stopping = false;
+		if (pthread_create(&thread, NULL, compactor, this) != 0) {
+			runs.clear();
+			pf.close();
+			return RC_FILE_OPEN_FAILED;
+		}
+		running = true;
+	}
+	return 0;
+}
+
+/*
+ * Write out the memtable, stop the compaction thread and close the index.
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC LsmIndexT<Key>::close()
+{
+	RC rc = 0;
+	if (running) {
+		pthread_mutex_lock(&lock);
+		rc = flushLocked();
+		stopping = true;
+		pthread_cond_signal(&work);
+		pthread_mutex_unlock(&lock);
+		pthread_join(thread, NULL);
+		running = false;
+		if (rc == 0)
+			rc = compactRC;
+	}
+
+	// cursors may still hold on to runs, which then close with them
+	runs.clear();
+	memtable.clear();
+	RC closeRC = pf.close();
+	return (rc < 0) ? rc : closeRC;
+}
+
+/*
+ * Insert (key, RecordId) pair to the index.
+ * @param key[IN] the key for the value inserted into the index
+ * @param rid[IN] the RecordId for the record being inserted into the index
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC LsmIndexT<Key>::insert(const Key& key, const RecordId& rid)
+{
+	RC rc = 0;
+	if (mode != 'w')
+		return RC_INVALID_FILE_MODE;
+
+	Entry entry = { key, rid };
+	pthread_mutex_lock(&lock);
+	memtable.insert(entry);
+	if ((int) memtable.size() >= memtableSize) {
+		// let compaction catch up before level 0 grows any further
+		for (;;) {
+			int level0 = 0;
+			for (int i = 0; i < (int) runs.size(); i++)
+				level0 += (runs[i]->level == 0);
+			if (compactRC < 0 || (level0 < MAX_LEVEL0_RUNS && (int) runs.size() < MAX_RUNS))
+				break;
+			pthread_cond_wait(&compacted, &lock);
+		}
+		if ((int) memtable.size() >= memtableSize)
+			rc = flushLocked();
+	}
+	pthread_mutex_unlock(&lock);
+	return rc;
+}
+
+/*
+ * Write the memtable out as a run now.
+ * @return error code. 0 if no error
+ */
+template <class Key>
+RC LsmIndexT<Key>::flush()
+{
+	if (mode != 'w')
+		return RC_INVALID_FILE_MODE;
+	pthread_mutex_lock(&lock);
+	RC rc = flushLocked();
+	pthread_mutex_unlock(&lock);
+	return rc;
+}
+
+// produces the entries of a memtable for writeRun()
+template <class Entry>
+struct MemtableSource {
+	typename set<Entry>::const_iterator it;
+
+	template <class Key>
+	RC operator() (Key& key, RecordId& rid)
+	{
+		key = it->key;
+		rid = it->rid;
+		++it;
+		return 0;
+	}
+};
+
+template <class Key>
+RC LsmIndexT<Key>::flushLocked()
+{
+	RC rc;
+	if (memtable.empty())
+		return 0;
+
+	RunPtr run;
+	MemtableSource<Entry> source = { memtable.begin() };
+	if ((rc = writeRun(nextRunId++, 0, memtable.size(), source, run)) < 0)
+		return rc;
+	runs.push_back(run);
+	if ((rc = writeManifest()) < 0) {
+		runs.pop_back();
+		run->obsolete = true;
+		return rc;
+	}
+	memtable.clear();
+	version++;
+	pthread_cond_signal(&work);
+	return 0;
+}
+
+template <class Key>
+RC LsmIndexT<Key>::writeManifest()
+{
+	char buffer[PageFile::PAGE_SIZE];
+	int* intBufPtr = (int*) buffer;
+	if ((int) runs.size() > MAX_RUNS)
+		return RC_NODE_FULL;
+
+	memset(buffer, 0, PageFile::PAGE_SIZE);
+	intBufPtr[0] = nextRunId;
+	intBufPtr[1] = runs.size();
+	for (int i = 0; i < (int) runs.size(); i++) {
+		intBufPtr[2 + 2 * i] = runs[i]->id;
+		intBufPtr[3 + 2 * i] = runs[i]->level;
+	}
+	return pf.write(0, buffer);
+}
+
+template <class Key>
+template <class Source>
+RC LsmIndexT<Key>::writeRun(int id, int level, int n, Source& next, RunPtr& run)
+{
+	RC rc;
+	run = RunPtr(new Run);
+	run->filename = runName(id);
+	run->id = id;
+	run->level = level;
+	run->entryCount = n;
+
+	// the size of every section follows from n, so the run is written
+	// in page order from front to back
+	const int keysPerPage = PageFile::PAGE_SIZE / sizeof(Key);
+	run->dataPages = (n + RunPage::MAX_KEY_COUNT - 1) / RunPage::MAX_KEY_COUNT;
+	int fencePages = (run->dataPages + keysPerPage - 1) / keysPerPage;
+	int bloomBytes = ((long long) n * BLOOM_BITS_PER_KEY + 7) / 8;
+	int bloomPages = (bloomBytes + PageFile::PAGE_SIZE - 1) / PageFile::PAGE_SIZE;
+	run->bloom.assign((size_t) bloomPages * PageFile::PAGE_SIZE, 0);
+	run->fences.reserve(run->dataPages);
+
+	// a file left behind by a crash before its run was recorded in the
+	// manifest is overwritten
+	unlink(run->filename.c_str());
+	if ((rc = run->pf.open(run->filename, 'w')) < 0)
+		return rc;
+	run->obsolete = true;
+
+	char buffer[PageFile::PAGE_SIZE];
+	int* intBufPtr = (int*) buffer;
+	memset(buffer, 0, PageFile::PAGE_SIZE);
+	intBufPtr[0] = n;
+	intBufPtr[1] = run->dataPages;
+	intBufPtr[2] = fencePages;
+	intBufPtr[3] = bloomPages;
+	if ((rc = run->pf.write(0, buffer)) < 0)
+		return rc;
+
+	// the data pages, each linked to its neighbors like the leaves of a
+	// B+tree
+	unsigned long long bits = (unsigned long long) run->bloom.size() * 8;
+	RunPage page;
+	PageId pid = 1;
+	for (int i = 0; i < n; i++) {
+		Key      key;
+		RecordId rid;
+		if ((rc = next(key, rid)) < 0)
+			return rc;
+		if (page.getKeyCount() == RunPage::MAX_KEY_COUNT) {
+			page.setNextNodePtr(pid + 1);
+			if ((rc = page.write(pid, run->pf)) < 0)
+				return rc;
+			page = RunPage();
+			page.setPrevNodePtr(pid++);
+		}
+		if (page.getKeyCount() == 0)
+			run->fences.push_back(key);
+		page.insert(key, rid);
+
+		unsigned long long h = hashKey(key);
+		for (int j = 0; j < BLOOM_HASH_COUNT; j++) {
+			unsigned long long b = bloomBit(h, j, bits);
+			run->bloom[b >> 3] |= (1 << (b & 7));
+		}
+	}
+	if (n > 0 && (rc = page.write(pid++, run->pf)) < 0)
+		return rc;
+
+	for (int i = 0; i < fencePages; i++) {
+		memset(buffer, 0, PageFile::PAGE_SIZE);
+		int count = min(keysPerPage, run->dataPages - i * keysPerPage);
+		memcpy(buffer, &run->fences[i * keysPerPage], count * sizeof(Key));
+		if ((rc = run->pf.write(pid++, buffer)) < 0)
+			return rc;
+	}
+	for (int i = 0; i < bloomPages; i++) {
+		if ((rc = run->pf.write(pid++, &run->bloom[i * PageFile::PAGE_SIZE])) < 0)
+			return rc;
+	}
+
+	run->obsolete = false;
+	return 0;
+}
+
+template <class Key>
+RC LsmIndexT<Key>::openRun(int id, int level, RunPtr& run)
+{
+	RC rc;
+	run = RunPtr(new Run);
+	run->filename = runName(id);
+	run->id = id;
+	run->level = level;
+	if ((rc = run->pf.open(run->filename, 'r')) < 0)
+		return rc;
+
+	char buffer[PageFile::PAGE_SIZE];
+	int* intBufPtr = (int*) buffer;
+	if ((rc = run->pf.read(0, buffer)) < 0)
+		return rc;
+	const int keysPerPage = PageFile::PAGE_SIZE / sizeof(Key);
+	run->entryCount = intBufPtr[0];
+	run->dataPages = intBufPtr[1];
+	int fencePages = intBufPtr[2];
+	int bloomPages = intBufPtr[3];
+	if (run->dataPages < 0 || fencePages < 0 || bloomPages < 0 ||
+	    fencePages != (run->dataPages + keysPerPage - 1) / keysPerPage ||
+	    1 + run->dataPages + fencePages + bloomPages > run->pf.endPid())
+		return RC_INVALID_FILE_FORMAT;
+
+	// the fences and the Bloom filter stay in memory
+	PageId pid = 1 + run->dataPages;
+	run->fences.resize(run->dataPages);
+	for (int i = 0; i < fencePages; i++) {
+		if ((rc = run->pf.read(pid++, buffer)) < 0)
+			return rc;
+		int count = min(keysPerPage, run->dataPages - i * keysPerPage);
+		memcpy(&run->fences[i * keysPerPage], buffer, count * sizeof(Key));
+	}
+	run->bloom.resize((size_t) bloomPages * PageFile::PAGE_SIZE);
+	for (int i = 0; i < bloomPages; i++) {
+		if ((rc = run->pf.read(pid++, &run->bloom[i * PageFile::PAGE_SIZE])) < 0)
+			return rc;
+	}
+	return 0;
+}
+
+/*
+ * Find an entry with key.
+ * @param key[IN] the key to find
+ * @param rid[OUT] the RecordId of the entry
+ * @return error code. 0 if no error. RC_NO_SUCH_RECORD if key is not in the index
+ */
+template <class Key>
+RC LsmIndexT<Key>::lookup(const Key& key, RecordId& rid)
+{
+	RC rc;
+	Entry from = { key, { INT_MIN, INT_MIN } };
+	pthread_mutex_lock(&lock);
+	typename set<Entry>::const_iterator it = memtable.lower_bound(from);
+	if (it != memtable.end() && !(key < it->key)) {
+		rid = it->rid;
+		pthread_mutex_unlock(&lock);
+		return 0;
+	}
+	vector<RunPtr> snapshot(runs);
+	pthread_mutex_unlock(&lock);
+
+	// newer runs first
+	for (int i = (int) snapshot.size() - 1; i >= 0; i--) {
+		Run& run = *snapshot[i];
+		if (!run.mayContain(key))
+			continue;
+
+		RunPage page;
+		PageId  pid = run.seek(key);
+		int     eid;
+		Key     found;
+		if ((rc = page.read(pid, run.pf)) < 0)
+			return rc;
+		if (page.locate(key, eid) < 0) {
+			// every key on the page is smaller: the first entry of the
+			// next page is the candidate
+			if (pid == run.dataPages)
+				continue;
+			if ((rc = page.read(++pid, run.pf)) < 0)
+				return rc;
+			eid = 0;
+		}
+		page.readEntry(eid, found, rid);
+		if (!(key < found))
+			return 0;
+	}
+	return RC_NO_SUCH_RECORD;
+}
+
+template <class Key>
+RC LsmIndexT<Key>::seekRuns(LsmCursorT<Key>& cursor, const vector<RunPtr>& snapshot,
+	const Entry* from, bool inclusive)
+{
+	RC rc;
+	cursor.sources.clear();
+	cursor.sources.resize(snapshot.size());
+	for (int i = 0; i < (int) snapshot.size(); i++) {
+		typename LsmCursorT<Key>::Source& s = cursor.sources[i];
+		s.run = snapshot[i];
+		s.pid = from ? s.run->seek(from->key) : (s.run->dataPages > 0 ? 1 : -1);
+		s.eid = 0;
+		if (s.pid == -1)
+			continue;
+		if ((rc = s.page.read(s.pid, s.run->pf)) < 0)
+			return rc;
+		if (from && s.page.locate(from->key, s.eid) < 0)
+			s.eid = s.page.getKeyCount();
+		if ((rc = cursor.settle(s)) < 0)
+			return rc;
+
+		// skip the entries with from->key up to from itself
+		while (from && s.pid != -1 && (inclusive ? s.head < *from : !(*from < s.head))) {
+			s.eid++;
+			if ((rc = cursor.settle(s)) < 0)
+				return rc;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Position cursor at the first entry whose key is larger than or equal
+ * to searchKey.
+ * @param searchKey[IN] the key to find
+ * @param cursor[OUT] the cursor pointing to the first index entry
+ * with a key value >= searchKey
+ * @return error code. 0 if no error. RC_NO_SUCH_RECORD if there is no such entry
+ */
+template <class Key>
+RC LsmIndexT<Key>::locate(const Key& searchKey, LsmCursorT<Key>& cursor)
+{
+	RC rc;
+	Entry from = { searchKey, { INT_MIN, INT_MIN } };
+	cursor.index = this;
+	cursor.sources.clear();
+	cursor.from = from;
+	cursor.fromInclusive = true;
+	cursor.version = -1;
+	if ((rc = cursor.refill()) < 0)
+		return rc;
+
+	if (cursor.memPos < (int) cursor.mem.size())
+		return 0;
+	for (int i = 0; i < (int) cursor.sources.size(); i++) {
+		if (cursor.sources[i].pid != -1)
+			return 0;
+	}
+	return RC_NO_SUCH_RECORD;
+}
+
+/*
+ * Read the (key, rid) pair at the cursor and move the cursor forward.
+ * @param cursor[IN/OUT] the cursor from locate()
+ * @param key[OUT] the key stored at the index cursor location
+ * @param rid[OUT] the RecordId stored at the index cursor location
+ * @return error code. 0 if no error. RC_END_OF_TREE past the last entry
+ */
+template <class Key>
+RC LsmIndexT<Key>::readForward(LsmCursorT<Key>& cursor, Key& key, RecordId& rid)
+{
+	RC rc;
+	if (cursor.memPos == (int) cursor.mem.size() && !cursor.memEnd &&
+	    (rc = cursor.refill()) < 0)
+		return rc;
+
+	// the smallest head among the memtable and the runs
+	const Entry* best = NULL;
+	int from = -1;
+	if (cursor.memPos < (int) cursor.mem.size())
+		best = &cursor.mem[cursor.memPos];
+	for (int i = 0; i < (int) cursor.sources.size(); i++) {
+		const typename LsmCursorT<Key>::Source& s = cursor.sources[i];
+		if (s.pid != -1 && (best == NULL || s.head < *best)) {
+			best = &s.head;
+			from = i;
+		}
+	}
+	if (best == NULL)
+		return RC_END_OF_TREE;
+
+	key = best->key;
+	rid = best->rid;
+	cursor.from = *best;
+	cursor.fromInclusive = false;
+	if (from == -1) {
+		cursor.memPos++;
+		return 0;
+	}
+	cursor.sources[from].eid++;
+	return cursor.settle(cursor.sources[from]);
+}
+
+template <class Key>
+int LsmIndexT<Key>::pickLevel() const
+{
+	vector<int> count;
+	for (int i = 0; i < (int) runs.size(); i++) {
+		if (runs[i]->level >= (int) count.size())
+			count.resize(runs[i]->level + 1, 0);
+		count[runs[i]->level]++;
+	}
+	for (int level = 0; level < (int) count.size(); level++) {
+		if (count[level] >= TIER_FANOUT)
+			return level;
+	}
+	return -1;
+}
+
+// produces the merged entries of a cursor for writeRun()
+template <class Key>
+struct MergeSource {
+	LsmIndexT<Key>*  index;
+	LsmCursorT<Key>* cursor;
+
+	RC operator() (Key& key, RecordId& rid) { return index->readForward(*cursor, key, rid); }
+};
+
+template <class Key>
+RC LsmIndexT<Key>::compact(int level)
+{
+	RC rc;
+	vector<RunPtr> inputs;
+	int n = 0;
+	for (int i = 0; i < (int) runs.size() && (int) inputs.size() < TIER_FANOUT; i++) {
+		if (runs[i]->level == level) {
+			inputs.push_back(runs[i]);
+			n += runs[i]->entryCount;
+		}
+	}
+	int id = nextRunId++;
+
+	// the inputs never change, so they are merged without the lock and
+	// inserts, flushes and lookups go on meanwhile
+	pthread_mutex_unlock(&lock);
+	RunPtr          output;
+	LsmCursorT<Key> cursor;
+	MergeSource<Key> source = { this, &cursor };
+	if ((rc = seekRuns(cursor, inputs, NULL, false)) == 0)
+		rc = writeRun(id, level + 1, n, source, output);
+	pthread_mutex_lock(&lock);
+	if (rc < 0)
+		return rc;
+
+	// the output takes the place of the oldest input
+	vector<RunPtr> live;
+	for (int i = 0; i < (int) runs.size(); i++) {
+		if (find(inputs.begin(), inputs.end(), runs[i]) == inputs.end())
+			live.push_back(runs[i]);
+		else if (runs[i] == inputs[0])
+			live.push_back(output);
+	}
+	runs.swap(live);
+	if ((rc = writeManifest()) < 0) {
+		runs.swap(live);
+		output->obsolete = true;
+		return rc;
+	}
+
+	// the files go once the last cursor using them is done
+	for (int i = 0; i < (int) inputs.size(); i++)
+		inputs[i]->obsolete = true;
+	return 0;
+}
+
+template <class Key>
+void* LsmIndexT<Key>::compactor(void* arg)
+{
+	LsmIndexT<Key>* index = (LsmIndexT<Key>*) arg;
+	pthread_mutex_lock(&index->lock);
+	while (!index->stopping) {
+		int level = index->pickLevel();
+		if (level < 0 || index->compactRC < 0) {
+			pthread_cond_wait(&index->work, &index->lock);
+			continue;
+		}
+		index->compactRC = index->compact(level);
+		pthread_cond_broadcast(&index->compacted);
+	}
+	pthread_mutex_unlock(&index->lock);
+	return NULL;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                          LsmCursor Implementation                          //
+////////////////////////////////////////////////////////////////////////////////
+
+template <class Key>
+LsmCursorT<Key>::LsmCursorT()
+{
+	index = NULL;
+	memPos = 0;
+	memEnd = true;
+	fromInclusive = true;
+	version = -1;
+}
+
+template <class Key>
+RC LsmCursorT<Key>::settle(Source& s)
+{
+	RC rc;
+	while (s.pid != -1 && s.eid >= s.page.getKeyCount()) {
+		s.pid = s.page.getNextNodePtr();
+		s.eid = 0;
+		if (s.pid != -1 && (rc = s.page.read(s.pid, s.run->pf)) < 0)
+			return rc;
+	}
+	if (s.pid != -1)
+		s.page.readEntry(s.eid, s.head.key, s.head.rid);
+	return 0;
+}
+
+template <class Key>
+RC LsmCursorT<Key>::refill()
+{
+	mem.clear();
+	memPos = 0;
+	memEnd = true;
+	if (index == NULL)
+		return 0;
+
+	// every entry is either in the memtable or in a run, so the entries
+	// past from that were written out meanwhile are found in the runs
+	pthread_mutex_lock(&index->lock);
+	bool resync = (version != index->version);
+	std::vector<RunPtr> snapshot;
+	if (resync) {
+		snapshot = index->runs;
+		version = index->version;
+	}
+	typename std::set<Entry>::const_iterator it = fromInclusive ?
+		index->memtable.lower_bound(from) : index->memtable.upper_bound(from);
+	for (; it != index->memtable.end() && (int) mem.size() < MEMTABLE_BATCH; ++it)
+		mem.push_back(*it);
+	memEnd = (it == index->memtable.end());
+	pthread_mutex_unlock(&index->lock);
+
+	return resync ? index->seekRuns(*this, snapshot, &from, fromInclusive) : 0;
+}
+
+//
+// explicit instantiations for the supported key types
+//
+template class LsmIndexT<Int32Key>;
+template class LsmIndexT<Int64Key>;
+template class LsmIndexT<StringKey>;
+
+template class LsmCursorT<Int32Key>;
+template class LsmCursorT<Int64Key>;
+template class LsmCursorT<StringKey>;
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#ifndef LSMINDEX_H
+#define LSMINDEX_H
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include "BTreeNode.h"
+
+template <class Key> class LsmCursorT;
+
+/**
+ * A log-structured merge (LSM) index for bruinbase, an alternative to
+ * BTreeIndexT with the same open/insert/locate/readForward interface.
+ *
+ * Inserts go to an in-memory sorted memtable. A full memtable is written
+ * out as an immutable sorted run, a PageFile of its own that is written
+ * once from front to back, so the index never updates a page in place.
+ * Runs are merged by tiered compaction on a background thread: as soon
+ * as a level holds TIER_FANOUT runs, they are merged into one run of the
+ * next level. Every run keeps the first key of each of its pages (fence
+ * pointers) and a Bloom filter of its keys in memory, so lookup() reads
+ * at most one page of each run that may hold the key.
+ *
+ * The index file itself is the manifest: page 0 lists the runs and
+ * their levels. Run n is stored in the file "<indexname>.n".
+ *
+ * Any number of threads may use an open index at the same time, except
+ * for open(), close() and setMemtableSize().
+ */
+template <class Key>
+class LsmIndexT {
+ public:
+  // the data pages of a run are chained leaf nodes
+  typedef BTLeafNodeT<Key> RunPage;
+
+  /**
+   * An index entry. Entries are ordered by key and then by RecordId.
+   */
+  struct Entry {
+    Key      key;
+    RecordId rid;
+    bool operator< (const Entry& e) const { return key < e.key || (!(e.key < key) && rid < e.rid); }
+  };
+
+  // the default # entries the memtable holds before it is written out
+  static const int DEFAULT_MEMTABLE_SIZE = 64 * RunPage::MAX_KEY_COUNT;
+
+  // the # runs of a level that are merged into one run of the next level
+  static const int TIER_FANOUT = 4;
+
+  // inserts wait for compaction while level 0 holds this many runs
+  static const int MAX_LEVEL0_RUNS = 2 * TIER_FANOUT;
+
+  // the size of the Bloom filters and the # hash functions they use
+  static const int BLOOM_BITS_PER_KEY = 10;
+  static const int BLOOM_HASH_COUNT = 7;
+
+  LsmIndexT();
+  ~LsmIndexT();
+
+  /**
+   * Set the # entries the memtable holds before it is written out as a
+   * run. Call it before open().
+   * @param entries[IN] the memtable size
+   */
+  void setMemtableSize(int entries);
+
+  /**
+   * Open the index in read or write mode.
+   * Under 'w' mode, the index is created if it does not exist and the
+   * compaction thread is started.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& indexname, char mode);
+
+  /**
+   * Write out the memtable, stop the compaction thread and close the
+   * index.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * Insert (key, RecordId) pair to the index.
+   * @param key[IN] the key for the value inserted into the index
+   * @param rid[IN] the RecordId for the record being inserted into the index
+   * @return error code. 0 if no error
+   */
+  RC insert(const Key& key, const RecordId& rid);
+
+  /**
+   * Find an entry with key. The memtable is searched first, then every
+   * run whose Bloom filter admits the key, with one page read per run.
+   * @param key[IN] the key to find
+   * @param rid[OUT] the RecordId of the entry
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if key is not in the index
+   */
+  RC lookup(const Key& key, RecordId& rid);
+
+  /**
+   * Position cursor at the first entry whose key is larger than or equal
+   * to searchKey. The cursor merges the memtable and a snapshot of the
+   * runs; runs that a later compaction replaces stay readable until the
+   * cursor is done with them.
+   * @param searchKey[IN] the key to find
+   * @param cursor[OUT] the cursor pointing to the first index entry
+   * with a key value >= searchKey
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if there is no such entry
+   */
+  RC locate(const Key& searchKey, LsmCursorT<Key>& cursor);
+
+  /**
+   * Read the (key, rid) pair at the cursor and move the cursor forward.
+   * @param cursor[IN/OUT] the cursor from locate()
+   * @param key[OUT] the key stored at the index cursor location
+   * @param rid[OUT] the RecordId stored at the index cursor location
+   * @return error code. 0 if no error. RC_END_OF_TREE past the last entry
+   */
+  RC readForward(LsmCursorT<Key>& cursor, Key& key, RecordId& rid);
+
+  /**
+   * Write the memtable out as a run now.
+   * @return error code. 0 if no error
+   */
+  RC flush();
+
+ private:
+  friend class LsmCursorT<Key>;
+
+  /**
+   * An immutable sorted run. Page 0 holds the # entries and the # pages
+   * of each section, followed by the data pages, the fence pages (the
+   * first key of each data page) and the Bloom filter pages. A run that
+   * compaction has replaced deletes its file once nobody uses it.
+   */
+  struct Run {
+    PageFile          pf;
+    std::string       filename;
+    int               id;
+    int               level;
+    int               entryCount;
+    int               dataPages;
+    std::vector<Key>  fences;     // the first key of each data page
+    std::vector<char> bloom;      // the Bloom filter bits
+    bool              obsolete;   // true: delete the file when closed
+
+    Run() : id(-1), level(0), entryCount(0), dataPages(0), obsolete(false) { }
+    ~Run();
+
+    // the PageId of the data page that may hold the first entry >= key
+    PageId seek(const Key& key) const;
+
+    // false if key is certainly not in the run
+    bool mayContain(const Key& key) const;
+  };
+  typedef std::shared_ptr<Run> RunPtr;
+
+  // the file name of run id
+  std::string runName(int id) const;
+
+  // open the existing run id and load its fences and Bloom filter
+  RC openRun(int id, int level, RunPtr& run);
+
+  /**
+   * Write n entries, produced in order by next(key, rid), as the new
+   * run id of level. next() returns 0 for each entry.
+   */
+  template <class Source>
+  RC writeRun(int id, int level, int n, Source& next, RunPtr& run);
+
+  // write the memtable out as a run. the caller holds lock.
+  RC flushLocked();
+
+  // write the run list to page 0 of the index file. the caller holds lock.
+  RC writeManifest();
+
+  // the # runs that the manifest page has room for
+  static const int MAX_RUNS = (PageFile::PAGE_SIZE / sizeof(int) - 2) / 2;
+
+  // position cursor at the first entry past *from (or at *from, with
+  // inclusive) of every run in snapshot, or at their first entry if from
+  // is NULL
+  RC seekRuns(LsmCursorT<Key>& cursor, const std::vector<RunPtr>& snapshot,
+              const Entry* from, bool inclusive);
+
+  // the lowest level that holds TIER_FANOUT runs, or -1. the caller holds lock.
+  int pickLevel() const;
+
+  // merge the oldest TIER_FANOUT runs of level into one run
+  RC compact(int level);
+
+  // the body of the compaction thread
+  static void* compactor(void* arg);
+
+  PageFile                pf;          /// the manifest
+  std::string             name;        /// the name of the index file
+  char                    mode;        /// 'r' or 'w'
+  int                     memtableSize;
+  std::set<Entry>         memtable;    /// the inserts not written out yet
+  std::vector<RunPtr>     runs;        /// the live runs, oldest first
+  int                     nextRunId;   /// the id of the next run
+  int                     version;     /// bumped when the memtable is written out
+
+  pthread_mutex_t         lock;        /// guards everything above
+  pthread_cond_t          work;        /// signals the compaction thread
+  pthread_cond_t          compacted;   /// signals inserts waiting for level 0
+  pthread_t               thread;      /// the compaction thread
+  bool                    running;     /// true while the thread runs
+  bool                    stopping;    /// asks the thread to exit
+  RC                      compactRC;   /// the error of the last compaction
+};
+
+/**
+ * A cursor over an LsmIndexT. It merges a snapshot of the runs with the
+ * memtable, which it copies a few entries at a time as the scan reaches
+ * them. Should the memtable be written out in the meantime, the cursor
+ * takes the runs again from where it stands.
+ */
+template <class Key>
+class LsmCursorT {
+ public:
+  LsmCursorT();
+
+ private:
+  friend class LsmIndexT<Key>;
+  typedef typename LsmIndexT<Key>::Entry  Entry;
+  typedef typename LsmIndexT<Key>::RunPtr RunPtr;
+  typedef typename LsmIndexT<Key>::RunPage RunPage;
+
+  // the # memtable entries copied at a time
+  static const int MEMTABLE_BATCH = 64;
+
+  // the position of the cursor in one run
+  struct Source {
+    RunPtr  run;
+    RunPage page;   // the current page
+    PageId  pid;    // its PageId, or -1 past the end of the run
+    int     eid;    // the current entry in page
+    Entry   head;   // the entry at (pid, eid)
+  };
+
+  // move s to the first entry at or after (pid, eid), reading the next
+  // pages as needed, and load its head
+  RC settle(Source& s);
+
+  // copy the next memtable entries into mem. if the memtable was written
+  // out since the runs were taken, take the runs again.
+  RC refill();
+
+  LsmIndexT<Key>*     index;       // the index of the memtable part, or NULL
+  std::vector<Source> sources;
+  std::vector<Entry>  mem;         // memtable entries copied so far
+  int                 memPos;      // the next entry of mem
+  bool                memEnd;      // true: the memtable had no more entries
+  Entry               from;        // the entry last returned
+  bool                fromInclusive; // true: nothing returned yet, from is the start
+  int                 version;     // the memtable version of sources
+};
+
+typedef LsmIndexT<Int32Key>  LsmIndex;
+typedef LsmCursorT<Int32Key> LsmCursor;
+
+#endif /* LSMINDEX_H */
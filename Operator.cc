@@ -0,0 +1,1008 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "Operator.h"
+
+using namespace std;
+
+void TupleBatch::selectAll()
+{
+    for (int i = 0; i < count; i++)
+        sel[i] = i;
+    selCount = count;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                          Predicate Implementation                          //
+////////////////////////////////////////////////////////////////////////////////
+
+Predicate::Predicate(const vector<SelCond>& cond)
+{
+    low = INT_MIN;
+    high = INT_MAX;
+    for (unsigned i = 0; i < cond.size(); i++) {
+        Term t;
+        t.key = 0;
+        if (cond[i].attr == 1) {
+            long long v = atoi(cond[i].value);
+            switch (cond[i].comp) {
+                case SelCond::EQ: low = max(low, v); high = min(high, v); continue;
+                case SelCond::GT: low = max(low, v + 1); continue;
+                case SelCond::GE: low = max(low, v); continue;
+                case SelCond::LT: high = min(high, v - 1); continue;
+                case SelCond::LE: high = min(high, v); continue;
+                case SelCond::NE: t.filter = keyNotEqual; t.key = (int) v; break;
+            }
+            terms.insert(terms.begin(), t);
+            continue;
+        }
+        t.value = cond[i].value;
+        switch (cond[i].comp) {
+            case SelCond::EQ: t.filter = filterValue<SelCond::EQ>; break;
+            case SelCond::NE: t.filter = filterValue<SelCond::NE>; break;
+            case SelCond::GT: t.filter = filterValue<SelCond::GT>; break;
+            case SelCond::LT: t.filter = filterValue<SelCond::LT>; break;
+            case SelCond::GE: t.filter = filterValue<SelCond::GE>; break;
+            case SelCond::LE: t.filter = filterValue<SelCond::LE>; break;
+        }
+        terms.push_back(t);
+    }
+}
+
+/*
+ * Drop the tuples that do not meet all conditions from the selection
+ * of batch.
+ * @param batch[IN/OUT] the batch to filter
+ */
+void Predicate::filter(TupleBatch& batch) const
+{
+    // the key range test has no branch that depends on the data
+    if (low > INT_MIN || high < INT_MAX) {
+        int n = 0;
+        for (int i = 0; i < batch.selCount; i++) {
+            int s = batch.sel[i];
+            batch.sel[n] = s;
+            n += (batch.keys[s] >= low) & (batch.keys[s] <= high);
+        }
+        batch.selCount = n;
+    }
+    for (unsigned i = 0; i < terms.size() && batch.selCount > 0; i++)
+        terms[i].filter(terms[i], batch);
+}
+
+Predicate::Predicate(const KeyRange& range)
+{
+    low = INT_MIN;
+    high = INT_MAX;
+    if (range.hasLow)
+        low = (long long) range.low + (range.lowInclusive ? 0 : 1);
+    if (range.hasHigh)
+        high = (long long) range.high - (range.highInclusive ? 0 : 1);
+}
+
+/*
+ * @return true if the predicate is always true
+ */
+bool Predicate::empty() const
+{
+    return low == INT_MIN && high == INT_MAX && terms.empty();
+}
+
+template <SelCond::Comparator Comp>
+bool Predicate::holds(int diff)
+{
+    switch (Comp) {
+        case SelCond::EQ: return diff == 0;
+        case SelCond::NE: return diff != 0;
+        case SelCond::GT: return diff > 0;
+        case SelCond::LT: return diff < 0;
+        case SelCond::GE: return diff >= 0;
+        case SelCond::LE: return diff <= 0;
+    }
+    return false;
+}
+
+void Predicate::keyNotEqual(const Term& t, TupleBatch& batch)
+{
+    int n = 0;
+    for (int i = 0; i < batch.selCount; i++) {
+        int s = batch.sel[i];
+        batch.sel[n] = s;
+        n += (batch.keys[s] != t.key);
+    }
+    batch.selCount = n;
+}
+
+template <SelCond::Comparator Comp>
+void Predicate::filterValue(const Term& t, TupleBatch& batch)
+{
+    int n = 0;
+    for (int i = 0; i < batch.selCount; i++) {
+        int s = batch.sel[i];
+        const string& value = batch.values[s];
+        bool keep;
+
+        // equality needs no ordering, and strings of different lengths differ
+        if (Comp == SelCond::EQ) keep = (value == t.value);
+        else if (Comp == SelCond::NE) keep = (value != t.value);
+        else keep = holds<Comp>(value.compare(t.value));
+
+        batch.sel[n] = s;
+        n += keep;
+    }
+    batch.selCount = n;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                          Operator Implementations                          //
+////////////////////////////////////////////////////////////////////////////////
+
+TableScan::TableScan(const RecordFile& rf) : rf(rf)
+{
+    rid.pid = rid.sid = 0;
+    end = rf.endRid();
+}
+
+TableScan::TableScan(const RecordFile& rf, PageId begin, PageId end) : rf(rf)
+{
+    rid.pid = begin;
+    rid.sid = 0;
+    this->end.pid = end;
+    this->end.sid = 0;
+    if (rf.endRid() < this->end)
+        this->end = rf.endRid();
+}
+
+RC TableScan::next(TupleBatch& batch)
+{
+    RC rc;
+    if (!(rid < end)) return RC_END_OF_TREE;
+
+    // the batch read reads each page of the run of rids once
+    int n = 0;
+    for (; n < batch.want && rid < end; n++, ++rid)
+        batch.rids[n] = rid;
+    if ((rc = rf.read(batch.rids, n, batch.keys, batch.values)) < 0)
+        return rc;
+    batch.count = n;
+    batch.selectAll();
+    return 0;
+}
+
+IndexScan::IndexScan(BTreeIndex& index, const KeyRange& range, bool reverse)
+    : index(index), range(range), reverse(reverse), opened(false)
+{
+}
+
+RC IndexScan::next(TupleBatch& batch)
+{
+    RC rc;
+    if (!opened) {
+        if ((rc = scan.open(index, range, reverse)) < 0)
+            return rc;
+        opened = true;
+    }
+
+    int n = 0;
+    while (n < batch.want && (rc = scan.next(batch.keys[n], batch.rids[n])) == 0) {
+        batch.values[n].clear();
+        n++;
+    }
+    if (n < batch.want && rc != RC_END_OF_TREE)
+        return rc;
+    if (n == 0)
+        return RC_END_OF_TREE;
+    batch.count = n;
+    batch.selectAll();
+    return 0;
+}
+
+LsmScan::LsmScan(LsmIndex& index, const KeyRange& range)
+    : index(index), range(range), opened(false), done(false)
+{
+}
+
+RC LsmScan::next(TupleBatch& batch)
+{
+    RC rc = 0;
+    if (!opened) {
+        opened = true;
+        rc = index.locate(range.hasLow ? range.low : INT_MIN, cursor);
+        if (rc == RC_NO_SUCH_RECORD)
+            done = true;
+        else if (rc < 0)
+            return rc;
+    }
+
+    int n = 0;
+    while (!done && n < batch.want) {
+        if ((rc = index.readForward(cursor, batch.keys[n], batch.rids[n])) < 0) {
+            if (rc != RC_END_OF_TREE)
+                return rc;
+            done = true;
+            break;
+        }
+
+        // the cursor starts at the first entry >= low
+        int key = batch.keys[n];
+        if (range.hasLow && !range.lowInclusive && key == range.low)
+            continue;
+        if (range.hasHigh && (key > range.high || (key == range.high && !range.highInclusive))) {
+            done = true;
+            break;
+        }
+        batch.values[n].clear();
+        n++;
+    }
+    if (n == 0)
+        return RC_END_OF_TREE;
+    batch.count = n;
+    batch.selectAll();
+    return 0;
+}
+
+RidScan::RidScan(int key, const vector<RecordId>& rids)
+    : key(key), rids(rids), pos(0)
+{
+}
+
+RC RidScan::next(TupleBatch& batch)
+{
+    if (pos >= rids.size()) return RC_END_OF_TREE;
+
+    int n = 0;
+    for (; n < batch.want && pos < rids.size(); n++, pos++) {
+        batch.keys[n] = key;
+        batch.values[n].clear();
+        batch.rids[n] = rids[pos];
+    }
+    batch.count = n;
+    batch.selectAll();
+    return 0;
+}
+
+Fetch::Fetch(Operator& child, const RecordFile& rf, bool sorted)
+    : child(child), rf(rf), sorted(sorted), drained(false), pos(0)
+{
+}
+
+RC Fetch::next(TupleBatch& batch)
+{
+    RC rc;
+    if (!sorted) {
+        // read the selected tuples of each batch of the child in its order
+        if ((rc = child.next(batch)) < 0)
+            return rc;
+        for (int i = 0; i < batch.selCount; i++)
+            batch.rids[i] = batch.rids[batch.sel[i]];
+        batch.count = batch.selCount;
+        return read(batch);
+    }
+
+    if (!drained) {
+        // every rid is needed for the order, however few tuples are wanted
+        int want = batch.want;
+        batch.want = TupleBatch::CAPACITY;
+        while ((rc = child.next(batch)) == 0) {
+            for (int i = 0; i < batch.selCount; i++)
+                rids.push_back(batch.rids[batch.sel[i]]);
+        }
+        batch.want = want;
+        if (rc != RC_END_OF_TREE)
+            return rc;
+        sort(rids.begin(), rids.end());
+        drained = true;
+    }
+    if (pos >= rids.size()) return RC_END_OF_TREE;
+
+    int n = min((int) (rids.size() - pos), batch.want);
+    copy(rids.begin() + pos, rids.begin() + pos + n, batch.rids);
+    pos += n;
+    batch.count = n;
+    return read(batch);
+}
+
+RC Fetch::read(TupleBatch& batch)
+{
+    RC rc;
+    if ((rc = rf.read(batch.rids, batch.count, batch.keys, batch.values)) < 0)
+        return rc;
+    batch.selectAll();
+    return 0;
+}
+
+Filter::Filter(Operator& child, const Predicate& pred)
+    : child(child), pred(pred)
+{
+}
+
+RC Filter::next(TupleBatch& batch)
+{
+    RC rc;
+    if ((rc = child.next(batch)) < 0)
+        return rc;
+    pred.filter(batch);
+    return 0;
+}
+
+// a sorted run in a temporary file, read back a chunk at a time
+struct Sort::Run {
+    RecordFile  rf;
+    RecordId    rid;    // the next tuple of the file to read
+    int         keys[TupleBatch::CAPACITY];
+    std::string values[TupleBatch::CAPACITY];
+    int         n;      // # tuples in keys and values. 0: past the end
+    int         pos;    // the next tuple in keys and values
+
+    Run() : n(0), pos(0) { rid.pid = 0; rid.sid = 0; }
+    ~Run() { rf.close(); }
+
+    // read the next chunk of the file
+    RC fill();
+};
+
+// std heaps keep the largest element in front, so the run whose next
+// tuple comes first in the order is the largest
+struct Sort::RunOrder {
+    Order order;
+    bool operator()(const Run* a, const Run* b) const
+    {
+        return order.before(b->keys[b->pos], b->values[b->pos],
+                            a->keys[a->pos], a->values[a->pos]);
+    }
+};
+
+// create and open a temporary record file, which is removed when closed
+static RC openTempFile(RecordFile& rf);
+
+RC Sort::Run::fill()
+{
+    RecordId rids[TupleBatch::CAPACITY];
+    const RecordId& end = rf.endRid();
+
+    n = pos = 0;
+    for (; n < TupleBatch::CAPACITY && rid < end; n++, ++rid)
+        rids[n] = rid;
+    return (n > 0) ? rf.read(rids, n, keys, values) : 0;
+}
+
+bool Sort::Order::before(int k1, const string& v1, int k2, const string& v2) const
+{
+    int c = (attr == 2) ? v1.compare(v2) : 0;
+    if (c == 0)
+        c = (k1 < k2) ? -1 : (k1 > k2);
+    if (c == 0 && attr != 2)
+        c = v1.compare(v2);
+    return descending ? c > 0 : c < 0;
+}
+
+Sort::Sort(Operator& child, int attr, bool descending, int limit)
+    : child(child), limit(limit), drained(false), pos(0)
+{
+    order.attr = attr;
+    order.descending = descending;
+}
+
+Sort::~Sort()
+{
+    for (unsigned i = 0; i < runs.size(); i++)
+        delete runs[i];
+}
+
+RC Sort::next(TupleBatch& batch)
+{
+    RC rc;
+    if (!drained) {
+        if ((rc = drain(batch)) < 0)
+            return rc;
+        drained = true;
+    }
+    if (pos >= tuples.size())
+        return merge(batch);
+
+    int n = 0;
+    for (; n < batch.want && pos < tuples.size(); n++, pos++) {
+        batch.keys[n] = tuples[pos].key;
+        batch.values[n].swap(tuples[pos].value);
+    }
+    batch.count = n;
+    batch.selectAll();
+    return 0;
+}
+
+RC Sort::drain(TupleBatch& batch)
+{
+    RC rc;
+
+    // a limit small enough for memory keeps a heap of the first tuples
+    bool heap = (limit >= 0 && limit <= MEMORY_TUPLES);
+
+    // every tuple is needed for the order, however few are wanted
+    int want = batch.want;
+    batch.want = TupleBatch::CAPACITY;
+    while ((rc = child.next(batch)) == 0) {
+        for (int i = 0; i < batch.selCount; i++) {
+            int j = batch.sel[i];
+            if (heap) {
+                keep(batch.keys[j], batch.values[j]);
+                continue;
+            }
+            tuples.push_back(Tuple());
+            tuples.back().key = batch.keys[j];
+            tuples.back().value.swap(batch.values[j]);
+            if (tuples.size() == MEMORY_TUPLES && (rc = spill()) < 0) {
+                batch.want = want;
+                return rc;
+            }
+        }
+    }
+    batch.want = want;
+    if (rc != RC_END_OF_TREE)
+        return rc;
+
+    if (heap) {
+        sort_heap(tuples.begin(), tuples.end(), order);
+    } else if (runs.empty()) {
+        sort(tuples.begin(), tuples.end(), order);
+    } else {
+        // the rest goes to a run too, and the runs are merged
+        if (!tuples.empty() && (rc = spill()) < 0)
+            return rc;
+        RunOrder first = { order };
+        make_heap(runs.begin(), runs.end(), first);
+    }
+    return 0;
+}
+
+void Sort::keep(int key, string& value)
+{
+    if (limit == 0) return;
+    if ((int) tuples.size() < limit) {
+        tuples.push_back(Tuple());
+        tuples.back().key = key;
+        tuples.back().value.swap(value);
+        push_heap(tuples.begin(), tuples.end(), order);
+        return;
+    }
+
+    // the front of the heap is the last of the tuples kept
+    if (!order.before(key, value, tuples.front().key, tuples.front().value))
+        return;
+    pop_heap(tuples.begin(), tuples.end(), order);
+    tuples.back().key = key;
+    tuples.back().value.swap(value);
+    push_heap(tuples.begin(), tuples.end(), order);
+}
+
+RC Sort::spill()
+{
+    RC rc;
+    RecordId rid;
+    Run* run = new Run;
+
+    sort(tuples.begin(), tuples.end(), order);
+    if ((rc = openTempFile(run->rf)) < 0) {
+        delete run;
+        return rc;
+    }
+    for (unsigned i = 0; i < tuples.size(); i++) {
+        if ((rc = run->rf.append(tuples[i].key, tuples[i].value, rid)) < 0) {
+            delete run;
+            return rc;
+        }
+    }
+    tuples.clear();
+
+    if ((rc = run->fill()) < 0) {
+        delete run;
+        return rc;
+    }
+    runs.push_back(run);
+    return 0;
+}
+
+RC Sort::merge(TupleBatch& batch)
+{
+    RC rc;
+    RunOrder first = { order };
+
+    int n = 0;
+    while (n < batch.want && !runs.empty()) {
+        // the run with the next tuple is in front of the heap
+        pop_heap(runs.begin(), runs.end(), first);
+        Run* run = runs.back();
+        batch.keys[n] = run->keys[run->pos];
+        batch.values[n].swap(run->values[run->pos]);
+        n++;
+
+        if (++run->pos == run->n && (rc = run->fill()) < 0)
+            return rc;
+        if (run->n > 0) {
+            push_heap(runs.begin(), runs.end(), first);
+        } else {
+            delete run;
+            runs.pop_back();
+        }
+    }
+    if (n == 0)
+        return RC_END_OF_TREE;
+    batch.count = n;
+    batch.selectAll();
+    return 0;
+}
+
+static RC openTempFile(RecordFile& rf)
+{
+    RC rc;
+    const char* dir = getenv("TMPDIR");
+    string name = string((dir != NULL && *dir != 0) ? dir : "/tmp") + "/bruinbase-sort-XXXXXX";
+    vector<char> path(name.begin(), name.end());
+    path.push_back(0);
+
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) return RC_FILE_OPEN_FAILED;
+    ::close(fd);
+
+    // the name goes at once. the open file stays until it is closed, and
+    // nothing is left behind if the query fails.
+    rc = rf.open(&path[0], 'w');
+    unlink(&path[0]);
+    return rc;
+}
+
+Limit::Limit(Operator& child, int limit, int offset)
+    : child(child), left(limit), skip(offset)
+{
+}
+
+RC Limit::next(TupleBatch& batch)
+{
+    RC rc;
+    if (left == 0) return RC_END_OF_TREE;
+
+    // a filter below may drop tuples, so this is only an upper bound
+    long long needed = (left < 0) ? TupleBatch::CAPACITY : (long long) skip + left;
+    batch.want = (int) min(needed, (long long) TupleBatch::CAPACITY);
+    if ((rc = child.next(batch)) < 0)
+        return rc;
+
+    int from = min(skip, batch.selCount);
+    int n = batch.selCount - from;
+    if (left >= 0 && n > left)
+        n = left;
+    for (int i = 0; i < n; i++)
+        batch.sel[i] = batch.sel[from + i];
+    batch.selCount = n;
+    skip -= from;
+    if (left > 0)
+        left -= n;
+    return 0;
+}
+
+Output::Output(Operator& child, ResultSink& sink)
+    : child(child), sink(sink)
+{
+    batch = new TupleBatch;
+}
+
+Output::~Output()
+{
+    delete batch;
+}
+
+/*
+ * Drain the child.
+ * @param count[IN/OUT] the tuple count to add to
+ * @return error code. 0 if no error
+ */
+RC Output::run(int& count)
+{
+    RC rc;
+    while ((rc = child.next(*batch)) == 0) {
+        if (sink.getAttr() != 4 && (rc = sink.write(*batch)) < 0)
+            return rc;
+        count += batch->selCount;
+    }
+    return (rc == RC_END_OF_TREE) ? 0 : rc;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                          ResultSink Implementation                         //
+////////////////////////////////////////////////////////////////////////////////
+
+ResultSink::ResultSink(int fd, SqlEngine::OutputFormat format, int attr)
+    : fd(fd), outputFormat(format), attr(attr)
+{
+    buffer.reserve(BUFFER_SIZE);
+}
+
+ResultSink::~ResultSink()
+{
+    flush();
+}
+
+/*
+ * Append the column of the SELECT clause of the selected tuples of
+ * batch to out in the output format.
+ * @param batch[IN] the batch to format
+ * @param out[IN/OUT] the text to append to
+ */
+void ResultSink::format(const TupleBatch& batch, string& out) const
+{
+    const int* sel = batch.sel;
+    int        n = batch.selCount;
+
+    // the format and the SELECT clause are looked at once per batch
+    switch (outputFormat) {
+        case SqlEngine::TEXT_OUTPUT:
+        for (int i = 0; i < n; i++) {
+            if (attr != 2)
+                appendInt(out, batch.keys[sel[i]]);
+            if (attr == 2)
+                out += batch.values[sel[i]];
+            else if (attr == 3) {
+                out += " '";
+                out += batch.values[sel[i]];
+                out += '\'';
+            }
+            out += '\n';
+        }
+        break;
+        case SqlEngine::TSV_OUTPUT:
+        for (int i = 0; i < n; i++) {
+            if (attr != 2)
+                appendInt(out, batch.keys[sel[i]]);
+            if (attr == 3)
+                out += '\t';
+            if (attr != 1)
+                appendTsv(out, batch.values[sel[i]]);
+            out += '\n';
+        }
+        break;
+        case SqlEngine::BINARY_OUTPUT:
+        for (int i = 0; i < n; i++) {
+            if (attr != 2)
+                appendRaw(out, batch.keys[sel[i]]);
+            if (attr != 1) {
+                appendRaw(out, batch.values[sel[i]].size());
+                out += batch.values[sel[i]];
+            }
+        }
+        break;
+    }
+}
+
+/*
+ * Write the selected tuples of batch.
+ * @param batch[IN] the batch to write
+ * @return error code. 0 if no error
+ */
+RC ResultSink::write(const TupleBatch& batch)
+{
+    format(batch, buffer);
+    return ((int) buffer.size() >= BUFFER_SIZE) ? flush() : 0;
+}
+
+/*
+ * Write text that format() made.
+ * @param text[IN] the text to write
+ * @return error code. 0 if no error
+ */
+RC ResultSink::write(const string& text)
+{
+    if ((int) (buffer.size() + text.size()) < BUFFER_SIZE) {
+        buffer += text;
+        return 0;
+    }
+
+    // a large text goes out right behind the buffer
+    struct iovec iov[2];
+    iov[0].iov_base = (void*) buffer.data();
+    iov[0].iov_len = buffer.size();
+    iov[1].iov_base = (void*) text.data();
+    iov[1].iov_len = text.size();
+    fflush(stdout);
+    RC rc = writeAll(iov, 2);
+    buffer.clear();
+    return rc;
+}
+
+/*
+ * Write the result of SELECT COUNT(*).
+ * @param count[IN] the tuple count
+ * @return error code. 0 if no error
+ */
+RC ResultSink::writeCount(int count)
+{
+    if (outputFormat == SqlEngine::BINARY_OUTPUT)
+        appendRaw(buffer, count);
+    else {
+        appendInt(buffer, count);
+        buffer += '\n';
+    }
+    return 0;
+}
+
+/*
+ * Write out the buffer.
+ * @return error code. 0 if no error
+ */
+RC ResultSink::flush()
+{
+    if (buffer.empty()) return 0;
+
+    struct iovec iov;
+    iov.iov_base = (void*) buffer.data();
+    iov.iov_len = buffer.size();
+    fflush(stdout);
+    RC rc = writeAll(&iov, 1);
+    buffer.clear();
+    return rc;
+}
+
+RC ResultSink::writeAll(struct iovec* iov, int n)
+{
+    while (n > 0) {
+        ssize_t written = writev(fd, iov, n);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return RC_FILE_WRITE_FAILED;
+        }
+
+        // skip what was written. a short write leaves the rest of a buffer.
+        while (n > 0 && (size_t) written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char*) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+void ResultSink::appendInt(string& out, int n)
+{
+    char  buf[12];
+    char* p = buf + sizeof(buf);
+
+    // the digits from the last, in unsigned so that INT_MIN negates
+    unsigned u = (n < 0) ? 0u - (unsigned) n : (unsigned) n;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u != 0);
+    if (n < 0) *--p = '-';
+    out.append(p, buf + sizeof(buf) - p);
+}
+
+void ResultSink::appendRaw(string& out, int n)
+{
+    out.append((const char*) &n, sizeof(n));
+}
+
+void ResultSink::appendTsv(string& out, const string& value)
+{
+    if (value.find_first_of("\t\n\\") == string::npos) {
+        out += value;
+        return;
+    }
+
+    // escape the characters that would break the columns or the lines
+    for (unsigned i = 0; i < value.size(); i++) {
+        switch (value[i]) {
+            case '\t': out += "\\t"; break;
+            case '\n': out += "\\n"; break;
+            case '\\': out += "\\\\"; break;
+            default: out += value[i];
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                         ParallelPlan Implementation                        //
+////////////////////////////////////////////////////////////////////////////////
+
+ParallelPlan::ParallelPlan(ResultSink& sink, int morselCount)
+    : sink(sink), morselCount(morselCount), morsels(morselCount)
+{
+    for (int i = 0; i < morselCount; i++) {
+        morsels[i].done = false;
+        morsels[i].count = 0;
+    }
+    nextMorsel = 0;
+    printed = 0;
+    error = 0;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&finished, NULL);
+    pthread_cond_init(&room, NULL);
+}
+
+ParallelPlan::~ParallelPlan()
+{
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&finished);
+    pthread_cond_destroy(&room);
+}
+
+/*
+ * Run the plan with threads worker threads.
+ * @param threads[IN] the # worker threads
+ * @param count[IN/OUT] the tuple count to add to
+ * @return error code. 0 if no error
+ */
+RC ParallelPlan::run(int threads, int& count)
+{
+    vector<pthread_t> workers;
+    for (int i = 0; i < threads; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, worker, this) == 0)
+            workers.push_back(t);
+    }
+
+    // without a worker, the calling thread scans the morsels itself
+    if (workers.empty()) {
+        TupleBatch* batch = new TupleBatch;
+        Morsel      result;
+        RC          rc = 0;
+        for (int m = 0; m < morselCount && rc == 0; m++) {
+            if ((rc = scanMorsel(m, *batch, result)) == 0 && (rc = sink.write(result.output)) == 0)
+                count += result.count;
+        }
+        delete batch;
+        return rc;
+    }
+
+    // print the morsels in order as they finish
+    RC rc = 0;
+    string output;
+    for (int m = 0; m < morselCount; m++) {
+        pthread_mutex_lock(&lock);
+        while (!morsels[m].done && error == 0)
+            pthread_cond_wait(&finished, &lock);
+        if (!morsels[m].done) {
+            // a worker failed. the others stop at their next morsel.
+            rc = error;
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        output.swap(morsels[m].output);
+        count += morsels[m].count;
+        printed = m + 1;
+        pthread_cond_broadcast(&room);
+        pthread_mutex_unlock(&lock);
+
+        if ((rc = sink.write(output)) < 0) {
+            // stop the workers at their next morsel
+            pthread_mutex_lock(&lock);
+            error = rc;
+            pthread_cond_broadcast(&room);
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        string().swap(output);
+    }
+
+    for (unsigned i = 0; i < workers.size(); i++)
+        pthread_join(workers[i], NULL);
+    return rc;
+}
+
+RC ParallelPlan::drain(Operator& op, TupleBatch& batch, Morsel& result)
+{
+    RC rc;
+    result.count = 0;
+    result.output.clear();
+    while ((rc = op.next(batch)) == 0) {
+        if (sink.getAttr() != 4)
+            sink.format(batch, result.output);
+        result.count += batch.selCount;
+    }
+    return (rc == RC_END_OF_TREE) ? 0 : rc;
+}
+
+void* ParallelPlan::worker(void* arg)
+{
+    ParallelPlan* scan = (ParallelPlan*) arg;
+    TupleBatch*   batch = new TupleBatch;
+    Morsel        result;
+
+    pthread_mutex_lock(&scan->lock);
+    for (;;) {
+        // stay within MORSEL_WINDOW morsels of the printer
+        while (scan->error == 0 && scan->nextMorsel < scan->morselCount &&
+               scan->nextMorsel >= scan->printed + MORSEL_WINDOW)
+            pthread_cond_wait(&scan->room, &scan->lock);
+        if (scan->error < 0 || scan->nextMorsel >= scan->morselCount)
+            break;
+        int m = scan->nextMorsel++;
+        pthread_mutex_unlock(&scan->lock);
+
+        RC rc = scan->scanMorsel(m, *batch, result);
+
+        pthread_mutex_lock(&scan->lock);
+        if (rc < 0) {
+            // the workers waiting for room stop too
+            if (scan->error == 0)
+                scan->error = rc;
+            pthread_cond_broadcast(&scan->room);
+        } else {
+            scan->morsels[m].output.swap(result.output);
+            scan->morsels[m].count = result.count;
+            scan->morsels[m].done = true;
+        }
+        pthread_cond_broadcast(&scan->finished);
+    }
+    pthread_mutex_unlock(&scan->lock);
+
+    delete batch;
+    return NULL;
+}
+
+ParallelScan::ParallelScan(const RecordFile& rf, const Predicate& pred, ResultSink& sink)
+    : ParallelPlan(sink, morselsOf(rf)), rf(rf), pred(pred)
+{
+}
+
+int ParallelScan::morselsOf(const RecordFile& rf)
+{
+    const RecordId& end = rf.endRid();
+    int pages = end.pid + (end.sid > 0 ? 1 : 0);
+    return (pages + MORSEL_PAGES - 1) / MORSEL_PAGES;
+}
+
+RC ParallelScan::scanMorsel(int m, TupleBatch& batch, Morsel& result)
+{
+    TableScan scan(rf, m * MORSEL_PAGES, (m + 1) * MORSEL_PAGES);
+    Filter    filter(scan, pred);
+    return drain(pred.empty() ? (Operator&) scan : (Operator&) filter, batch, result);
+}
+
+ParallelIndexScan::ParallelIndexScan(BTreeIndex& index, const KeyRange& range,
+                                     const vector<int>& splitKeys, const RecordFile* rf,
+                                     bool sorted, const Predicate& pred, ResultSink& sink)
+    : ParallelPlan(sink, splitKeys.size() + 1), index(index),
+      parts(splitKeys.size() + 1, range), rf(rf), sorted(sorted), pred(pred)
+{
+    // sub-range i ends before split key i, where sub-range i+1 starts
+    for (unsigned i = 0; i < splitKeys.size(); i++) {
+        parts[i].hasHigh = true;
+        parts[i].highInclusive = false;
+        parts[i].high = splitKeys[i];
+        parts[i + 1].hasLow = true;
+        parts[i + 1].lowInclusive = true;
+        parts[i + 1].low = splitKeys[i];
+    }
+}
+
+RC ParallelIndexScan::scanMorsel(int m, TupleBatch& batch, Morsel& result)
+{
+    IndexScan scan(index, parts[m]);
+    if (rf == NULL) {
+        Filter filter(scan, pred);
+        return drain(pred.empty() ? (Operator&) scan : (Operator&) filter, batch, result);
+    }
+
+    Fetch  fetch(scan, *rf, sorted);
+    Filter filter(fetch, pred);
+    return drain(pred.empty() ? (Operator&) fetch : (Operator&) filter, batch, result);
+}
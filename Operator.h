@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#ifndef OPERATOR_H
+#define OPERATOR_H
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Bruinbase.h"
+#include "RecordFile.h"
+#include "BTreeIndex.h"
+#include "LsmIndex.h"
+#include "SqlEngine.h"
+
+/**
+ * A batch of tuples that the operators of a query plan pass to each
+ * other. The columns are arrays, and sel lists the positions of the
+ * tuples still selected, so a filter drops tuples by shrinking sel
+ * without moving anything. The value strings keep their buffers from
+ * batch to batch, so filling a batch allocates nothing once warm.
+ */
+struct TupleBatch {
+  static const int CAPACITY = 1024;
+
+  int         count;             // # tuples in the columns
+  int         keys[CAPACITY];
+  std::string values[CAPACITY];  // empty unless the tuples were read
+  RecordId    rids[CAPACITY];    // where the tuples are in the table
+  int         sel[CAPACITY];     // the positions of the selected tuples
+  int         selCount;          // # entries in sel
+  int         want;              // a producer fills at most this many tuples
+
+  TupleBatch() : count(0), selCount(0), want(CAPACITY) { }
+
+  // select all count tuples
+  void selectAll();
+};
+
+/**
+ * The conditions of a WHERE clause, compiled once per query. Every
+ * constant is parsed once, the conditions on key other than NE fold into
+ * one range test, and each remaining condition gets a loop specialized
+ * for its column and comparator, which it runs over a whole batch.
+ */
+class Predicate {
+ public:
+  explicit Predicate(const std::vector<SelCond>& cond);
+
+  /**
+   * The predicate that key is in range.
+   */
+  explicit Predicate(const KeyRange& range);
+
+  /**
+   * Drop the tuples that do not meet all conditions from the selection
+   * of batch.
+   * @param batch[IN/OUT] the batch to filter
+   */
+  void filter(TupleBatch& batch) const;
+
+  /**
+   * @return true if the predicate is always true
+   */
+  bool empty() const;
+
+ private:
+  struct Term {
+    // keep the selected tuples of batch that meet the condition
+    void (*filter)(const Term& t, TupleBatch& batch);
+    int         key;    // the constant of a condition on key
+    std::string value;  // the constant of a condition on value
+  };
+
+  template <SelCond::Comparator Comp> static bool holds(int diff);
+  static void keyNotEqual(const Term& t, TupleBatch& batch);
+  template <SelCond::Comparator Comp>
+  static void filterValue(const Term& t, TupleBatch& batch);
+
+  long long         low;    // the range the conditions on key allow
+  long long         high;
+  std::vector<Term> terms;  // the NE conditions on key, then those on value
+};
+
+/**
+ * An operator of a query plan. Every call to next() refills the batch
+ * with the next tuples of the operator's output. An operator that has a
+ * child passes the same batch to it and works on what comes back.
+ */
+class Operator {
+ public:
+  virtual ~Operator() { }
+
+  /**
+   * Fill batch with the next tuples. The batch may select no tuple.
+   * @param batch[OUT] the batch to fill
+   * @return error code. 0 if no error. RC_END_OF_TREE after the last tuple
+   */
+  virtual RC next(TupleBatch& batch) = 0;
+};
+
+/**
+ * Read every tuple of a table file, or of the pages [begin, end) of it,
+ * in the order of the file.
+ */
+class TableScan : public Operator {
+ public:
+  explicit TableScan(const RecordFile& rf);
+  TableScan(const RecordFile& rf, PageId begin, PageId end);
+  RC next(TupleBatch& batch);
+
+ private:
+  const RecordFile& rf;
+  RecordId          rid;  // the next tuple to read
+  RecordId          end;  // the tuple past the last one to read
+};
+
+/**
+ * Return the keys and RecordIds of an index range in key order, or with
+ * reverse, in descending key order. The values are left empty.
+ */
+class IndexScan : public Operator {
+ public:
+  IndexScan(BTreeIndex& index, const KeyRange& range, bool reverse = false);
+  RC next(TupleBatch& batch);
+
+ private:
+  BTreeIndex&    index;
+  KeyRange       range;
+  bool           reverse;
+  IndexRangeScan scan;
+  bool           opened;
+};
+
+/**
+ * Return the keys and RecordIds of a key range of an LSM index in key
+ * order. The values are left empty.
+ */
+class LsmScan : public Operator {
+ public:
+  LsmScan(LsmIndex& index, const KeyRange& range);
+  RC next(TupleBatch& batch);
+
+ private:
+  LsmIndex& index;
+  KeyRange  range;
+  LsmCursor cursor;
+  bool      opened;
+  bool      done;    // true: the cursor is past the range
+};
+
+/**
+ * Return the given RecordIds, all of which have the same key, e.g., the
+ * result of a hash index lookup. The values are left empty.
+ */
+class RidScan : public Operator {
+ public:
+  RidScan(int key, const std::vector<RecordId>& rids);
+  RC next(TupleBatch& batch);
+
+ private:
+  int                          key;
+  const std::vector<RecordId>& rids;
+  unsigned                     pos;  // the next rid to return
+};
+
+/**
+ * Read the tuples whose RecordIds the child returns. In sorted mode,
+ * the child's RecordIds are all collected and sorted first, so that
+ * each page of the table is read once.
+ */
+class Fetch : public Operator {
+ public:
+  Fetch(Operator& child, const RecordFile& rf, bool sorted);
+  RC next(TupleBatch& batch);
+
+ private:
+  // read the tuples of batch.rids[0..count)
+  RC read(TupleBatch& batch);
+
+  Operator&             child;
+  const RecordFile&     rf;
+  bool                  sorted;
+  bool                  drained;  // true: the child's rids are in rids
+  std::vector<RecordId> rids;     // the sorted rids of the child
+  unsigned              pos;      // the next rid in rids to read
+};
+
+/**
+ * Keep the tuples of the child that meet a predicate.
+ */
+class Filter : public Operator {
+ public:
+  Filter(Operator& child, const Predicate& pred);
+  RC next(TupleBatch& batch);
+
+ private:
+  Operator&        child;
+  const Predicate& pred;
+};
+
+/**
+ * Return the tuples of the child ordered by key or by value. It drains
+ * the child before it returns the first tuple. With a limit, only the
+ * first limit tuples in that order are kept, in a heap that the rest of
+ * the child streams past. Otherwise the tuples are sorted in memory, and
+ * a child larger than memory is sorted in runs that are written to
+ * temporary files and then merged.
+ */
+class Sort : public Operator {
+ public:
+  // the # tuples sorted in memory at a time
+  static const int MEMORY_TUPLES = 1 << 19;
+
+  /**
+   * @param child[IN] the operator to sort
+   * @param attr[IN] the attribute to order by (1: key, 2: value)
+   * @param descending[IN] true to return the tuples in descending order
+   * @param limit[IN] the # tuples to return at most. -1: no limit
+   */
+  Sort(Operator& child, int attr, bool descending, int limit);
+  ~Sort();
+  RC next(TupleBatch& batch);
+
+ private:
+  struct Tuple {
+    int         key;
+    std::string value;
+  };
+
+  // the order of the tuples. ties on attr are broken by the other column
+  struct Order {
+    int  attr;
+    bool descending;
+    bool operator()(const Tuple& a, const Tuple& b) const
+      { return before(a.key, a.value, b.key, b.value); }
+    // check whether the tuple (k1, v1) is returned before (k2, v2)
+    bool before(int k1, const std::string& v1, int k2, const std::string& v2) const;
+  };
+
+  struct Run;       // a sorted run in a temporary file
+  struct RunOrder;  // the order of the runs by their next tuple
+
+  // read every tuple of the child
+  RC drain(TupleBatch& batch);
+
+  // keep a tuple in the heap of the first limit tuples. value may be
+  // swapped out.
+  void keep(int key, std::string& value);
+
+  // sort tuples and write them to a new run
+  RC spill();
+
+  // fill batch with the next tuples of the merged runs
+  RC merge(TupleBatch& batch);
+
+  Operator&          child;
+  Order              order;
+  int                limit;
+  bool               drained;  // true: the child has been read
+  std::vector<Tuple> tuples;   // the tuples in memory, or the heap
+  unsigned           pos;      // the next tuple in tuples to return
+  std::vector<Run*>  runs;     // the runs to merge, as a heap
+};
+
+/**
+ * Where the result of a query goes. The tuples are formatted into a
+ * large buffer in the output format of the engine, with integers
+ * formatted by hand, and the buffer goes to the file descriptor with one
+ * writev() call when it fills up. Text formatted elsewhere, e.g., by the
+ * workers of a parallel plan, is written along with the buffer without
+ * being copied into it.
+ */
+class ResultSink {
+ public:
+  // the # bytes buffered before a write
+  static const int BUFFER_SIZE = 65536;
+
+  /**
+   * @param fd[IN] the file descriptor to write to
+   * @param format[IN] the output format
+   * @param attr[IN] attribute in the SELECT clause
+   * (1: key, 2: value, 3: *, 4: count(*))
+   */
+  ResultSink(int fd, SqlEngine::OutputFormat format, int attr);
+  ~ResultSink();
+
+  /**
+   * Append the column of the SELECT clause of the selected tuples of
+   * batch to out in the output format.
+   * @param batch[IN] the batch to format
+   * @param out[IN/OUT] the text to append to
+   */
+  void format(const TupleBatch& batch, std::string& out) const;
+
+  /**
+   * Write the selected tuples of batch.
+   * @param batch[IN] the batch to write
+   * @return error code. 0 if no error
+   */
+  RC write(const TupleBatch& batch);
+
+  /**
+   * Write text that format() made.
+   * @param text[IN] the text to write
+   * @return error code. 0 if no error
+   */
+  RC write(const std::string& text);
+
+  /**
+   * Write the result of SELECT COUNT(*).
+   * @param count[IN] the tuple count
+   * @return error code. 0 if no error
+   */
+  RC writeCount(int count);
+
+  /**
+   * Write out the buffer. What stdout holds is written first, so that the
+   * result comes after the prompt.
+   * @return error code. 0 if no error
+   */
+  RC flush();
+
+  /**
+   * @return attribute in the SELECT clause
+   */
+  int getAttr() const { return attr; }
+
+ private:
+  ResultSink(const ResultSink&);
+  ResultSink& operator=(const ResultSink&);
+
+  // write the n buffers of iov completely
+  RC writeAll(struct iovec* iov, int n);
+
+  static void appendInt(std::string& out, int n);
+  static void appendRaw(std::string& out, int n);
+  static void appendTsv(std::string& out, const std::string& value);
+
+  int                     fd;
+  SqlEngine::OutputFormat outputFormat;
+  int                     attr;
+  std::string             buffer;
+};
+
+/**
+ * Skip the first offset tuples of the child and return at most limit of
+ * the rest. It asks the child for no more tuples than it still needs,
+ * and once it has returned limit tuples it stops pulling, so the scans
+ * below it stop early.
+ */
+class Limit : public Operator {
+ public:
+  /**
+   * @param child[IN] the operator to limit
+   * @param limit[IN] the # tuples to return at most. -1: no limit
+   * @param offset[IN] the # tuples to skip first
+   */
+  Limit(Operator& child, int limit, int offset);
+  RC next(TupleBatch& batch);
+
+ private:
+  Operator& child;
+  int       left;  // the # tuples still to return. -1: no limit
+  int       skip;  // the # tuples still to skip
+};
+
+/**
+ * The root of a query plan: drain the child, write the column of the
+ * SELECT clause of every tuple to a sink and count the tuples. For SELECT
+ * COUNT(*) it only counts.
+ */
+class Output {
+ public:
+  /**
+   * @param child[IN] the operator to drain
+   * @param sink[IN] where the tuples go
+   */
+  Output(Operator& child, ResultSink& sink);
+  ~Output();
+
+  /**
+   * Drain the child.
+   * @param count[IN/OUT] the tuple count to add to
+   * @return error code. 0 if no error
+   */
+  RC run(int& count);
+
+ private:
+  Output(const Output&);
+  Output& operator=(const Output&);
+
+  Operator&   child;
+  ResultSink& sink;
+  TupleBatch* batch;  // the one batch of the plan
+};
+
+/**
+ * A query plan cut into morsels that run on several threads. The workers
+ * take the morsels one at a time, so a worker that gets fast morsels
+ * takes more of them. Each worker runs the plan of its morsel with a
+ * batch of its own, counts the tuples and formats the output into the
+ * buffer of the morsel. The calling thread prints the buffers in the
+ * order of the morsels, so the output is the same as that of a single
+ * thread; workers stay at most MORSEL_WINDOW morsels ahead of it.
+ */
+class ParallelPlan {
+ public:
+  // the # morsels that may wait to be printed
+  static const int MORSEL_WINDOW = 64;
+
+  virtual ~ParallelPlan();
+
+  /**
+   * Run the plan with threads worker threads.
+   * @param threads[IN] the # worker threads
+   * @param count[IN/OUT] the tuple count to add to
+   * @return error code. 0 if no error
+   */
+  RC run(int threads, int& count);
+
+ protected:
+  // the result of a morsel
+  struct Morsel {
+    bool        done;
+    int         count;
+    std::string output;
+  };
+
+  /**
+   * @param sink[IN] where the tuples go
+   * @param morselCount[IN] the # morsels of the plan
+   */
+  ParallelPlan(ResultSink& sink, int morselCount);
+
+  // run, count and format morsel m
+  virtual RC scanMorsel(int m, TupleBatch& batch, Morsel& result) = 0;
+
+  // drain op into result
+  RC drain(Operator& op, TupleBatch& batch, Morsel& result);
+
+ private:
+  ParallelPlan(const ParallelPlan&);
+  ParallelPlan& operator=(const ParallelPlan&);
+
+  // the body of a worker thread
+  static void* worker(void* arg);
+
+  ResultSink&         sink;
+  int                 morselCount;
+  std::vector<Morsel> morsels;
+
+  pthread_mutex_t     lock;        /// guards everything below and morsels
+  pthread_cond_t      finished;    /// signals a finished morsel
+  pthread_cond_t      room;        /// signals a printed morsel
+  int                 nextMorsel;  /// the next morsel to take
+  int                 printed;     /// the # morsels printed
+  RC                  error;       /// the first error of a worker
+};
+
+/**
+ * A full table scan, filter and output on several threads. The pages of
+ * the table are cut into morsels of MORSEL_PAGES pages.
+ */
+class ParallelScan : public ParallelPlan {
+ public:
+  // the # pages of a morsel
+  static const int MORSEL_PAGES = 64;
+
+  /**
+   * @param rf[IN] the table to scan
+   * @param pred[IN] the conditions the tuples must meet
+   * @param sink[IN] where the tuples go
+   */
+  ParallelScan(const RecordFile& rf, const Predicate& pred, ResultSink& sink);
+
+ protected:
+  RC scanMorsel(int m, TupleBatch& batch, Morsel& result);
+
+ private:
+  // the # morsels of rf
+  static int morselsOf(const RecordFile& rf);
+
+  const RecordFile& rf;
+  const Predicate&  pred;
+};
+
+/**
+ * An index range scan, fetch, filter and output on several threads. The
+ * range is cut into sub-ranges at the keys that
+ * BTreeIndex::getSplitKeys() gives, and each sub-range is a morsel, so
+ * the output is in key order as with a single scan.
+ */
+class ParallelIndexScan : public ParallelPlan {
+ public:
+  /**
+   * @param index[IN] the index to scan
+   * @param range[IN] the range to scan
+   * @param splitKeys[IN] the ascending keys inside range to cut it at
+   * @param rf[IN] the table to read the tuples from. NULL: the index
+   * alone answers the query
+   * @param sorted[IN] true: read the tuples of a sub-range in table order
+   * @param pred[IN] the conditions the tuples must meet
+   * @param sink[IN] where the tuples go
+   */
+  ParallelIndexScan(BTreeIndex& index, const KeyRange& range,
+                    const std::vector<int>& splitKeys, const RecordFile* rf,
+                    bool sorted, const Predicate& pred, ResultSink& sink);
+
+ protected:
+  RC scanMorsel(int m, TupleBatch& batch, Morsel& result);
+
+ private:
+  BTreeIndex&           index;
+  std::vector<KeyRange> parts;  // the sub-range of every morsel
+  const RecordFile*     rf;
+  bool                  sorted;
+  const Predicate&      pred;
+};
+
+#endif /* OPERATOR_H */
@@ -9,7 +9,9 @@
 
 #include "Bruinbase.h"
 #include "PageFile.h"
+#include <cstring>
 #include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 using std::string;
@@ -17,6 +19,8 @@ using std::string;
 int PageFile::readCount = 0;
 int PageFile::writeCount = 0;
 int PageFile::cacheClock = 1;
+int PageFile::cacheWrites = 0;
+pthread_rwlock_t PageFile::cacheLock = PTHREAD_RWLOCK_INITIALIZER;
 struct PageFile::cacheStruct PageFile::readCache[PageFile::CACHE_COUNT];
 
 PageFile::PageFile() 
@@ -70,10 +74,10 @@ RC PageFile::close()
 {
   if (fd <= 0) return RC_FILE_CLOSE_FAILED;
 
-  // close the file
-  if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
-
-  // evict all cached pages for this file
+  // evict all cached pages for this file before the descriptor is
+  // released, since another thread may get the same descriptor for a
+  // different file right after it is closed
+  pthread_rwlock_wrlock(&cacheLock);
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].lastAccessed != 0) {
        readCache[i].fd = 0;
@@ -81,6 +85,10 @@ RC PageFile::close()
        readCache[i].lastAccessed = 0;
     }
   }
+  pthread_rwlock_unlock(&cacheLock);
+
+  // close the file
+  if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
 
   // set the fd and epid to the initial state
   fd = -1; 
@@ -90,89 +98,100 @@ RC PageFile::close()
 
 PageId PageFile::endPid() const 
 {
-  return epid;
-}
-
-RC PageFile::seek(PageId pid) const
-{
-  return (::lseek(fd, pid * PAGE_SIZE, SEEK_SET) < 0) ? RC_FILE_SEEK_FAILED : 0;
+  return __atomic_load_n(&epid, __ATOMIC_ACQUIRE);
 }
 
 RC PageFile::write(PageId pid, const void* buffer)
 {
-  RC rc;
   if (pid < 0) return RC_INVALID_PID; 
 
-  // seek to the location of the page
-  if ((rc = seek(pid) < 0)) return rc;
-
   // write the buffer to the disk page
-  if (::write(fd, buffer, PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
+  if (::pwrite(fd, buffer, PAGE_SIZE, (off_t) pid * PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
 
-  // if the page is in read cache, invalidate it
+  // if the page is in read cache, refresh it, so that a page that is
+  // read, updated and written back again and again (e.g., the leaf that
+  // an insert stream appends to) stays cached
+  pthread_rwlock_wrlock(&cacheLock);
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].pid == pid &&
         readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
+       memcpy(readCache[i].buffer, buffer, PAGE_SIZE);
        break;
     }
   }
+  cacheWrites++;
+  pthread_rwlock_unlock(&cacheLock);
 
   // if the written pid >= end pid, update the end pid
-  if (pid >= epid) epid = pid + 1;
+  PageId end = __atomic_load_n(&epid, __ATOMIC_RELAXED);
+  while (pid >= end &&
+         !__atomic_compare_exchange_n(&epid, &end, pid + 1, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    ;
 
   // increase page write count
-  writeCount++;
+  __atomic_fetch_add(&writeCount, 1, __ATOMIC_RELAXED);
 
   return 0;
 }
 
 RC PageFile::read(PageId pid, void* buffer) const
 {
-  RC rc;
-
-  if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
+  if (pid < 0 || pid >= endPid()) return RC_INVALID_PID; 
 
   //
   // if the page is in cache, read it from there
   //
+  pthread_rwlock_rdlock(&cacheLock);
   for (int i = 0; i < CACHE_COUNT; i++) {
     if (readCache[i].fd == fd && readCache[i].pid == pid && 
         readCache[i].lastAccessed != 0) {
        memcpy(buffer, readCache[i].buffer, PAGE_SIZE);
-       readCache[i].lastAccessed = ++cacheClock;
+       __atomic_store_n(&readCache[i].lastAccessed,
+                        __atomic_add_fetch(&cacheClock, 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+       pthread_rwlock_unlock(&cacheLock);
        return 0;
     }
   }
+  int writesBefore = cacheWrites;
+  pthread_rwlock_unlock(&cacheLock);
 
-  // seek to the page
-  if ((rc = seek(pid) < 0)) return rc;
-  
-  // find the cache slot to evict
-  int toEvict = 0; 
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].lastAccessed == 0) {
-      toEvict = i;
-      break;
-    }
-    if (readCache[i].lastAccessed < readCache[toEvict].lastAccessed) {
-      toEvict = i;
-    }
-  }
-  readCache[toEvict].fd = fd;
-  readCache[toEvict].pid = pid;
-  readCache[toEvict].lastAccessed = ++cacheClock;
- 
-  // read the page to cache first and copy it to the buffer
-  if (::read(fd, readCache[toEvict].buffer, PAGE_SIZE) < 0) {
+  // read the page without holding the lock, so that other threads
+  // can use the cache meanwhile
+  if (::pread(fd, buffer, PAGE_SIZE, (off_t) pid * PAGE_SIZE) < 0) {
     return RC_FILE_READ_FAILED;
   }
-  memcpy(buffer, readCache[toEvict].buffer, PAGE_SIZE);
 
   // increase the page read count
-  readCount++;
+  __atomic_fetch_add(&readCount, 1, __ATOMIC_RELAXED);
+
+  pthread_rwlock_wrlock(&cacheLock);
+
+  // a page written while we were reading may be stale in buffer.
+  // cache the page only if nothing was written in between and no other
+  // thread has cached it meanwhile.
+  bool cached = (cacheWrites != writesBefore);
+  for (int i = 0; i < CACHE_COUNT && !cached; i++) {
+    cached = (readCache[i].fd == fd && readCache[i].pid == pid &&
+              readCache[i].lastAccessed != 0);
+  }
+  if (!cached) {
+    // find the cache slot to evict
+    int toEvict = 0; 
+    for (int i = 0; i < CACHE_COUNT; i++) {
+      if (readCache[i].lastAccessed == 0) {
+        toEvict = i;
+        break;
+      }
+      if (readCache[i].lastAccessed < readCache[toEvict].lastAccessed) {
+        toEvict = i;
+      }
+    }
+    readCache[toEvict].fd = fd;
+    readCache[toEvict].pid = pid;
+    readCache[toEvict].lastAccessed = ++cacheClock;
+    memcpy(readCache[toEvict].buffer, buffer, PAGE_SIZE);
+  }
+  pthread_rwlock_unlock(&cacheLock);
 
   return 0;
 }
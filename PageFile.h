@@ -11,12 +11,16 @@
 #define PAGEFILE_H
 
 #include <string>
+#include <pthread.h>
 #include "Bruinbase.h"
 
 typedef int PageId;
 
 /**
- * read/write a file in the unit of a page
+ * read/write a file in the unit of a page.
+ * A PageFile may be shared by many threads: pages are read and written
+ * with positional I/O, and the read cache is guarded by a reader-writer
+ * lock, so that threads reading cached pages do not wait for each other.
  */
 class PageFile {
  public:
@@ -69,21 +73,12 @@ class PageFile {
   /**
    * @return the total # of disk reads
    */
-  static int getPageReadCount()  { return readCount; }
+  static int getPageReadCount()  { return __atomic_load_n(&readCount, __ATOMIC_RELAXED); }
   
   /**
    * @return the total # of disk writes
    */
-  static int getPageWriteCount() { return writeCount; }
-
- protected:
-  /**
-   * move the file cursor to the beginning of a page.
-   * this is an internal function not exposed to public.
-   * @param pid[IN] page to seek to
-   * @return error code. 0 if no error
-   */
-  RC seek(PageId pid) const;
+  static int getPageWriteCount() { return __atomic_load_n(&writeCount, __ATOMIC_RELAXED); }
 
  private:
   int     fd;     // file descriptor of the associated unix file
@@ -92,18 +87,22 @@ class PageFile {
   //
   // the following set of members implement LRU caching 
   //
-  static const int CACHE_COUNT = 10;
-
-  static int cacheClock; // clock tick counter for LRU policy
+  static const int CACHE_COUNT = 10;  // the # pages to be cached
 
-  // the actual cache data structure
-  static struct cacheStruct {
+  struct cacheStruct {
     int    fd;              // file id of the cached page
     PageId pid;             // page id of the cached page
     int    lastAccessed;    // the last time the cached page was accessed
                             //   (lastAccessed == 0) means that the buffer is empty
     char buffer[PAGE_SIZE]; // the buffer used for caching
-  } readCache[CACHE_COUNT];
+  };
+
+  static pthread_rwlock_t cacheLock;  // guards the cache slots; a cache hit
+                                      //   takes it shared and bumps
+                                      //   lastAccessed atomically
+  static int cacheClock;  // clock tick counter for LRU policy
+  static int cacheWrites; // # writes to cached files, to detect stale reads
+  static struct cacheStruct readCache[CACHE_COUNT];  // the cache data structure
 
   static int readCount;  // total # of page reads 
   static int writeCount; // total # of page writes 
@@ -0,0 +1,413 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include "QueryCursor.h"
+
+using namespace std;
+
+//
+// the query planner. the cost of an access path is the # pages it reads.
+//
+
+// collect the bounds that the conditions put on key into range, and the
+// conditions that range does not cover (NE and those on value) into
+// residual. returns 1 if key is bounded, 0 if not, and -1 if no key can
+// match.
+static int getKeyRange(const vector<SelCond>& cond, KeyRange& range, vector<SelCond>& residual);
+
+// check whether key can be in range: 1 if range bounds key, 0 if it
+// does not, and -1 if no key is in range
+static int checkRange(const KeyRange& range);
+
+// check whether the query needs nothing but the key of each tuple
+static bool keysOnly(int attr, const vector<SelCond>& cond);
+
+// the cost of sorting one rid, in pages. it breaks the tie between the
+// two fetch orders when few tuples share a page.
+static const double SORT_COST = 0.01;
+
+// check whether reading n tuples in table order is cheaper than in key
+// order
+static bool sortedFetchPays(double n, int pages);
+
+
+QueryCursor::QueryCursor()
+    : table(NULL), owned(NULL), rf(NULL), bIndex(NULL), hIndex(NULL), lIndex(NULL), hashed(false),
+      covered(false), bounded(0),
+      pages(0), limit(-1), offset(0), order(0), descending(false), path(FULL_SCAN), entries(0), tupleFilter(NULL), residualFilter(NULL), pos(0)
+{
+    batch = new TupleBatch;
+}
+
+QueryCursor::~QueryCursor()
+{
+    close();
+    delete batch;
+}
+
+/*
+ * Open the files of table and plan a SELECT on it.
+ * @param table[IN] the table name in the FROM clause
+ * @param attr[IN] attribute in the SELECT clause
+ * @param cond[IN] list of conditions in the WHERE clause, ANDed together
+ * @param order[IN] the attribute in the ORDER BY clause. 0: none
+ * @param descending[IN] true to return the tuples in descending order
+ * @param limit[IN] the # tuples to return at most. -1: no limit
+ * @param offset[IN] the # matching tuples to skip first
+ * @return error code. 0 if no error
+ */
+RC QueryCursor::open(const string& table, int attr, const vector<SelCond>& cond,
+                     int order, bool descending, int limit, int offset)
+{
+    RC rc;
+    Table* t = new Table;
+
+    close();
+    if ((rc = t->open(table, 'r')) < 0) {
+        delete t;
+        return rc;
+    }
+    if ((rc = open(*t, attr, cond, order, descending, limit, offset)) < 0) {
+        delete t;
+        return rc;
+    }
+    owned = t;
+    return 0;
+}
+
+/*
+ * Plan a SELECT on an open table.
+ * @param table[IN] the table in the FROM clause
+ * @param attr[IN] attribute in the SELECT clause
+ * @param cond[IN] list of conditions in the WHERE clause, ANDed together
+ * @param order[IN] the attribute in the ORDER BY clause. 0: none
+ * @param descending[IN] true to return the tuples in descending order
+ * @param limit[IN] the # tuples to return at most. -1: no limit
+ * @param offset[IN] the # matching tuples to skip first
+ * @return error code. 0 if no error
+ */
+RC QueryCursor::open(Table& table, int attr, const vector<SelCond>& cond,
+                     int order, bool descending, int limit, int offset)
+{
+    vector<SelCond> residual;  // the conditions that range does not cover
+
+    close();
+    bounded = getKeyRange(cond, range, residual);
+
+    // the conditions are compiled once. what an index path returns is
+    // in range already and checked against the residual conditions only.
+    tupleFilter = new Predicate(cond);
+    residualFilter = new Predicate(residual);
+    return planQuery(table, keysOnly(attr, cond), order, descending, limit, offset);
+}
+
+/*
+ * Plan a SELECT on an open table whose only condition is that key is in
+ * range.
+ * @param table[IN] the table in the FROM clause
+ * @param attr[IN] attribute in the SELECT clause
+ * @param range[IN] the keys to return
+ * @return error code. 0 if no error
+ */
+RC QueryCursor::open(Table& table, int attr, const KeyRange& range)
+{
+    close();
+    this->range = range;
+    bounded = checkRange(range);
+    tupleFilter = new Predicate(range);
+    residualFilter = new Predicate(vector<SelCond>());
+    return planQuery(table, keysOnly(attr, vector<SelCond>()), 0, false, -1, 0);
+}
+
+/*
+ * Return the next batch of the result.
+ * @param batch[OUT] the batch
+ * @return error code. 0 if no error. RC_END_OF_TREE after the last tuple
+ */
+RC QueryCursor::nextBatch(const TupleBatch*& batch)
+{
+    RC rc;
+    pos = this->batch->selCount;
+    if (plan.empty()) return RC_END_OF_TREE;
+    if ((rc = plan.back()->next(*this->batch)) < 0) return rc;
+    batch = this->batch;
+    pos = 0;
+    return 0;
+}
+
+/*
+ * Return the next tuple of the result.
+ * @param key[OUT] the key of the tuple
+ * @param value[OUT] the value of the tuple
+ * @return error code. 0 if no error. RC_END_OF_TREE after the last tuple
+ */
+RC QueryCursor::next(int& key, string_view& value)
+{
+    RC rc;
+    const TupleBatch* b;
+
+    // a batch may select no tuple
+    while (pos >= batch->selCount) {
+        if ((rc = nextBatch(b)) < 0) return rc;
+    }
+
+    int i = batch->sel[pos++];
+    key = batch->keys[i];
+    value = batch->values[i];
+    return 0;
+}
+
+/*
+ * Close the query, and the table if the cursor opened it.
+ */
+void QueryCursor::close()
+{
+    for (unsigned i = 0; i < plan.size(); i++)
+        delete plan[i];
+    plan.clear();
+    delete tupleFilter;
+    delete residualFilter;
+    tupleFilter = residualFilter = NULL;
+    rids.clear();
+    batch->count = batch->selCount = 0;
+    batch->want = TupleBatch::CAPACITY;
+    pos = 0;
+
+    delete owned;
+    table = owned = NULL;
+    rf = NULL;
+    bIndex = NULL;
+    hIndex = NULL;
+    lIndex = NULL;
+    hashed = covered = false;
+}
+
+/*
+ * Output the access path of the open query.
+ * @param info[OUT] the access path
+ */
+void QueryCursor::getPathInfo(PathInfo& info) const
+{
+    info.root = plan.empty() ? NULL : plan.back();
+    info.path = path;
+    info.bIndex = bIndex;
+    info.hashed = hashed;
+    info.covered = covered;
+    info.range = range;
+    info.entries = entries;
+    info.pages = pages;
+    info.rf = rf;
+    info.tupleFilter = tupleFilter;
+    info.residualFilter = residualFilter;
+}
+
+RC QueryCursor::planQuery(Table& table, bool onlyKeys, int order, bool descending, int limit, int offset)
+{
+    RC rc;
+
+    this->table = &table;
+    this->limit = limit;
+    this->offset = offset;
+    this->order = order;
+    this->descending = descending;
+    rf = &table.getRecordFile();
+
+    // an equality condition on key is answered by the hash index if the
+    // table has one, and by the B+tree index otherwise
+    if (bounded > 0 && range.hasLow && range.hasHigh && range.low == range.high)
+        hIndex = table.getHashIndex();
+    hashed = (hIndex != NULL);
+    if (!hashed)
+        bIndex = table.getIndex();
+    if (!hashed && bIndex == NULL)
+        lIndex = table.getLsmIndex();
+
+    // the index holds every key of the table, so a query that needs
+    // nothing but keys never reads a tuple. ORDER BY value needs them.
+    covered = (bIndex != NULL || hashed || lIndex != NULL) && onlyKeys && order != 2;
+
+    const RecordId& end = rf->endRid();
+    pages = end.pid + (end.sid > 0 ? 1 : 0);
+
+    path = FULL_SCAN;
+    if (bIndex != NULL) {
+        IndexStats stats;
+        bIndex->getStats(stats);
+        entries = stats.estimate(range);
+        path = choosePath(stats);
+    } else if (lIndex != NULL)
+        path = chooseLsmPath();
+
+    if ((rc = buildPlan()) < 0)
+        close();
+    return rc;
+}
+
+QueryCursor::AccessPath QueryCursor::choosePath(const IndexStats& stats) const
+{
+    if (covered) return INDEX_ONLY;
+    if (bounded == 0 && order != 1) return FULL_SCAN;  // every tuple matches the key range
+
+    // the index range costs a descent plus its share of the leaves
+    double n = stats.estimate(range);
+    double leaves = n / (BTreeIndex::LeafNode::MAX_KEY_COUNT * BTreeIndex::DEFAULT_FILL_FACTOR);
+    double indexCost = 1 + ceil(leaves);
+
+    // with a limit, the scans stop after the first k matches: the file
+    // scan after the fraction k/n of the table, if the matches are spread
+    // evenly, and the key-order fetch after k tuples. the sorted fetch
+    // still reads the whole index range, but only the pages of the first
+    // k rids in table order.
+    double k = (limit >= 0) ? min(n, (double) offset + limit) : n;
+    double part = (n > 0) ? k / n : 1;
+
+    // a sort reads every match before it returns the first. ORDER BY key
+    // costs the other paths the sort, and ORDER BY value costs all paths.
+    double keyPart = (order == 2) ? 1 : part;
+    double otherPart = (order != 0) ? 1 : part;
+    double sortCost = (order == 1) ? n * SORT_COST : 0;
+
+    double scanCost = pages * otherPart + sortCost;
+    double keyOrderCost = 1 + ceil(leaves * keyPart) + n * keyPart;
+    double sortedCost = indexCost + pages * (1 - exp(-n / max(pages, 1))) * otherPart +
+                        n * SORT_COST + sortCost;
+
+    if (scanCost <= keyOrderCost && scanCost <= sortedCost) return FULL_SCAN;
+    return (sortedCost < keyOrderCost) ? SORTED_FETCH : INDEX_SCAN;
+}
+
+QueryCursor::AccessPath QueryCursor::chooseLsmPath() const
+{
+    // the range is read in table order, which reads no page of the table
+    // file twice, so it costs at most a full scan plus the index range
+    if (covered) return INDEX_ONLY;
+    return (bounded == 0) ? FULL_SCAN : SORTED_FETCH;
+}
+
+RC QueryCursor::buildPlan()
+{
+    RC rc;
+
+    if (bounded < 0) {
+        // the conditions on key contradict each other. nothing matches.
+        return 0;
+    }
+
+    if (hashed) {
+        // the tuples of the one bucket the key hashes to
+        if ((rc = hIndex->lookup(range.low, rids)) < 0 && rc != RC_NO_SUCH_RECORD)
+            return rc;
+        plan.push_back(new RidScan(range.low, rids));
+        if (!covered)
+            plan.push_back(new Fetch(*plan.back(), *rf, sortedFetchPays(rids.size(), pages)));
+    } else if (path != FULL_SCAN) {
+        // scan the index from the lower bound along the leaf chain, or
+        // merge the runs of the LSM index from there
+        if (lIndex != NULL)
+            plan.push_back(new LsmScan(*lIndex, range));
+        else
+            plan.push_back(new IndexScan(*bIndex, range, order == 1 && descending));
+        if (path != INDEX_ONLY)
+            plan.push_back(new Fetch(*plan.back(), *rf, path == SORTED_FETCH));
+    } else {
+        // scan the table file from the beginning
+        plan.push_back(new TableScan(*rf));
+    }
+
+    const Predicate& filter = (path == FULL_SCAN && !hashed) ? *tupleFilter : *residualFilter;
+    if (!filter.empty())
+        plan.push_back(new Filter(*plan.back(), filter));
+
+    // the leaf chain returns the tuples in key order either way, the LSM
+    // index in ascending order, and a hash index the tuples of one key.
+    // anything else is sorted.
+    bool keyOrder = hashed || ((path == INDEX_ONLY || path == INDEX_SCAN) &&
+                               (lIndex == NULL || !descending));
+    if (order == 2 || (order == 1 && !keyOrder))
+        plan.push_back(new Sort(*plan.back(), order, descending,
+                                (limit >= 0) ? offset + limit : -1));
+
+    // stop pulling once the LIMIT is reached
+    if (limit >= 0 || offset > 0)
+        plan.push_back(new Limit(*plan.back(), limit, offset));
+    return 0;
+}
+
+static int getKeyRange(const vector<SelCond>& cond, KeyRange& range, vector<SelCond>& residual)
+{
+    range.hasLow = range.hasHigh = false;
+    range.lowInclusive = range.highInclusive = true;
+    range.low = range.high = 0;
+    residual.clear();
+
+    for (unsigned i = 0; i < cond.size(); i++) {
+        if (cond[i].attr != 1 || cond[i].comp == SelCond::NE) {
+            residual.push_back(cond[i]);
+            continue;
+        }
+        int v = atoi(cond[i].value);
+        bool setLow = false, setHigh = false, inclusive = true;
+        switch (cond[i].comp) {
+            case SelCond::GT: setLow = true;  inclusive = false; break;
+            case SelCond::GE: setLow = true;  break;
+            case SelCond::LT: setHigh = true; inclusive = false; break;
+            case SelCond::LE: setHigh = true; break;
+            case SelCond::EQ: setLow = setHigh = true; break;
+            case SelCond::NE: break;  // not a range. kept in residual
+        }
+        // keep the tighter bound. at the same value exclusive is tighter.
+        if (setLow && (!range.hasLow || v > range.low ||
+                       (v == range.low && !inclusive))) {
+            range.hasLow = true;
+            range.low = v;
+            range.lowInclusive = inclusive;
+        }
+        if (setHigh && (!range.hasHigh || v < range.high ||
+                        (v == range.high && !inclusive))) {
+            range.hasHigh = true;
+            range.high = v;
+            range.highInclusive = inclusive;
+        }
+    }
+
+    return checkRange(range);
+}
+
+static int checkRange(const KeyRange& range)
+{
+    if (range.hasLow && range.hasHigh) {
+        if (range.low > range.high) return -1;
+        if (range.low == range.high && !(range.lowInclusive && range.highInclusive)) return -1;
+    }
+    return (range.hasLow || range.hasHigh) ? 1 : 0;
+}
+
+static bool sortedFetchPays(double n, int pages)
+{
+    if (pages <= 0) return false;
+
+    // in key order nearly every tuple is on a page other than the last
+    // one. n tuples spread evenly in table order fall on this many pages.
+    double distinct = pages * (1 - exp(-n / pages));
+    return distinct + n * SORT_COST < n;
+}
+
+static bool keysOnly(int attr, const vector<SelCond>& cond)
+{
+    // SELECT key and SELECT COUNT(*) print no value
+    if (attr != 1 && attr != 4) return false;
+    for (unsigned i = 0; i < cond.size(); i++) {
+        if (cond[i].attr != 1) return false;
+    }
+    return true;
+}
+
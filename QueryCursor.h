@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#ifndef QUERYCURSOR_H
+#define QUERYCURSOR_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Bruinbase.h"
+#include "SqlEngine.h"
+#include "RecordFile.h"
+#include "BTreeIndex.h"
+#include "HashIndex.h"
+#include "Operator.h"
+#include "Database.h"
+
+/**
+ * A SELECT whose result the caller pulls instead of reading it from
+ * stdout, on a table it opens itself or on a Table handle. open() plans
+ * the query the way SqlEngine::select() does, and nextBatch() or next()
+ * then return the matching tuples as they are read, without formatting
+ * or copying them. The plan runs on the calling thread.
+ */
+class QueryCursor {
+ public:
+  // the ways a query reads a table
+  enum AccessPath {
+    FULL_SCAN,     // read every page of the table file
+    INDEX_ONLY,    // read the keys of the index range, and no tuple
+    INDEX_SCAN,    // read the tuples of the index range in key order
+    SORTED_FETCH   // read the tuples of the index range in table order
+  };
+
+  /**
+   * The access path open() chose, for a caller that runs a large plan on
+   * several threads instead of pulling it through the cursor. The
+   * pointers belong to the cursor and stay valid while it is open.
+   */
+  struct PathInfo {
+    Operator*         root;            // the root of the plan. NULL: nothing matches
+    AccessPath        path;
+    BTreeIndex*       bIndex;          // the B+tree index the path reads, or NULL
+    bool              hashed;          // true: the path reads the hash index
+    bool              covered;         // true: the index alone answers the query
+    KeyRange          range;           // the key range the conditions allow
+    double            entries;         // the estimated # entries in range
+    int               pages;           // the # pages of the table file
+    const RecordFile* rf;              // the table file
+    const Predicate*  tupleFilter;     // all conditions
+    const Predicate*  residualFilter;  // the conditions range does not cover
+  };
+
+  QueryCursor();
+  ~QueryCursor();
+
+  /**
+   * Open the files of table and plan a SELECT on it.
+   * @param table[IN] the table name in the FROM clause
+   * @param attr[IN] attribute in the SELECT clause
+   * (1: key, 2: value, 3: *, 4: count(*)). For 1 and 4 the values are
+   * left empty, so an index may answer the query alone.
+   * @param cond[IN] list of conditions in the WHERE clause, ANDed together
+   * @param order[IN] the attribute in the ORDER BY clause
+   * (0: none, 1: key, 2: value)
+   * @param descending[IN] true to return the tuples in descending order
+   * @param limit[IN] the # tuples to return at most. -1: no limit
+   * @param offset[IN] the # matching tuples to skip first
+   * @return error code. 0 if no error. RC_FILE_OPEN_FAILED if the table
+   * does not exist
+   */
+  RC open(const std::string& table, int attr, const std::vector<SelCond>& cond,
+          int order = 0, bool descending = false, int limit = -1, int offset = 0);
+
+  /**
+   * Plan a SELECT on an open table.
+   * @param table[IN] the table in the FROM clause. It must stay open
+   * while the cursor is
+   * @param attr[IN] attribute in the SELECT clause
+   * (1: key, 2: value, 3: *, 4: count(*))
+   * @param cond[IN] list of conditions in the WHERE clause, ANDed together
+   * @param order[IN] the attribute in the ORDER BY clause
+   * (0: none, 1: key, 2: value)
+   * @param descending[IN] true to return the tuples in descending order
+   * @param limit[IN] the # tuples to return at most. -1: no limit
+   * @param offset[IN] the # matching tuples to skip first
+   * @return error code. 0 if no error
+   */
+  RC open(Table& table, int attr, const std::vector<SelCond>& cond,
+          int order = 0, bool descending = false, int limit = -1, int offset = 0);
+
+  /**
+   * Plan a SELECT on an open table whose only condition is that key is
+   * in range, e.g., for the range that Table::scan() takes.
+   * @param table[IN] the table in the FROM clause. It must stay open
+   * while the cursor is
+   * @param attr[IN] attribute in the SELECT clause
+   * (1: key, 2: value, 3: *, 4: count(*))
+   * @param range[IN] the keys to return
+   * @return error code. 0 if no error
+   */
+  RC open(Table& table, int attr, const KeyRange& range);
+
+  /**
+   * Return the next batch of the result. The tuples at the positions
+   * sel[0..selCount) of the batch match; the batch may select none. It
+   * belongs to the cursor and stays valid until the next call.
+   * @param batch[OUT] the batch
+   * @return error code. 0 if no error. RC_END_OF_TREE after the last tuple
+   */
+  RC nextBatch(const TupleBatch*& batch);
+
+  /**
+   * Return the next tuple of the result. value points into the cursor's
+   * batch and stays valid until the next call to next() or nextBatch().
+   * @param key[OUT] the key of the tuple
+   * @param value[OUT] the value of the tuple
+   * @return error code. 0 if no error. RC_END_OF_TREE after the last tuple
+   */
+  RC next(int& key, std::string_view& value);
+
+  /**
+   * Close the query, and the table if the cursor opened it. The
+   * destructor closes them too.
+   */
+  void close();
+
+  /**
+   * Output the access path of the open query.
+   * @param info[OUT] the access path
+   */
+  void getPathInfo(PathInfo& info) const;
+
+ private:
+  QueryCursor(const QueryCursor&);
+  QueryCursor& operator=(const QueryCursor&);
+
+  // plan the query once range, bounded and the filters are set. a query
+  // that needs nothing but keys may be answered from an index.
+  RC planQuery(Table& table, bool onlyKeys, int order, bool descending, int limit, int offset);
+
+  // choose the cheapest access path from the statistics of the B+tree
+  // index. a covered query is answered from the index. with a limit, a
+  // path that returns the tuples as it reads them stops early. ORDER BY
+  // key comes free along the leaf chain, and the other paths pay for a
+  // sort.
+  AccessPath choosePath(const IndexStats& stats) const;
+
+  // choose the access path of a query on the LSM index, which keeps no
+  // statistics
+  AccessPath chooseLsmPath() const;
+
+  // build the plan bottom-up
+  RC buildPlan();
+
+  Table*                 table;           // the table of the query
+  Table*                 owned;           // the table if the cursor opened it
+  const RecordFile*      rf;              // the table file
+  BTreeIndex*            bIndex;          // the B+tree index the query uses
+  HashIndex*             hIndex;          // the hash index the query uses
+  LsmIndex*              lIndex;          // the LSM index the query uses
+  bool                   hashed;          // true: the query uses hIndex
+  bool                   covered;         // true: the index alone answers the query
+  int                    bounded;         // 1: range bounds key, 0: not, -1: empty
+  KeyRange               range;           // the key range the conditions allow
+  int                    pages;           // the # pages of the table file
+  int                    limit;           // the LIMIT of the query. -1: none
+  int                    offset;          // the OFFSET of the query
+  int                    order;           // the ORDER BY attribute. 0: none
+  bool                   descending;      // true: ORDER BY ... DESC
+  AccessPath             path;
+  double                 entries;         // the estimated # entries in range
+  Predicate*             tupleFilter;     // all conditions
+  Predicate*             residualFilter;  // the conditions range does not cover
+  std::vector<RecordId>  rids;            // the result of a hash index lookup
+  std::vector<Operator*> plan;            // the operators of the plan, leaf first
+  TupleBatch*            batch;           // the batch of next()
+  int                    pos;             // the next position in batch->sel
+};
+
+#endif /* QUERYCURSOR_H */
@@ -7,6 +7,7 @@
  * @date 3/24/2008
  */
 
+#include <cstring>
 #include "Bruinbase.h"
 #include "RecordFile.h"
 
@@ -183,6 +184,31 @@ RC RecordFile::read(const RecordId& rid, int& key, string& value) const
   return 0;
 }
 
+RC RecordFile::read(const RecordId* rids, int n, int* keys, string* values) const
+{
+  RC     rc;
+  char   page[PageFile::PAGE_SIZE];
+  PageId pid = -1;  // the page in the buffer
+
+  for (int i = 0; i < n; i++) {
+    // check whether the rid is in the valid range
+    if (rids[i].pid < 0 || rids[i].pid > erid.pid) return RC_INVALID_RID;
+    if (rids[i].sid < 0 || rids[i].sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
+    if (rids[i] >= erid) return RC_INVALID_RID;
+
+    // read the page containing the record unless it is in the buffer
+    if (rids[i].pid != pid) {
+      if ((rc = pf.read(rids[i].pid, page)) < 0) return rc;
+      pid = rids[i].pid;
+    }
+
+    // read the record from the slot in the page
+    readSlot(page, rids[i].sid, keys[i], values[i]);
+  }
+
+  return 0;
+}
+
 RC RecordFile::append(int key, const std::string& value, RecordId& rid)
 {
   RC   rc;
@@ -79,6 +79,17 @@ class RecordFile {
    */
   RC read(const RecordId& rid, int& key, std::string& value) const;
 
+  /**
+   * read n records from the file. the page of a run of rids on the same
+   * page is read once, so rids sorted by pid read every page only once.
+   * @param rids[IN] the ids of the records to read
+   * @param n[IN] the number of records to read
+   * @param keys[OUT] keys[i] is the key of rids[i]
+   * @param values[OUT] values[i] is the value of rids[i]
+   * @return error code. 0 if no error
+   */
+  RC read(const RecordId* rids, int n, int* keys, std::string* values) const;
+
   /**
    * append a new record at the end of the file.
    * note that RecordFile does not have write() function.
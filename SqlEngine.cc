@@ -11,8 +11,14 @@
 #include <iostream>
 #include <fstream>
 #include <climits>
+#include <cmath>
+#include <algorithm>
+#include <unistd.h>
 #include "Bruinbase.h"
 #include "SqlEngine.h"
+#include "Operator.h"
+#include "QueryCursor.h"
+#include "Database.h"
 
  using namespace std;
 
@@ -20,6 +26,48 @@
  extern FILE* sqlin;
  int sqlparse(void);
 
+//
+// helper functions for select
+//
+
+// the tables the statements of this session have opened. a table stays
+// open from one SELECT to the next until LOAD changes it.
+static Database session;
+
+// the tuples of a load file, one per line
+class LoadFileSource : public TupleSource {
+ public:
+    explicit LoadFileSource(ifstream& file) : file(file) { }
+
+    RC next(int& key, string& value)
+    {
+        string line;
+        getline(file, line);
+        if (!file.good())
+            return RC_END_OF_TREE;
+        SqlEngine::parseLoadLine(line, key, value);
+        return 0;
+    }
+
+ private:
+    ifstream& file;
+};
+
+// the # threads to scan a table of the given # pages with: one per core,
+// but no more than the table has morsels
+static int scanThreads(int pages);
+
+// the # threads to scan an index range of about n entries with: one per
+// core, but no more than the range has morsels of MORSEL_LEAVES leaves
+static int indexThreads(double n);
+
+// the # leaves of an index range a thread should get at least
+static const int MORSEL_LEAVES = 16;
+
+// the # sub-ranges per thread an index range is cut into, so that a
+// thread done early takes another one
+static const int RANGES_PER_THREAD = 4;
+
 
  RC SqlEngine::run(FILE* commandline)
  {
@@ -33,252 +81,133 @@
     return 0;
 }
 
-RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
+SqlEngine::OutputFormat SqlEngine::outputFormat = SqlEngine::TEXT_OUTPUT;
+
+void SqlEngine::setOutputFormat(OutputFormat format)
+{
+    outputFormat = format;
+}
+
+RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond,
+                     int order, bool descending, int limit, int offset)
 {
-    RecordFile rf;   // RecordFile containing the table
-    RecordId   rid;  // record cursor for table scanning
-    BTreeIndex bIndex; // B+Tree index file
-    bool index = true;
+    Table* t;            // the table in the catalog of the session
+    QueryCursor cursor;  // the plan of the query
+    QueryCursor::PathInfo info;  // the access path of the plan
     RC     rc;
-    int    key;     
-    string value;
     int    count;
-    int    diff;
-    
-    // open the table file
-    if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
-        fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
-        return rc;
-    }
-    if ((bIndex.open(table + ".idx", 'r')) < 0)
-        index = false;
+    int    threads;
+    vector<int> splitKeys;     // the keys to cut the range at for threads
+    bool   limited;            // true: LIMIT or OFFSET cut the tuples
+    ResultSink sink(STDOUT_FILENO, outputFormat, attr);  // where the result goes
     
-    // scan the table file from the beginning
-
     count = 0;
-    if(index) 
-    {
-        int start = -1;
-        int end = INT_MAX;
-        int eql = -1;
-        bool notEqual = true; 
-        for (unsigned i = 0; i < cond.size(); i++) {
-            int newKey = atoi(cond[i].value);
-            switch (cond[i].comp) {
-                case SelCond::GT: 
-                    if(start <= newKey)
-                        start = newKey + 1;
-                    break;
-                case SelCond::GE:
-                    if(start < newKey)
-                        start = newKey;
-                    break;
-                case SelCond::LT:
-                    if(end >= newKey)
-                        end = newKey - 1;
-                    break;
-                case SelCond::LE:
-                    if(end > newKey)
-                        end = newKey;
-                    break;
-                case SelCond::EQ:
-                    if(newKey < start || newKey > end) {
-                        start = end = -1 ;
-                        notEqual = false;
-                    }
-                    else {
-                        if(eql == -1 || eql == newKey)
-                            start = end = eql = newKey;
-                        else
-                            notEqual = false;
-                    }
-                    break;
-                //case SelCond::NE:
-            }
-        }
-        fprintf(stdout, "start: %d\n end: %d\n", start, end );
-
-        if(notEqual) {
-            IndexCursor cursor;
-            if(start != -1 && end != INT_MAX) {
-                for (int i = start; i <= end; i++) {
-                    // i = searchKey   
-                    if((bIndex.locate(i, cursor)) == 0) {
-                        bIndex.readForward(cursor, key, rid); 
-                        if( key == i) {        
-                            if ((rc = rf.read(rid, key, value)) < 0) {
-                                fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-                                goto exit_select;
-                            }
-                            // print the tuple 
-                            switch (attr) {
-                                case 1:  // SELECT key
-                                fprintf(stdout, "%d\n", key);
-                                break;
-                                case 2:  // SELECT value
-                                fprintf(stdout, "%s\n", value.c_str());
-                                break;
-                                case 3:  // SELECT *
-                                fprintf(stdout, "%d '%s'\n", key, value.c_str());
-                                break;
-                            }
-                        }
-                    }
-
-                }
-            } else if (start != -1 && end == INT_MAX) {
-                int i = start;
-                for (;;) {
-
-                    // If it reaches NULL,  break out
-                }
-            } else if(start == -1 && end != INT_MAX) {
-                for (int i = 0; i <= end; i++) {
-
-                }
-            } else  {
-                int i = 0;
-                // select * from movie; No condition; go through all the tuples
-                for (;;) {
-                    //If it reaches NULL, break out
-                }
-
-            }
 
+    // COUNT(*) counts every match. its LIMIT and OFFSET apply to the one
+    // row of the count.
+    limited = (attr != 4 && (limit >= 0 || offset > 0));
+    if (attr == 4) order = 0;  // the count is the same in any order
 
+    // get the open table and index files and plan the query
+    if ((rc = session.getTable(table, t)) < 0) {
+        fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+        goto exit_select;
+    }
+    if ((rc = cursor.open(*t, attr, cond, order, descending,
+                          limited ? limit : -1, limited ? offset : 0)) < 0) {
+        fprintf(stderr, "Error: while reading the index of table %s\n", table.c_str());
+        goto exit_select;
+    }
+    cursor.getPathInfo(info);
+
+    if (info.root == NULL) {
+        // the conditions on key contradict each other. nothing matches.
+    } else if (info.bIndex != NULL && info.path == QueryCursor::INDEX_ONLY &&
+               attr == 4 && cond.empty()) {
+        // the index keeps the # tuples in its first page
+        count = info.bIndex->getRowCount();
+    } else if (limited || order != 0) {
+        // the scan stops at the limit, which the threads would overrun,
+        // and the threads would lose the order
+        Output output(*info.root, sink);
+        if ((rc = output.run(count)) < 0) {
+            fprintf(stderr, "Error: while reading table %s\n", table.c_str());
+            goto exit_select;
         }
-    } 
-                    //     
-            //     bIndex.readForward(cursor, key, rid);
-
-    else {
-        rid.pid = rid.sid = 0;
-        while (rid < rf.endRid()) {
-            // read the tuple
-            if ((rc = rf.read(rid, key, value)) < 0) {
-                fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-                goto exit_select;
-            }
-            
-            // check the conditions on the tuple
-            for (unsigned i = 0; i < cond.size(); i++) {
-                // compute the difference between the tuple value and the condition value
-                switch (cond[i].attr) {
-                    case 1:
-                    diff = key - atoi(cond[i].value);
-                    break;
-                    case 2:
-                    diff = strcmp(value.c_str(), cond[i].value);
-                    break;
-                }
-                
-                // skip the tuple if any condition is not met
-                switch (cond[i].comp) {
-                    case SelCond::EQ:
-                    if (diff != 0) goto next_tuple;
-                    break;
-                    case SelCond::NE:
-                    if (diff == 0) goto next_tuple;
-                    break;
-                    case SelCond::GT:
-                    if (diff <= 0) goto next_tuple;
-                    break;
-                    case SelCond::LT:
-                    if (diff >= 0) goto next_tuple;
-                    break;
-                    case SelCond::GE:
-                    if (diff < 0) goto next_tuple;
-                    break;
-                    case SelCond::LE:
-                    if (diff > 0) goto next_tuple;
-                    break;
-                }
-            }
-            
-            // the condition is met for the tuple. 
-            // increase matching tuple counter
-            count++;
-            
-            // print the tuple 
-            switch (attr) {
-                case 1:  // SELECT key
-                fprintf(stdout, "%d\n", key);
-                break;
-                case 2:  // SELECT value
-                fprintf(stdout, "%s\n", value.c_str());
-                break;
-                case 3:  // SELECT *
-                fprintf(stdout, "%d '%s'\n", key, value.c_str());
-                break;
-            }
-            
-            // move to the next tuple
-            next_tuple:
-            ++rid;
+    } else if (info.bIndex != NULL && info.path != QueryCursor::FULL_SCAN &&
+               (threads = indexThreads(info.entries)) > 1 &&
+               info.bIndex->getSplitKeys(info.range, threads * RANGES_PER_THREAD, splitKeys) == 0 &&
+               !splitKeys.empty()) {
+        // scan the sub-ranges of a large index range on every core
+        ParallelIndexScan scan(*info.bIndex, info.range, splitKeys,
+                               info.covered ? NULL : info.rf,
+                               info.path == QueryCursor::SORTED_FETCH, *info.residualFilter, sink);
+        if ((rc = scan.run(threads, count)) < 0) {
+            fprintf(stderr, "Error: while reading table %s\n", table.c_str());
+            goto exit_select;
         }
-        
-        // print matching tuple count if "select count(*)"
-        if (attr == 4) {
-            fprintf(stdout, "%d\n", count);
+    } else if (info.path == QueryCursor::FULL_SCAN && !info.hashed &&
+               (threads = scanThreads(info.pages)) > 1) {
+        // scan the morsels of a large table on every core
+        ParallelScan scan(*info.rf, *info.tupleFilter, sink);
+        if ((rc = scan.run(threads, count)) < 0) {
+            fprintf(stderr, "Error: while reading table %s\n", table.c_str());
+            goto exit_select;
+        }
+    } else {
+        // run the plan of the cursor on this thread
+        Output output(*info.root, sink);
+        if ((rc = output.run(count)) < 0) {
+            fprintf(stderr, "Error: while reading table %s\n", table.c_str());
+            goto exit_select;
         }
-        rc = 0;
     }
 
-    // close the table file and return
+    // print matching tuple count if "select count(*)"
+    if (attr == 4 && offset == 0 && limit != 0) {
+        sink.writeCount(count);
+    }
+    if ((rc = sink.flush()) < 0) {
+        fprintf(stderr, "Error: while writing the result\n");
+        goto exit_select;
+    }
+
+    // the table stays open in the catalog
     exit_select:
-    rf.close();
     return rc;
 }
 
-RC SqlEngine::load(const string& table, const string& loadfile, bool index)
+static int scanThreads(int pages)
 {
-    ifstream   inputFile;
-    RecordFile rf;
-    BTreeIndex bIndex; 
-    RecordId   rid;
-    RC      rc;
-    
-    if((rc = rf.open(table + ".tbl", 'w')) < 0) {
-        fprintf(stderr, "Error while creating table %s\n", table.c_str());
-        return rc;
-    }
+    int morsels = (pages + ParallelScan::MORSEL_PAGES - 1) / ParallelScan::MORSEL_PAGES;
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    return max(1, min(cores, morsels));
+}
 
-    if(index) {
-        if((rc = bIndex.open(table+".idx", 'w'))<0) {
-            fprintf(stderr, "Error while indexing table %s\n", table.c_str());
-            return rc;
-        }
-    }
+static int indexThreads(double n)
+{
+    double leaves = n / (BTreeIndex::LeafNode::MAX_KEY_COUNT * BTreeIndex::DEFAULT_FILL_FACTOR);
+    int morsels = (int) (leaves / MORSEL_LEAVES);
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    return max(1, min(cores, morsels));
+}
 
+RC SqlEngine::load(const string& table, const string& loadfile, IndexType index)
+{
+    ifstream   inputFile;
+    RC      rc;
 
     inputFile.open(loadfile.c_str());
     if(!inputFile.is_open()) {
         fprintf(stderr, "Error Opening File");
-        goto exit_select;
+        return 0;
     }
-    while (1) {
-        string line;
-        int     key;
-        string  value;
-        getline (inputFile, line);
-        if(!inputFile.good())
-            break;
-        parseLoadLine(line, key, value);
-        if(rf.append(key, value, rid) < 0)
-        { 
-            fprintf(stderr, "Error appending tuple");
-            goto exit_select;
-        }
-        if(index) {
-            bIndex.insert(key, rid);
-        }
 
-    }
+    LoadFileSource source(inputFile);
+    if((rc = session.loadTable(table, index, source)) < 0)
+        fprintf(stderr, "Error while loading table %s\n", table.c_str());
 
-    exit_select:
     inputFile.close();
-    rf.close();
-    bIndex.close();
     return rc;
 }
 
@@ -14,6 +14,7 @@
 #include "Bruinbase.h"
 #include "RecordFile.h"
 #include "BTreeIndex.h"
+#include "HashIndex.h"
 
 /**
  * data structure to represent a condition in the WHERE clause
@@ -29,6 +30,26 @@ struct SelCond {
  */
 class SqlEngine {
  public:
+
+  /**
+   * the index that LOAD builds on the key column
+   */
+  enum IndexType {
+    NO_INDEX,       // no "WITH ... INDEX" option
+    BTREE_INDEX,    // "WITH INDEX"
+    BUFFERED_INDEX, // "WITH BUFFERED INDEX": a B+tree in buffered mode
+    HASH_INDEX,     // "WITH HASH INDEX": a hash index in <table>.hash
+    LSM_INDEX       // "WITH LSM INDEX": an LSM index in <table>.lsm
+  };
+
+  /**
+   * the format SELECT prints its result in
+   */
+  enum OutputFormat {
+    TEXT_OUTPUT,    // key 'value', a tuple per line (the default)
+    TSV_OUTPUT,     // key<TAB>value, a tuple per line
+    BINARY_OUTPUT   // a 4-byte key, and a 4-byte length before a value
+  };
     
   /**
    * takes the user commands from commandline and executes them.
@@ -47,18 +68,25 @@ class SqlEngine {
    * (1: key, 2: value, 3: *, 4: count(*))
    * @param table[IN] the table name in the FROM clause
    * @param conds[IN] list of conditions in the WHERE clause
+   * @param order[IN] the attribute in the ORDER BY clause
+   * (0: none, 1: key, 2: value)
+   * @param descending[IN] true for ORDER BY ... DESC
+   * @param limit[IN] the # tuples to print at most, from the LIMIT clause.
+   * -1: no limit
+   * @param offset[IN] the # matching tuples to skip, from the OFFSET clause
    * @return error code. 0 if no error
    */
-  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds);
+  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds,
+                   int order = 0, bool descending = false, int limit = -1, int offset = 0);
 
   /**
    * load a table from a load file.
    * @param table[IN] the table name in the LOAD command
    * @param loadfile[IN] the file name of the load file
-   * @param index[IN] true if "WITH INDEX" option was specified
+   * @param index[IN] the index to build, from the "WITH ... INDEX" option
    * @return error code. 0 if no error
    */
-  static RC load(const std::string& table, const std::string& loadfile, bool index);
+  static RC load(const std::string& table, const std::string& loadfile, IndexType index);
 
   /**
    * parse a line from the load file into the (key, value) pair.
@@ -68,6 +96,15 @@ class SqlEngine {
    * @return error code. 0 if no error
    */
   static RC parseLoadLine(const std::string& line, int& key, std::string& value);
+
+  /**
+   * set the format of the result of later SELECTs.
+   * @param format[IN] the output format
+   */
+  static void setOutputFormat(OutputFormat format);
+
+ private:
+  static OutputFormat outputFormat;  // the format of SELECT results
 };
 
 #endif /* SQLENGINE_H */
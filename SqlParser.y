@@ -1,6 +1,8 @@
 %{
 #include <cstdio>
 #include <cstring>
+#include <cstdlib>
+#include <unistd.h>
 #include <sys/times.h>
 #include <climits>
 #include <string>
@@ -12,7 +14,8 @@ int  sqllex(void);
 void sqlerror(const char *str) { fprintf(stderr, "Error: %s\n", str); }
 extern "C" { int  sqlwrap() { return 1; } }
 
-static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds)
+static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds,
+                      int order, int limit, int offset)
 {
   struct tms tmsbuf;
   clock_t btime, etime;
@@ -20,7 +23,7 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
 
   btime = times(&tmsbuf);
   bpagecnt = PageFile::getPageReadCount();
-  SqlEngine::select(attr, table, conds);
+  SqlEngine::select(attr, table, conds, abs(order), order < 0, limit, offset);
   etime = times(&tmsbuf);
   epagecnt = PageFile::getPageReadCount();
 
@@ -36,12 +39,13 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
   std::vector<SelCond>* conds;
 }
 
-%token SELECT FROM WHERE LOAD WITH INDEX QUIT COUNT AND OR 
+%token SELECT FROM WHERE LOAD WITH INDEX BUFFERED HASH LSM QUIT COUNT AND OR 
+%token LIMIT OFFSET ORDER BY ASC DESC
 %token COMMA STAR LF
 %token <string> INTEGER STRING ID
 %token EQUAL NEQUAL LESS LESSEQUAL GREATER GREATEREQUAL 
 
-%type <integer> attributes attribute comparator
+%type <integer> attributes attribute comparator opt_order direction opt_limit opt_offset
 %type <string> table value
 %type <cond> condition
 %type <conds> conditions
@@ -66,25 +70,40 @@ quit_command:
 
 load_command:
 	LOAD table FROM STRING LF { 
-	  SqlEngine::load(std::string($2), std::string($4), false); 
+	  SqlEngine::load(std::string($2), std::string($4), SqlEngine::NO_INDEX); 
 	  free($2);
 	  free($4);
 	}
 	| LOAD table FROM STRING WITH INDEX LF { 
-	  SqlEngine::load(std::string($2), std::string($4), true); 
+	  SqlEngine::load(std::string($2), std::string($4), SqlEngine::BTREE_INDEX); 
+	  free($2);
+	  free($4);
+	}
+	| LOAD table FROM STRING WITH BUFFERED INDEX LF { 
+	  SqlEngine::load(std::string($2), std::string($4), SqlEngine::BUFFERED_INDEX); 
+	  free($2);
+	  free($4);
+	}
+	| LOAD table FROM STRING WITH HASH INDEX LF { 
+	  SqlEngine::load(std::string($2), std::string($4), SqlEngine::HASH_INDEX); 
+	  free($2);
+	  free($4);
+	}
+	| LOAD table FROM STRING WITH LSM INDEX LF { 
+	  SqlEngine::load(std::string($2), std::string($4), SqlEngine::LSM_INDEX); 
 	  free($2);
 	  free($4);
 	}
 	;
 
 select_command:
-	SELECT attributes FROM table LF {
+	SELECT attributes FROM table opt_order opt_limit opt_offset LF {
    	        std::vector<SelCond> conds;
-		runSelect($2, $4, conds);
+		runSelect($2, $4, conds, $5, $6, $7);
 		free($4);
 	}
-	| SELECT attributes FROM table WHERE conditions LF {
-	        runSelect($2, $4, *$6);
+	| SELECT attributes FROM table WHERE conditions opt_order opt_limit opt_offset LF {
+	        runSelect($2, $4, *$6, $7, $8, $9);
 	  	free($4);
 	  	for (unsigned i = 0; i < $6->size(); i++) {
 		    free((*$6)[i].value);
@@ -93,6 +112,36 @@ select_command:
 	}
 	;
 
+opt_order:
+	/* the attribute, negative for DESC */
+	ORDER BY attribute direction { $$ = $3 * $4; }
+	| { $$ = 0; }
+	;
+
+direction:
+	ASC { $$ = 1; }
+	| DESC { $$ = -1; }
+	| { $$ = 1; }
+	;
+
+opt_limit:
+	LIMIT INTEGER {
+		$$ = atoi($2);
+		if ($$ < 0) { sqlerror("negative LIMIT"); $$ = 0; }
+		free($2);
+	}
+	| { $$ = -1; }
+	;
+
+opt_offset:
+	OFFSET INTEGER {
+		$$ = atoi($2);
+		if ($$ < 0) { sqlerror("negative OFFSET"); $$ = 0; }
+		free($2);
+	}
+	| { $$ = 0; }
+	;
+
 conditions:
 	condition {
 	  std::vector<SelCond>* v = new std::vector<SelCond>;
@@ -7,11 +7,28 @@
  * @date 3/24/2008
  */
  
+#include <cstdio>
+#include <cstring>
 #include "Bruinbase.h"
 #include "SqlEngine.h"
 
-int main()
+int main(int argc, char* argv[])
 {
+  // "-f text|tsv|binary" chooses the format of SELECT results
+  for (int i = 1; i < argc; i++) {
+    const char* format = (strcmp(argv[i], "-f") == 0 && i + 1 < argc) ? argv[++i] : "";
+    if (strcmp(format, "text") == 0)
+      SqlEngine::setOutputFormat(SqlEngine::TEXT_OUTPUT);
+    else if (strcmp(format, "tsv") == 0)
+      SqlEngine::setOutputFormat(SqlEngine::TSV_OUTPUT);
+    else if (strcmp(format, "binary") == 0)
+      SqlEngine::setOutputFormat(SqlEngine::BINARY_OUTPUT);
+    else {
+      fprintf(stderr, "usage: %s [-f text|tsv|binary]\n", argv[0]);
+      return 1;
+    }
+  }
+
   // run the SQL engine taking user commands from standard input (console).
   SqlEngine::run(stdin);
 
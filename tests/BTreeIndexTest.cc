@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+#include <pthread.h>
+#include "BTreeIndex.h"
+#include "Test.h"
+
+using namespace std;
+
+static TestDir dir;
+
+// the # copies of DUP_KEY that the tests insert
+static const int DUP_COUNT = 300;
+static const int DUP_KEY = 5;
+
+// the # threads of the concurrent test, and the # keys each inserts
+static const int THREADS = 4;
+static const int THREAD_KEYS = 5000;
+
+static RecordId ridOf(int i)
+{
+    RecordId rid;
+    rid.pid = i / 10;
+    rid.sid = i % 10;
+    return rid;
+}
+
+static int numberOf(const RecordId& rid)
+{
+    return rid.pid * 10 + rid.sid;
+}
+
+static KeyRange between(bool hasLow, int low, bool lowInclusive,
+                        bool hasHigh, int high, bool highInclusive)
+{
+    KeyRange range;
+    range.hasLow = hasLow;
+    range.low = low;
+    range.lowInclusive = lowInclusive;
+    range.hasHigh = hasHigh;
+    range.high = high;
+    range.highInclusive = highInclusive;
+    return range;
+}
+
+// the numbers of the rids of the entries with key, from locate() and
+// readForward()
+static vector<int> readByCursor(BTreeIndex& index, int key)
+{
+    vector<int> found;
+    IndexCursor cursor;
+    int k;
+    RecordId rid;
+
+    if (index.locate(key, cursor) != 0) return found;
+    while (index.readForward(cursor, k, rid) == 0 && k == key)
+        found.push_back(numberOf(rid));
+    return found;
+}
+
+// the # entries of an IndexRangeScan over range, checking their order
+static int scanCount(BTreeIndex& index, const KeyRange& range, bool reverse)
+{
+    IndexRangeScan scan;
+    int key, last = 0, n = 0;
+    RecordId rid;
+
+    CHECK_EQ(0, scan.open(index, range, reverse));
+    while (scan.next(key, rid) == 0) {
+        if (n > 0)
+            CHECK(reverse ? key <= last : key >= last);
+        last = key;
+        n++;
+    }
+    return n;
+}
+
+// insert the copies of DUP_KEY between other keys on both sides of it,
+// so that they span several leaves and become keys of nonleaf nodes
+static void insertDuplicates(BTreeIndex& index)
+{
+    for (int i = 0; i < DUP_COUNT; i++) {
+        CHECK_EQ(0, index.insert(DUP_KEY, ridOf(i)));
+        CHECK_EQ(0, index.insert(i % DUP_KEY, ridOf(1000 + i)));
+        CHECK_EQ(0, index.insert(DUP_KEY + 1 + i, ridOf(2000 + i)));
+    }
+}
+
+// check that lookupBatch() returns the first entry with each key, the
+// one that locate() finds, for the keys low..high in a scrambled order
+static void checkLookupBatch(BTreeIndex& index, int low, int high)
+{
+    int n = high - low + 1;
+    vector<int> keys(n);
+    vector<RecordId> out(n);
+    bool* found = new bool[n];
+
+    for (int i = 0; i < n; i++)
+        keys[i] = low + (int) ((i * 7919LL) % n);
+    CHECK_EQ(0, index.lookupBatch(&keys[0], n, &out[0], found));
+    for (int i = 0; i < n; i++) {
+        vector<int> expected = readByCursor(index, keys[i]);
+        CHECK_EQ(!expected.empty(), found[i]);
+        if (found[i] && !expected.empty())
+            CHECK_EQ(expected[0], numberOf(out[i]));
+    }
+    delete[] found;
+}
+
+static void checkDuplicates(BTreeIndex& index)
+{
+    checkLookupBatch(index, -1, DUP_KEY + DUP_COUNT + 1);
+
+    vector<int> found = readByCursor(index, DUP_KEY);
+    CHECK_EQ(DUP_COUNT, found.size());
+    sort(found.begin(), found.end());
+    for (unsigned i = 0; i < found.size(); i++)
+        CHECK_EQ(i, found[i]);
+
+    for (int reverse = 0; reverse < 2; reverse++) {
+        CHECK_EQ(DUP_COUNT, scanCount(index, between(true, DUP_KEY, true, true, DUP_KEY, true), reverse));
+        CHECK_EQ(DUP_COUNT, scanCount(index, between(true, DUP_KEY - 1, false, true, DUP_KEY + 1, false), reverse));
+        CHECK_EQ(2 * DUP_COUNT, scanCount(index, between(true, 0, true, true, DUP_KEY, true), reverse));
+        CHECK_EQ(2 * DUP_COUNT, scanCount(index, between(true, DUP_KEY, true, false, 0, true), reverse));
+        CHECK_EQ(DUP_COUNT, scanCount(index, between(true, DUP_KEY, false, false, 0, true), reverse));
+        CHECK_EQ(DUP_COUNT, scanCount(index, between(false, 0, true, true, DUP_KEY, false), reverse));
+        CHECK_EQ(3 * DUP_COUNT, scanCount(index, between(false, 0, true, false, 0, true), reverse));
+    }
+}
+
+static void testInsertedDuplicates()
+{
+    BTreeIndex index;
+    CHECK_EQ(0, index.open(dir.path("inserted.idx"), 'w'));
+    insertDuplicates(index);
+    checkDuplicates(index);
+    CHECK_EQ(0, index.close());
+
+    CHECK_EQ(0, index.open(dir.path("inserted.idx"), 'r'));
+    checkDuplicates(index);
+    CHECK_EQ(0, index.close());
+}
+
+static void testBufferedDuplicates()
+{
+    BTreeIndex index;
+    CHECK_EQ(0, index.open(dir.path("buffered.idx"), 'w'));
+    CHECK_EQ(0, index.setBuffered(true));
+    insertDuplicates(index);
+    checkDuplicates(index);
+    CHECK_EQ(0, index.close());
+}
+
+static void testBulkLoadedDuplicates()
+{
+    const int keys = 100, copies = 50;
+    vector<BTreeIndex::IndexEntry> entries;
+    for (int i = 0; i < keys * copies; i++) {
+        BTreeIndex::IndexEntry e = { i / copies, ridOf(i) };
+        entries.push_back(e);
+    }
+
+    BTreeIndex index;
+    CHECK_EQ(0, index.open(dir.path("bulk.idx"), 'w'));
+    CHECK_EQ(0, index.bulkLoad(&entries[0], entries.size()));
+    for (int k = 0; k < keys; k++) {
+        vector<int> found = readByCursor(index, k);
+        CHECK_EQ(copies, found.size());
+        for (unsigned i = 0; i < found.size(); i++)
+            CHECK_EQ(k, found[i] / copies);
+        CHECK_EQ(copies, scanCount(index, between(true, k, true, true, k, true), false));
+        CHECK_EQ(copies, scanCount(index, between(true, k, true, true, k, true), true));
+    }
+    checkLookupBatch(index, -1, keys);
+
+    // more copies inserted into the bulk-loaded tree
+    for (int i = 0; i < DUP_COUNT; i++)
+        CHECK_EQ(0, index.insert(keys / 2, ridOf(10000 + i)));
+    CHECK_EQ(copies + DUP_COUNT, readByCursor(index, keys / 2).size());
+    CHECK_EQ(copies + DUP_COUNT, scanCount(index, between(true, keys / 2, true, true, keys / 2, true), false));
+    CHECK_EQ(copies, scanCount(index, between(true, keys / 2 - 1, true, true, keys / 2, false), false));
+    CHECK_EQ(copies, scanCount(index, between(true, keys / 2, false, true, keys / 2 + 1, true), true));
+    CHECK_EQ(0, index.close());
+}
+
+// what one thread of testConcurrentInserts does
+struct Worker {
+    BTreeIndex* index;
+    int         t;          // the thread inserts the keys k with k % THREADS == t
+    int         errors;     // the # failed inserts and lookups
+    int         misordered; // the # scans that read keys out of order
+};
+
+static void* work(void* arg)
+{
+    Worker* w = (Worker*) arg;
+    IndexRangeScan scan;
+    int key;
+    RecordId rid;
+    bool found;
+
+    for (int i = 0; i < THREAD_KEYS; i++) {
+        int k = (int) ((i * 7919LL) % THREAD_KEYS) * THREADS + w->t;
+        if (w->index->insert(k, ridOf(k)) != 0)
+            w->errors++;
+
+        // every key the thread inserted so far is found, whatever the
+        // other threads split meanwhile
+        int j = (int) ((i / 2 * 7919LL) % THREAD_KEYS) * THREADS + w->t;
+        if (w->index->lookupBatch(&j, 1, &rid, &found) != 0 || !found || numberOf(rid) != j)
+            w->errors++;
+        int n = 0;
+        if (scan.open(*w->index, between(true, j, true, true, j, true), i % 2) != 0)
+            w->errors++;
+        while (scan.next(key, rid) == 0)
+            n += (key == j && numberOf(rid) == j) ? 1 : THREADS * THREAD_KEYS;
+        if (n != 1)
+            w->errors++;
+
+        // and a short scan reads the keys of its range in order
+        if (i % 16 == 0) {
+            bool reverse = (i % 32 == 0);
+            int last = reverse ? k + 50 : k - 50;
+            if (scan.open(*w->index, between(true, k - 50, true, true, k + 50, true), reverse) != 0)
+                w->errors++;
+            while (scan.next(key, rid) == 0) {
+                if (reverse ? key > last : key < last)
+                    w->misordered++;
+                last = key;
+            }
+        }
+    }
+    return NULL;
+}
+
+// threads that insert into one index and look up and scan their keys at
+// the same time
+static void testConcurrentInserts()
+{
+    BTreeIndex index;
+    Worker     workers[THREADS];
+    pthread_t  threads[THREADS];
+
+    CHECK_EQ(0, index.open(dir.path("concurrent.idx"), 'w'));
+    for (int t = 0; t < THREADS; t++) {
+        Worker w = { &index, t, 0, 0 };
+        workers[t] = w;
+        CHECK_EQ(0, pthread_create(&threads[t], NULL, work, &workers[t]));
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        CHECK_EQ(0, workers[t].errors);
+        CHECK_EQ(0, workers[t].misordered);
+    }
+
+    // every key is in the index once, in order
+    IndexCursor cursor;
+    int key, n = 0;
+    RecordId rid;
+    CHECK_EQ(0, index.locate(INT_MIN, cursor));
+    while (index.readForward(cursor, key, rid) == 0) {
+        CHECK_EQ(n, key);
+        CHECK_EQ(n, numberOf(rid));
+        n++;
+    }
+    CHECK_EQ(THREADS * THREAD_KEYS, n);
+    CHECK_EQ(THREADS * THREAD_KEYS, index.getRowCount());
+    CHECK_EQ(0, index.close());
+}
+
+int main()
+{
+    RUN(testInsertedDuplicates);
+    RUN(testBufferedDuplicates);
+    RUN(testBulkLoadedDuplicates);
+    RUN(testConcurrentInserts);
+    return testResult();
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include <climits>
+#include <vector>
+#include "LsmIndex.h"
+#include "Test.h"
+
+using namespace std;
+
+static TestDir dir;
+
+// the # distinct keys and the # copies of each that the tests insert
+static const int KEYS = 5000;
+static const int COPIES = 3;
+
+// a memtable this small is written out and compacted many times
+static const int SMALL_MEMTABLE = 200;
+
+static RecordId ridOf(int i)
+{
+    RecordId rid;
+    rid.pid = i / 10;
+    rid.sid = i % 10;
+    return rid;
+}
+
+// insert the copies of the keys 0..KEYS-1 in a scrambled order, each
+// copy with a rid of its own
+static void insertKeys(LsmIndex& index, int copy)
+{
+    for (int i = 0; i < KEYS; i++) {
+        int key = (int) ((i * 7919LL) % KEYS);
+        CHECK_EQ(0, index.insert(key, ridOf(copy * KEYS + key)));
+    }
+}
+
+// the # entries from locate(searchKey) up to and including high,
+// checking that they come in (key, rid) order
+static int scanCount(LsmIndex& index, int searchKey, int high)
+{
+    LsmCursor cursor;
+    LsmIndex::Entry last = { 0, { 0, 0 } }, e;
+    int n = 0;
+
+    if (index.locate(searchKey, cursor) != 0) return 0;
+    while (index.readForward(cursor, e.key, e.rid) == 0 && e.key <= high) {
+        CHECK(e.key >= searchKey);
+        if (n > 0)
+            CHECK(last < e);
+        last = e;
+        n++;
+    }
+    return n;
+}
+
+static void checkKeys(LsmIndex& index, int copies)
+{
+    RecordId rid;
+    for (int k = 0; k < KEYS; k += 37) {
+        CHECK_EQ(0, index.lookup(k, rid));
+        CHECK_EQ(k, (rid.pid * 10 + rid.sid) % KEYS);
+        CHECK_EQ(copies, scanCount(index, k, k));
+    }
+    CHECK_EQ(RC_NO_SUCH_RECORD, index.lookup(KEYS, rid));
+    CHECK_EQ(RC_NO_SUCH_RECORD, index.lookup(-1, rid));
+
+    CHECK_EQ(copies * KEYS, scanCount(index, INT_MIN, INT_MAX));
+    CHECK_EQ(copies * KEYS / 2, scanCount(index, KEYS / 2, INT_MAX));
+    CHECK_EQ(copies * 100, scanCount(index, 1000, 1099));
+    CHECK_EQ(0, scanCount(index, KEYS, INT_MAX));
+}
+
+static void testMemtable()
+{
+    LsmIndex index;
+    CHECK_EQ(0, index.open(dir.path("memtable.lsm"), 'w'));
+    insertKeys(index, 0);
+    checkKeys(index, 1);
+    CHECK_EQ(0, index.close());
+
+    // close() writes the memtable out
+    CHECK_EQ(0, index.open(dir.path("memtable.lsm"), 'r'));
+    checkKeys(index, 1);
+    CHECK_EQ(RC_INVALID_FILE_MODE, index.insert(0, ridOf(0)));
+    CHECK_EQ(0, index.close());
+}
+
+static void testCompaction()
+{
+    LsmIndex index;
+    index.setMemtableSize(SMALL_MEMTABLE);
+    CHECK_EQ(0, index.open(dir.path("compacted.lsm"), 'w'));
+    for (int c = 0; c < COPIES; c++)
+        insertKeys(index, c);
+    checkKeys(index, COPIES);
+    CHECK_EQ(0, index.close());
+
+    CHECK_EQ(0, index.open(dir.path("compacted.lsm"), 'r'));
+    checkKeys(index, COPIES);
+    CHECK_EQ(0, index.close());
+
+    // more runs on top of the ones from the last session
+    CHECK_EQ(0, index.open(dir.path("compacted.lsm"), 'w'));
+    insertKeys(index, COPIES);
+    checkKeys(index, COPIES + 1);
+    CHECK_EQ(0, index.close());
+}
+
+// a cursor keeps its place while the memtable is written out and the
+// runs it reads are compacted away
+static void testCursorAcrossFlush()
+{
+    LsmIndex  index;
+    LsmCursor cursor;
+    int       key, n = 0;
+    RecordId  rid;
+
+    index.setMemtableSize(SMALL_MEMTABLE);
+    CHECK_EQ(0, index.open(dir.path("cursor.lsm"), 'w'));
+    for (int k = 0; k < KEYS; k += 2)
+        CHECK_EQ(0, index.insert(k, ridOf(k)));
+
+    CHECK_EQ(0, index.locate(0, cursor));
+    for (; n < KEYS / 4; n++) {
+        CHECK_EQ(0, index.readForward(cursor, key, rid));
+        CHECK_EQ(2 * n, key);
+    }
+
+    // the odd keys inserted meanwhile may or may not show up, but every
+    // even key past the cursor does, once and in order
+    for (int k = 1; k < KEYS; k += 2)
+        CHECK_EQ(0, index.insert(k, ridOf(k)));
+    CHECK_EQ(0, index.flush());
+    int last = 2 * (n - 1);
+    while (index.readForward(cursor, key, rid) == 0) {
+        CHECK(key > last);
+        if (key % 2 == 0)
+            CHECK_EQ(2 * n++, key);
+        last = key;
+    }
+    CHECK_EQ(KEYS / 2, n);
+    CHECK_EQ(0, index.close());
+}
+
+int main()
+{
+    RUN(testMemtable);
+    RUN(testCompaction);
+    RUN(testCursorAcrossFlush);
+    return testResult();
+}
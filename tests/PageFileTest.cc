@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include <cstring>
+#include <string>
+#include <pthread.h>
+#include "PageFile.h"
+#include "Test.h"
+
+using namespace std;
+
+static TestDir dir;
+
+// the # pages of every test file, and the # threads and reads per thread
+// of the concurrent test
+static const int PAGES = 64;
+static const int THREADS = 4;
+static const int READS = 20000;
+
+// fill buffer with the content of page pid of file f, version v
+static void fillPage(char* buffer, int f, PageId pid, int v)
+{
+    memset(buffer, 0, PageFile::PAGE_SIZE);
+    int* intBufPtr = (int*) buffer;
+    intBufPtr[0] = f;
+    intBufPtr[1] = pid;
+    intBufPtr[2] = v;
+    memset(buffer + 3 * sizeof(int), (f * PAGES + pid + v) & 0xff,
+           PageFile::PAGE_SIZE - 3 * sizeof(int));
+}
+
+// check that buffer holds page pid of file f, version v
+static bool isPage(const char* buffer, int f, PageId pid, int v)
+{
+    char expected[PageFile::PAGE_SIZE];
+    fillPage(expected, f, pid, v);
+    return memcmp(buffer, expected, PageFile::PAGE_SIZE) == 0;
+}
+
+static void writeFile(const string& name, int f)
+{
+    PageFile pf;
+    char buffer[PageFile::PAGE_SIZE];
+    CHECK_EQ(0, pf.open(name, 'w'));
+    for (PageId pid = 0; pid < PAGES; pid++) {
+        fillPage(buffer, f, pid, 0);
+        CHECK_EQ(0, pf.write(pid, buffer));
+    }
+    CHECK_EQ(PAGES, pf.endPid());
+    CHECK_EQ(0, pf.close());
+}
+
+// a read after a write returns what was written, cached or not
+static void testReadAfterWrite()
+{
+    PageFile pf;
+    char buffer[PageFile::PAGE_SIZE];
+    writeFile(dir.path("rw"), 0);
+
+    CHECK_EQ(0, pf.open(dir.path("rw"), 'w'));
+    for (int v = 1; v < 4; v++) {
+        for (PageId pid = 0; pid < PAGES; pid++) {
+            CHECK_EQ(0, pf.read(pid, buffer));
+            CHECK(isPage(buffer, 0, pid, v - 1));
+            fillPage(buffer, 0, pid, v);
+            CHECK_EQ(0, pf.write(pid, buffer));
+        }
+    }
+    CHECK_EQ(RC_INVALID_PID, pf.read(PAGES, buffer));
+    CHECK_EQ(RC_INVALID_PID, pf.read(-1, buffer));
+    CHECK_EQ(0, pf.close());
+}
+
+// the cached pages of a closed file are not returned for the next file
+// that gets its descriptor
+static void testReusedDescriptor()
+{
+    PageFile pf;
+    char buffer[PageFile::PAGE_SIZE];
+    writeFile(dir.path("first"), 1);
+    writeFile(dir.path("second"), 2);
+
+    CHECK_EQ(0, pf.open(dir.path("first"), 'r'));
+    for (PageId pid = 0; pid < PAGES; pid++) {
+        CHECK_EQ(0, pf.read(pid, buffer));
+        CHECK(isPage(buffer, 1, pid, 0));
+    }
+    CHECK_EQ(0, pf.close());
+
+    CHECK_EQ(0, pf.open(dir.path("second"), 'r'));
+    for (PageId pid = 0; pid < PAGES; pid++) {
+        CHECK_EQ(0, pf.read(pid, buffer));
+        CHECK(isPage(buffer, 2, pid, 0));
+    }
+    CHECK_EQ(0, pf.close());
+}
+
+// what one thread of testConcurrentAccess does
+struct Worker {
+    int       f;        // the file of the thread
+    PageFile* own;      // the file that only this thread reads and writes
+    PageFile* shared;   // the file that every thread reads
+    int       errors;   // the # reads that returned the wrong page
+};
+
+static void* work(void* arg)
+{
+    Worker* w = (Worker*) arg;
+    char buffer[PageFile::PAGE_SIZE];
+    unsigned seed = w->f;
+
+    for (int i = 0; i < READS; i++) {
+        PageId pid = rand_r(&seed) % PAGES;
+        if (w->shared->read(pid, buffer) != 0 || !isPage(buffer, THREADS, pid, 0))
+            w->errors++;
+
+        // rewrite a page of the own file now and then, and read it back
+        pid = rand_r(&seed) % PAGES;
+        int v = (i % 16 == 0) ? i : 0;
+        if (v != 0) {
+            fillPage(buffer, w->f, pid, v);
+            if (w->own->write(pid, buffer) != 0)
+                w->errors++;
+        }
+        if (w->own->read(pid, buffer) != 0)
+            w->errors++;
+        else if (v != 0 && !isPage(buffer, w->f, pid, v))
+            w->errors++;
+        else if (*(int*) buffer != w->f)
+            w->errors++;
+    }
+    return NULL;
+}
+
+// threads that read and write their own files and read a shared one
+// through the shared cache
+static void testConcurrentAccess()
+{
+    PageFile  shared;
+    PageFile  own[THREADS];
+    Worker    workers[THREADS];
+    pthread_t threads[THREADS];
+
+    writeFile(dir.path("shared"), THREADS);
+    CHECK_EQ(0, shared.open(dir.path("shared"), 'r'));
+    for (int t = 0; t < THREADS; t++) {
+        string name = dir.path("own") + (char) ('0' + t);
+        writeFile(name, t);
+        CHECK_EQ(0, own[t].open(name, 'w'));
+        Worker w = { t, &own[t], &shared, 0 };
+        workers[t] = w;
+    }
+
+    for (int t = 0; t < THREADS; t++)
+        CHECK_EQ(0, pthread_create(&threads[t], NULL, work, &workers[t]));
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        CHECK_EQ(0, workers[t].errors);
+        CHECK_EQ(0, own[t].close());
+    }
+    CHECK_EQ(0, shared.close());
+}
+
+int main()
+{
+    RUN(testReadAfterWrite);
+    RUN(testReusedDescriptor);
+    RUN(testConcurrentAccess);
+    return testResult();
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Operator.h"
+#include "Test.h"
+
+using namespace std;
+
+// the # seconds a test may take before it counts as hung
+static const int TIMEOUT = 30;
+
+// the # morsels of a test plan, more than the workers may run ahead
+static const int MORSELS = 4 * ParallelPlan::MORSEL_WINDOW;
+
+/**
+ * A plan whose morsels produce one tuple each, except for morsel fail,
+ * which fails after the other workers had the time to run ahead of the
+ * printer.
+ */
+class FailingPlan : public ParallelPlan {
+ public:
+    FailingPlan(ResultSink& sink, int fail) : ParallelPlan(sink, MORSELS), fail(fail) { }
+
+ protected:
+    RC scanMorsel(int m, TupleBatch& batch, Morsel& result)
+    {
+        if (m == fail) {
+            usleep(200 * 1000);
+            return RC_FILE_READ_FAILED;
+        }
+        result.count = 1;
+        result.output = "0 'x'\n";
+        return 0;
+    }
+
+ private:
+    int fail;
+};
+
+static void onAlarm(int)
+{
+    static const char msg[] = "a test hung\n";
+    if (write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0) { }
+    _exit(1);
+}
+
+// a failed morsel stops the plan, also while workers wait for the
+// printer to make room
+static void testFailedMorsel()
+{
+    int fd = open("/dev/null", O_WRONLY);
+    CHECK(fd >= 0);
+
+    int fails[] = { 0, 1, MORSELS / 2, MORSELS - 1 };
+    for (unsigned i = 0; i < sizeof(fails) / sizeof(fails[0]); i++) {
+        for (int threads = 0; threads <= 4; threads += 2) {
+            ResultSink  sink(fd, SqlEngine::TEXT_OUTPUT, 3);
+            FailingPlan plan(sink, fails[i]);
+            int         count = 0;
+
+            alarm(TIMEOUT);
+            CHECK_EQ(RC_FILE_READ_FAILED, plan.run(threads, count));
+            alarm(0);
+            CHECK(count <= fails[i]);
+        }
+    }
+    close(fd);
+}
+
+int main()
+{
+    signal(SIGALRM, onAlarm);
+    RUN(testFailedMorsel);
+    return testResult();
+}
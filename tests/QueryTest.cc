@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Database.h"
+#include "QueryCursor.h"
+#include "Test.h"
+
+using namespace std;
+
+static TestDir dir;
+
+// the # tuples of the test tables, and the # distinct keys among them
+static const int TUPLES = 5000;
+static const int KEYS = 2000;
+
+// the # tuples of the table that ORDER BY cannot sort in memory
+static const int LARGE_TUPLES = Sort::MEMORY_TUPLES + Sort::MEMORY_TUPLES / 2;
+
+// the LIMIT and OFFSET values the tests try
+static const int LIMITS[] = { -1, 0, 1, 7, 100, TUPLES };
+static const int OFFSETS[] = { 0, 3, 50, TUPLES - 1, TUPLES + 10 };
+
+struct Row {
+    int    key;
+    string value;
+
+    bool operator< (const Row& r) const { return key < r.key || (key == r.key && value < r.value); }
+    bool operator== (const Row& r) const { return key == r.key && value == r.value; }
+};
+
+/**
+ * The tuples of the test tables: every key about TUPLES/KEYS times, in a
+ * scrambled order, with a few dozen distinct values.
+ */
+class QuerySource : public TupleSource {
+ public:
+    explicit QuerySource(int n = TUPLES) : n(n), i(0) { }
+
+    RC next(int& key, string& value)
+    {
+        char buf[16];
+        if (i >= n) return RC_END_OF_TREE;
+        key = (int) ((i * 7919LL) % KEYS);
+        snprintf(buf, sizeof(buf), "v%d", i % 37);
+        value = buf;
+        i++;
+        return 0;
+    }
+
+ private:
+    int n;
+    int i;
+};
+
+/**
+ * The WHERE clause of a test query. The SelCond values point into it.
+ */
+struct Where {
+    vector<SelCond> cond;
+    char            values[4][16];
+
+    Where() { }
+
+    // add the condition attr comp value
+    void add(int attr, SelCond::Comparator comp, const char* value)
+    {
+        SelCond c;
+        c.attr = attr;
+        c.comp = comp;
+        c.value = values[cond.size()];
+        snprintf(c.value, sizeof(values[0]), "%s", value);
+        cond.push_back(c);
+    }
+
+ private:
+    Where(const Where&);
+    Where& operator=(const Where&);
+};
+
+// the tables the tests query, one with each kind of index
+static const char* TABLES[] = { "plain", "btree", "hash", "lsm" };
+static const SqlEngine::IndexType TYPES[] = {
+    SqlEngine::NO_INDEX, SqlEngine::BTREE_INDEX, SqlEngine::HASH_INDEX, SqlEngine::LSM_INDEX
+};
+static const int TABLE_COUNT = 4;
+
+static Database db(dir.path(""));
+
+static void loadTables()
+{
+    for (int t = 0; t < TABLE_COUNT; t++) {
+        QuerySource source;
+        CHECK_EQ(0, db.loadTable(TABLES[t], TYPES[t], source));
+    }
+}
+
+// run SELECT * on table and collect the result in order
+static vector<Row> select(const char* table, const Where& where,
+                          int order, bool descending, int limit, int offset)
+{
+    vector<Row> rows;
+    QueryCursor cursor;
+    Table* t;
+    Row r;
+    string_view v;
+
+    CHECK_EQ(0, db.getTable(table, t));
+    CHECK_EQ(0, cursor.open(*t, 3, where.cond, order, descending, limit, offset));
+    while (cursor.next(r.key, v) == 0) {
+        r.value.assign(v.data(), v.size());
+        rows.push_back(r);
+    }
+    return rows;
+}
+
+static bool holds(int diff, SelCond::Comparator comp)
+{
+    switch (comp) {
+        case SelCond::EQ: return diff == 0;
+        case SelCond::NE: return diff != 0;
+        case SelCond::GT: return diff > 0;
+        case SelCond::LT: return diff < 0;
+        case SelCond::GE: return diff >= 0;
+        case SelCond::LE: return diff <= 0;
+    }
+    return false;
+}
+
+// the tuples of a full scan of the table without an index that meet the
+// conditions of where, in table order
+static vector<Row> scanAll(const Where& where)
+{
+    vector<Row> all = select("plain", Where(), 0, false, -1, 0);
+    vector<Row> rows;
+
+    CHECK_EQ(TUPLES, all.size());
+    for (unsigned i = 0; i < all.size(); i++) {
+        bool match = true;
+        for (unsigned c = 0; c < where.cond.size() && match; c++) {
+            const SelCond& s = where.cond[c];
+            int diff = (s.attr == 1) ? (all[i].key > atoi(s.value)) - (all[i].key < atoi(s.value))
+                                     : all[i].value.compare(s.value);
+            match = holds(diff, s.comp);
+        }
+        if (match)
+            rows.push_back(all[i]);
+    }
+    return rows;
+}
+
+// the # test queries
+static const int QUERY_COUNT = 5;
+
+// fill where with the conditions of test query q
+static void makeWhere(int q, Where& where)
+{
+    switch (q) {
+        case 0: break;
+        case 1: where.add(1, SelCond::GE, "500"); where.add(1, SelCond::LT, "900"); break;
+        case 2: where.add(1, SelCond::EQ, "1234"); break;
+        case 3: where.add(2, SelCond::LE, "v2"); break;
+        case 4: where.add(1, SelCond::GT, "1500"); where.add(2, SelCond::NE, "v5"); break;
+    }
+}
+
+// the # tuples LIMIT limit OFFSET offset leaves of n
+static int sliceSize(int n, int limit, int offset)
+{
+    int rest = max(0, n - offset);
+    return (limit < 0) ? rest : min(limit, rest);
+}
+
+// without ORDER BY the tuples may come in any order, and the plan may
+// change with the limit, but LIMIT and OFFSET always return the right
+// # matches
+static void testLimitOffset()
+{
+    for (int q = 0; q < QUERY_COUNT; q++) {
+        Where where;
+        makeWhere(q, where);
+        vector<Row> expected = scanAll(where);
+        sort(expected.begin(), expected.end());
+
+        for (int t = 0; t < TABLE_COUNT; t++) {
+            vector<Row> all = select(TABLES[t], where, 0, false, -1, 0);
+            sort(all.begin(), all.end());
+            CHECK(all == expected);
+
+            for (unsigned l = 0; l < sizeof(LIMITS) / sizeof(LIMITS[0]); l++) {
+                for (unsigned o = 0; o < sizeof(OFFSETS) / sizeof(OFFSETS[0]); o++) {
+                    vector<Row> rows = select(TABLES[t], where, 0, false, LIMITS[l], OFFSETS[o]);
+                    CHECK_EQ(sliceSize(expected.size(), LIMITS[l], OFFSETS[o]), rows.size());
+                    sort(rows.begin(), rows.end());
+                    CHECK(includes(expected.begin(), expected.end(), rows.begin(), rows.end()));
+                }
+            }
+        }
+    }
+}
+
+// the values of the ORDER BY attribute of rows
+static vector<string> orderColumn(const vector<Row>& rows, int order)
+{
+    vector<string> column;
+    char buf[16];
+    for (unsigned i = 0; i < rows.size(); i++) {
+        snprintf(buf, sizeof(buf), "%011d", rows[i].key + 1000000000);
+        column.push_back(order == 1 ? string(buf) : rows[i].value);
+    }
+    return column;
+}
+
+// check a result of ORDER BY order against the matches of a full scan:
+// the ORDER BY column is the slice of the sorted column, and every row is
+// a match. rows with the same ORDER BY value may come in any order.
+static void checkOrder(const vector<Row>& rows, const vector<Row>& matches,
+                       int order, bool descending, int limit, int offset)
+{
+    vector<string> column = orderColumn(matches, order);
+    sort(column.begin(), column.end());
+    if (descending)
+        reverse(column.begin(), column.end());
+    int begin = min((int) column.size(), offset);
+    int end = begin + sliceSize(column.size(), limit, offset);
+    CHECK(orderColumn(rows, order) == vector<string>(column.begin() + begin, column.begin() + end));
+
+    vector<Row> sorted(rows);
+    sort(sorted.begin(), sorted.end());
+    CHECK(includes(matches.begin(), matches.end(), sorted.begin(), sorted.end()));
+}
+
+static void testOrderBy()
+{
+    for (int q = 0; q < QUERY_COUNT; q++) {
+        Where where;
+        makeWhere(q, where);
+        vector<Row> expected = scanAll(where);
+        sort(expected.begin(), expected.end());
+
+        for (int t = 0; t < TABLE_COUNT; t++) {
+            for (int order = 1; order <= 2; order++) {
+                for (int descending = 0; descending < 2; descending++) {
+                    vector<Row> all = select(TABLES[t], where, order, descending, -1, 0);
+                    checkOrder(all, expected, order, descending, -1, 0);
+                    CHECK_EQ(expected.size(), all.size());
+
+                    for (unsigned l = 0; l < sizeof(LIMITS) / sizeof(LIMITS[0]); l++) {
+                        for (unsigned o = 0; o < sizeof(OFFSETS) / sizeof(OFFSETS[0]); o++) {
+                            vector<Row> rows = select(TABLES[t], where, order, descending,
+                                                      LIMITS[l], OFFSETS[o]);
+                            checkOrder(rows, expected, order, descending, LIMITS[l], OFFSETS[o]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// a table too large to sort in memory is sorted in runs and merged
+static void testExternalSort()
+{
+    QuerySource source(LARGE_TUPLES);
+    CHECK_EQ(0, db.loadTable("large", SqlEngine::NO_INDEX, source));
+
+    for (int descending = 0; descending < 2; descending++) {
+        vector<Row> rows = select("large", Where(), 2, descending, -1, 0);
+        CHECK_EQ(LARGE_TUPLES, rows.size());
+        for (unsigned i = 1; i < rows.size(); i++) {
+            const Row& a = rows[descending ? i : i - 1];
+            const Row& b = rows[descending ? i - 1 : i];
+            CHECK(a.value < b.value || (a.value == b.value && a.key <= b.key));
+        }
+
+        // with an offset past the heap size, the limit is sorted the same way
+        vector<Row> tail = select("large", Where(), 2, descending, 10, LARGE_TUPLES - 5);
+        CHECK_EQ(5, tail.size());
+        for (unsigned i = 0; i < tail.size(); i++)
+            CHECK(tail[i] == rows[LARGE_TUPLES - 5 + i]);
+    }
+}
+
+int main()
+{
+    loadTables();
+    RUN(testLimitOffset);
+    RUN(testOrderBy);
+    RUN(testExternalSort);
+    return testResult();
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include <climits>
+#include <cstdio>
+#include <string>
+#include "Database.h"
+#include "QueryCursor.h"
+#include "Test.h"
+
+using namespace std;
+
+static TestDir dir;
+
+// the # tuples of every load
+static const int LOAD_SIZE = 3000;
+
+/**
+ * The tuples of one load: the keys 0..LOAD_SIZE-1 in a scrambled order,
+ * with a value that names the load.
+ */
+class LoadSource : public TupleSource {
+ public:
+    explicit LoadSource(int load) : load(load), i(0) { }
+
+    RC next(int& key, string& value)
+    {
+        char buf[32];
+        if (i >= LOAD_SIZE) return RC_END_OF_TREE;
+        key = (int) ((i++ * 7919LL) % LOAD_SIZE);
+        snprintf(buf, sizeof(buf), "load%d", load);
+        value = buf;
+        return 0;
+    }
+
+ private:
+    int load;
+    int i;
+};
+
+// the # tuples a SELECT * with key = k returns
+static int countKey(Table& table, int k)
+{
+    char value[16];
+    vector<SelCond> cond(1);
+    QueryCursor cursor;
+    int key, n = 0;
+    string_view v;
+
+    snprintf(value, sizeof(value), "%d", k);
+    cond[0].attr = 1;
+    cond[0].comp = SelCond::EQ;
+    cond[0].value = value;
+    CHECK_EQ(0, cursor.open(table, 3, cond));
+    while (cursor.next(key, v) == 0) {
+        CHECK_EQ(k, key);
+        n++;
+    }
+    return n;
+}
+
+// load the table once with every index type in types, and after each
+// load check that every index the table has holds every tuple
+static void checkLoads(const char* name, const SqlEngine::IndexType* types, int loads)
+{
+    Database db(dir.path(""));
+    bool hasIndex = false, hasHash = false, hasLsm = false;
+
+    for (int l = 0; l < loads; l++) {
+        LoadSource source(l);
+        CHECK_EQ(0, db.loadTable(name, types[l], source));
+        hasIndex = hasIndex || types[l] == SqlEngine::BTREE_INDEX || types[l] == SqlEngine::BUFFERED_INDEX;
+        hasHash = hasHash || types[l] == SqlEngine::HASH_INDEX;
+        hasLsm = hasLsm || types[l] == SqlEngine::LSM_INDEX;
+
+        Table* t;
+        int n;
+        CHECK_EQ(0, db.getTable(name, t));
+        CHECK_EQ(hasIndex, t->getIndex() != NULL);
+        CHECK_EQ(hasHash, t->getHashIndex() != NULL);
+        CHECK_EQ(hasLsm, t->getLsmIndex() != NULL);
+        if (t->getIndex() != NULL)
+            CHECK_EQ((l + 1) * LOAD_SIZE, t->getIndex()->getRowCount());
+
+        CHECK_EQ(0, t->count(0, LOAD_SIZE, n));
+        CHECK_EQ((l + 1) * LOAD_SIZE, n);
+        CHECK_EQ(0, t->count(LOAD_SIZE / 3, 2 * LOAD_SIZE / 3 - 1, n));
+        CHECK_EQ((l + 1) * (LOAD_SIZE / 3), n);
+        CHECK_EQ(0, t->count(INT_MIN, INT_MAX, n));
+        CHECK_EQ((l + 1) * LOAD_SIZE, n);
+        CHECK_EQ(0, t->count(LOAD_SIZE / 2, LOAD_SIZE / 2 - 1, n));
+        CHECK_EQ(0, n);
+        for (int k = 0; k < LOAD_SIZE; k += 97)
+            CHECK_EQ(l + 1, countKey(*t, k));
+    }
+}
+
+static void testIndexThenHash()
+{
+    SqlEngine::IndexType types[] = { SqlEngine::BTREE_INDEX, SqlEngine::HASH_INDEX, SqlEngine::NO_INDEX };
+    checkLoads("indexThenHash", types, 3);
+}
+
+static void testHashThenIndex()
+{
+    SqlEngine::IndexType types[] = { SqlEngine::HASH_INDEX, SqlEngine::NO_INDEX, SqlEngine::BUFFERED_INDEX };
+    checkLoads("hashThenIndex", types, 3);
+}
+
+static void testIndexAfterTuples()
+{
+    SqlEngine::IndexType types[] = { SqlEngine::NO_INDEX, SqlEngine::NO_INDEX,
+                                     SqlEngine::BTREE_INDEX, SqlEngine::HASH_INDEX };
+    checkLoads("indexAfterTuples", types, 4);
+}
+
+static void testLsmAfterTuples()
+{
+    SqlEngine::IndexType types[] = { SqlEngine::NO_INDEX, SqlEngine::LSM_INDEX,
+                                     SqlEngine::NO_INDEX, SqlEngine::HASH_INDEX };
+    checkLoads("lsmAfterTuples", types, 4);
+}
+
+static void testLsmThenIndex()
+{
+    SqlEngine::IndexType types[] = { SqlEngine::LSM_INDEX, SqlEngine::BTREE_INDEX, SqlEngine::LSM_INDEX };
+    checkLoads("lsmThenIndex", types, 3);
+}
+
+int main()
+{
+    RUN(testIndexThenHash);
+    RUN(testHashThenIndex);
+    RUN(testIndexAfterTuples);
+    RUN(testLsmAfterTuples);
+    RUN(testLsmThenIndex);
+    return testResult();
+}
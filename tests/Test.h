@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+//
+// a minimal harness for the test programs in this directory. a test
+// program runs its test functions from main() and returns testResult().
+//
+
+// the # checks that failed so far
+static int testFailures = 0;
+
+// report a failed check without stopping the test
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      testFailures++; \
+    } \
+  } while (0)
+
+// report a failed check of two integers, with their values
+#define CHECK_EQ(expected, actual) \
+  do { \
+    long long e_ = (expected), a_ = (actual); \
+    if (e_ != a_) { \
+      fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", \
+              __FILE__, __LINE__, #expected, #actual, e_, a_); \
+      testFailures++; \
+    } \
+  } while (0)
+
+// run a test function and name it in the output
+#define RUN(test) \
+  do { \
+    int before_ = testFailures; \
+    test(); \
+    fprintf(stderr, "%s %s\n", (testFailures == before_) ? "  ok  " : "FAILED", #test); \
+  } while (0)
+
+/**
+ * A scratch directory for the files of a test program. It is removed
+ * with its files when the program ends.
+ */
+class TestDir {
+ public:
+  TestDir()
+  {
+    char name[] = "/tmp/bruinbase-test-XXXXXX";
+    if (mkdtemp(name) == NULL) {
+      perror("mkdtemp");
+      exit(2);
+    }
+    dir = name;
+  }
+
+  ~TestDir()
+  {
+    std::string cmd = "rm -rf '" + dir + "'";
+    if (system(cmd.c_str()) != 0)
+      fprintf(stderr, "could not remove %s\n", dir.c_str());
+  }
+
+  /**
+   * @param name[IN] a file name
+   * @return the path of the file in the directory
+   */
+  std::string path(const std::string& name) const { return dir + "/" + name; }
+
+ private:
+  std::string dir;
+};
+
+// the exit status of the test program
+static int testResult()
+{
+  if (testFailures > 0)
+    fprintf(stderr, "%d check(s) failed\n", testFailures);
+  return testFailures > 0 ? 1 : 0;
+}
+
+#endif /* TEST_H */